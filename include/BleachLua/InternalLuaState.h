@@ -24,6 +24,9 @@
 
 #pragma once
 #include "LuaIncludes.h"
+#include "LuaStl.h"
+#include "LuaError.h"
+#include <cstdint>
 
 //---------------------------------------------------------------------------------------------------------------------
 // Important!  This class is incomplete.  Specifically, the template functions GetGlobal() and SetGlobal() are defined 
@@ -41,14 +44,18 @@ class LuaVar;
 class LuaState
 {
     lua_State* m_pState;
+    mutable uint32_t m_globalsGeneration;  // see CachedGlobal in LuaCachedGlobal.h
+    luastl::vector<uint32_t> m_refCounts;  // the number of LuaVars sharing each registry ref, indexed by the ref
+    mutable luastl::vector<int> m_deferredUnrefs;  // registry refs waiting for FlushDeferredUnrefs()
+    bool m_isDeferringUnrefs;
 
 public:
     // construction
-    LuaState() noexcept : m_pState(nullptr) { }
+    LuaState() noexcept : m_pState(nullptr), m_globalsGeneration(1), m_isDeferringUnrefs(false) { }
     LuaState(const LuaState& right) = delete;
-    LuaState(LuaState&& right) noexcept : m_pState(right.m_pState) { right.m_pState = nullptr; }
+    LuaState(LuaState&& right) noexcept;
     LuaState& operator=(const LuaState& right) = delete;
-    LuaState& operator=(LuaState&& right) noexcept { m_pState = right.m_pState; right.m_pState = nullptr; return (*this); }
+    LuaState& operator=(LuaState&& right) noexcept;
     ~LuaState();
 
     // initialization
@@ -56,10 +63,43 @@ public:
 
     // Lua commands
     LuaVar LoadString(const char* str);
+    LuaVar LoadString(const char* str, const LuaVar& env);
     bool DoString(const char* str) const;
+    bool DoString(const char* str, const LuaVar& env) const;
     bool DoFile(const char* path);
+    bool DoFile(const char* path, const LuaVar& env);
     void ClearStack() const;
+
+    // sandboxing
+    LuaVar CreateEnvironment();
+    LuaVar CreateEnvironment(const LuaVar& parent);
+    void ResetSharedEnvironmentBase();
+
+    // garbage collection
     void CollectGarbage() const;
+    bool StepGarbageCollector(int stepSizeKb = 0) const;  // returns true if this step finished a collection cycle
+    void StopGarbageCollector() const;
+    void RestartGarbageCollector() const;
+    size_t GetMemoryUsage() const;  // in bytes
+    bool SetGenerationalGc(int minorMultiplier = 0, int majorMultiplier = 0) const;
+    bool SetIncrementalGc(int pause = 0, int stepMultiplier = 0, int stepSizeLog2 = 0) const;
+
+    // Deferred unrefs.  Normally, the LuaVar that releases the last reference to a value calls luaL_unref() right 
+    // away.  With deferring on, the ref is pushed onto a vector instead and all of them are unreffed together by 
+    // FlushDeferredUnrefs(), which is cheaper when lots of LuaVars die at once (e.g. tearing down entities).  A 
+    // deferred ref can't be read: no LuaVar refers to it anymore.  Its registry slot just keeps the value alive and 
+    // isn't reused until the flush.  Call FlushDeferredUnrefs() at a safe point, like the end of a frame.  
+    // CollectGarbage() and StepGarbageCollector() flush first, so the values can be collected.
+    void SetDeferUnrefs(bool defer);  // turning it off flushes
+    bool IsDeferringUnrefs() const { return m_isDeferringUnrefs; }
+    void DeferUnref(int ref) const { m_deferredUnrefs.push_back(ref); }
+    size_t FlushDeferredUnrefs() const;  // returns the number of refs released
+    size_t GetNumDeferredUnrefs() const { return m_deferredUnrefs.size(); }
+
+    // LuaVar ref counts.  These are only meant to be called by LuaVar.
+    void InitRefCount(int ref);
+    void AddRefCount(int ref) { ++m_refCounts[ref]; }
+    bool ReleaseRefCount(int ref);  // returns true if that was the last reference, so the ref should be unreffed
 
     // accessors
     lua_State* GetState() const { return m_pState; }
@@ -67,8 +107,39 @@ public:
     template <class Type> Type GetGlobal(const char* key);
     template <class Type> void SetGlobal(const char* key, Type&& value);
 
+    // Bumped by DoString(), DoFile(), and SetGlobal(), which invalidates every CachedGlobal.  Call 
+    // BumpGlobalsGeneration() after changing globals any other way.
+    uint32_t GetGlobalsGeneration() const { return m_globalsGeneration; }
+    void BumpGlobalsGeneration() const { if (++m_globalsGeneration == 0) m_globalsGeneration = 1; }
+
     // debug
     void DumpStack(const char* prefix = nullptr) const;
 };
 
+//---------------------------------------------------------------------------------------------------------------------
+// Starts the count for a registry ref that a LuaVar just created.  luaL_ref() reuses freed refs, so the array stays 
+// about as big as the most refs alive at once.
+//---------------------------------------------------------------------------------------------------------------------
+inline void LuaState::InitRefCount(int ref)
+{
+    LUA_ASSERT(ref > 0);
+    const size_t index = static_cast<size_t>(ref);
+    if (index >= m_refCounts.size())
+        m_refCounts.resize(index + 1, 0);  // grows the capacity geometrically
+    LUA_ASSERT(m_refCounts[index] == 0);
+    m_refCounts[index] = 1;
+}
+
+inline bool LuaState::ReleaseRefCount(int ref)
+{
+#if BLEACHLUA_DEBUG_MODE
+    if (m_refCounts[ref] == 0)
+    {
+        LUA_ERROR("Attempting to decrement ref count, but it's already 0.");
+        return false;
+    }
+#endif
+    return --m_refCounts[ref] == 0;
+}
+
 }  // end namespace BleachLua
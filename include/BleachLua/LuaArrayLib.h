@@ -0,0 +1,67 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaTypes.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+// Native loops over plain Lua arrays of numbers.  These work on ordinary tables, so they're useful for data that 
+// can't move to a typed array (because it's shared with other scripts, serialized, etc.).  Each function reads the 
+// array part with lua_rawgeti() in a C loop, so the per-element cost is a few API calls instead of a trip through the 
+// VM's loop, index, and arithmetic opcodes.  Metamethods are never invoked.
+// 
+// Call OpenArrayLib() once to add the bleach.array table:
+//      local total = bleach.array.sum(scores)
+//      local low, high = bleach.array.minmax(scores, 1, 10)   -- optional [first, last] range
+//      bleach.array.scale(weights, 0.5)                        -- in place
+//      local blended = bleach.array.lerp(from, to, 0.25)       -- new table, or pass a table to fill as the 4th arg
+//      local index = bleach.array.find(names, "bob")           -- any value type, compared with rawequal
+//      local numAbove = bleach.array.count_if_gt(scores, 100)
+//      bleach.sort_by(players, "score", "desc")              -- see SortArrayBy() below
+// 
+// The length of the array is its raw length (#t without __len), and any non-number element in a numeric function 
+// raises an error.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+void OpenArrayLib(LuaState* pState);
+
+//---------------------------------------------------------------------------------------------------------------------
+// Sorts an array of tables by the value each element has at a key, which is what bleach.sort_by() and 
+// LuaVar::SortBy() use.  The keys are read once with raw gets, sorted in C++ as (key, index) pairs, and the elements 
+// are then moved into place in a single pass.  The sort is stable.
+// 
+// Every element must be a table, and the keys must be all numbers (NaN isn't allowed) or all strings.  Strings are 
+// compared byte-wise.  This never raises a Lua error, so it's safe to call outside of a protected call.
+//      -pState:        The Lua state.
+//      -tableIndex:    The absolute stack index of the array.
+//      -keyIndex:      The absolute stack index of the key to sort by.
+//      -order:         Ascending or descending.
+//      -ppOutError:    If this isn't null, it's set to a description of the problem on failure.
+//      -return:        true if the array was sorted, false if the array was left unchanged because of bad input.
+//---------------------------------------------------------------------------------------------------------------------
+bool SortArrayBy(lua_State* pState, int tableIndex, int keyIndex, LuaSortOrder order, const char** ppOutError = nullptr);
+
+}  // end namespace BleachLua
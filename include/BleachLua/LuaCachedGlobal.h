@@ -0,0 +1,134 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaStl.h"
+#include "LuaState.h"
+#include "LuaFunction.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+// CachedGlobal resolves a global once and reuses the result until the globals might have changed.  It replaces the 
+// pattern of calling GetGlobal<LuaVar>() right before every call, which costs a string lookup in the globals table 
+// and a new registry ref each time.
+// 
+//      CachedGlobal<LuaFunction<void>> onUpdate(&luaState, "OnUpdate");
+//      ...
+//      onUpdate(deltaTime);  // resolved on the first call and after any DoFile(), DoString(), or SetGlobal()
+// 
+//      CachedGlobal<float> gravity(&luaState, "Gravity");
+//      float g = *gravity;
+// 
+// Invalidation uses LuaState's globals generation, which DoString(), DoFile(), SetGlobal(), and LuaModuleReloader 
+// bump, so a cached value is never used across a reload.  A script that assigns a global from inside a call (rather 
+// than at file scope) doesn't bump it; call LuaState::BumpGlobalsGeneration() or Invalidate() if that matters.  A 
+// __newindex hook on the globals table wouldn't help there either, since Lua only calls it for keys that don't exist 
+// yet.
+// 
+// Type can be anything GetGlobal() returns, or a LuaFunction.  For functions, IsValid() is false if the global isn't 
+// a function, and calling it logs an error and returns the default value.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+template <class Type>
+class CachedGlobal
+{
+    static constexpr bool kIsFunction = std::is_base_of<BaseLuaFunction, Type>::value;
+
+    LuaState* m_pState;
+    luastl::string m_name;
+    mutable luastl::optional<Type> m_value;
+    mutable uint32_t m_generation;  // the globals generation m_value was resolved in, or 0 if it needs resolving
+
+public:
+    CachedGlobal(LuaState* pState, const char* name) : m_pState(pState), m_name(name), m_generation(0) { LUA_ASSERT(pState); }
+
+    const Type& Get() const;
+    bool IsValid() const { Resolve(); return m_value.has_value(); }
+    const Type& operator*() const { return Get(); }
+    const Type* operator->() const { return &Get(); }
+    template <class... Args> auto operator()(Args&&... args) const;
+
+    void Invalidate() { m_generation = 0; }
+    const char* GetName() const { return m_name.c_str(); }
+
+private:
+    void Resolve() const;
+};
+
+template <class Type>
+const Type& CachedGlobal<Type>::Get() const
+{
+    Resolve();
+    LUA_ASSERT_MSG(m_value.has_value(), "Global " + m_name + " isn't a function.");
+    return *m_value;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Calls the cached function.  This is only available when Type is a LuaFunction.
+//      -args:      The arguments to pass to the function.
+//      -return:    Whatever the function returns, or the default value if the global isn't a function.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+template <class... Args>
+auto CachedGlobal<Type>::operator()(Args&&... args) const
+{
+    static_assert(kIsFunction, "Only a CachedGlobal of a LuaFunction can be called.");
+    using RetType = decltype(std::declval<const Type&>()(std::forward<Args>(args)...));
+
+    Resolve();
+    if (!m_value.has_value())
+    {
+        LUA_ERROR("Attempting to call global " + m_name + ", which isn't a function.");
+        if constexpr (std::is_void<RetType>::value)
+            return;
+        else
+            return StackHelpers::GetDefault<RetType>();
+    }
+    return (*m_value)(std::forward<Args>(args)...);
+}
+
+template <class Type>
+void CachedGlobal<Type>::Resolve() const
+{
+    const uint32_t generation = m_pState->GetGlobalsGeneration();
+    if (m_generation == generation)
+        return;
+    m_generation = generation;
+
+    if constexpr (kIsFunction)
+    {
+        LuaVar function = m_pState->GetGlobal<LuaVar>(m_name.c_str());
+        if (function.IsFunction())
+            m_value.emplace(std::move(function));
+        else
+            m_value.reset();
+    }
+    else
+    {
+        m_value.emplace(m_pState->GetGlobal<Type>(m_name.c_str()));
+    }
+}
+
+}  // end namespace BleachLua
@@ -0,0 +1,178 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaConfig.h"
+#include <type_traits>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Thin wrappers around the parts of the Lua C API whose signatures changed between the Lua versions BleachLua 
+// supports.  Everything here is inline and resolved at compile time, so there's no cost to going through them.
+//---------------------------------------------------------------------------------------------------------------------
+
+// Catch the case where BLEACHLUA_CORE_VERSION was changed without swapping out the Lua headers (or vice versa).  
+// LuaJIT reports itself as Lua 5.1.
+static_assert((LUA_VERSION_NUM / 100) * 10 + (LUA_VERSION_NUM % 10) == BLEACHLUA_CORE_VERSION, "BLEACHLUA_CORE_VERSION doesn't match the version of the Lua headers being compiled against.");
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaJIT implements the Lua 5.1 API plus a handful of 5.2 functions (lua_tonumberx(), lua_tointegerx(), 
+// luaL_traceback(), etc.).  These fill in the rest of what BleachLua uses.  Everything that needs extra space, 
+// lua_seti(), or native integers already has a 5.2 path, which LuaJIT shares.
+//---------------------------------------------------------------------------------------------------------------------
+#if BLEACHLUA_CORE_VERSION <= 51
+    #define LUA_OK 0
+    #define LUA_OPEQ 0
+    #define LUA_OPLT 1
+    #define LUA_OPLE 2
+
+    // LuaJIT has no integer subtype, so lua_Unsigned doesn't exist.  This is the unsigned counterpart of lua_Integer.
+    using lua_Unsigned = std::make_unsigned_t<lua_Integer>;
+#endif
+
+namespace BleachLua::Compat {
+
+//---------------------------------------------------------------------------------------------------------------------
+// Pushes the globals table.  Lua 5.1 stores it in a pseudo-index rather than the registry.
+//      -pState:    The Lua state.
+//---------------------------------------------------------------------------------------------------------------------
+inline void PushGlobalTable(lua_State* pState)
+{
+#if BLEACHLUA_CORE_VERSION >= 52
+    lua_pushglobaltable(pState);
+#else
+    lua_pushvalue(pState, LUA_GLOBALSINDEX);
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Returns the raw length of the value at the given index, without calling metamethods.  Lua 5.1 calls this 
+// lua_objlen().
+//      -pState:        The Lua state.
+//      -stackIndex:    The index of the value.
+//      -return:        The length.
+//---------------------------------------------------------------------------------------------------------------------
+inline size_t RawLen(lua_State* pState, int stackIndex)
+{
+#if BLEACHLUA_CORE_VERSION >= 52
+    return static_cast<size_t>(lua_rawlen(pState, stackIndex));
+#else
+    return lua_objlen(pState, stackIndex);
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Compares two values as Lua would, including metamethods.  Lua 5.1 has no lua_compare(), only lua_equal() and 
+// lua_lessthan(), so <= is built from those two.  This differs from a real <= only for objects with an __le 
+// metamethod that isn't consistent with their __eq and __lt metamethods.
+//      -pState:    The Lua state.
+//      -index1:    The index of the left operand.
+//      -index2:    The index of the right operand.
+//      -op:        One of LUA_OPEQ, LUA_OPLT, or LUA_OPLE.
+//      -return:    1 if the comparison is true, 0 if not.
+//---------------------------------------------------------------------------------------------------------------------
+inline int Compare(lua_State* pState, int index1, int index2, int op)
+{
+#if BLEACHLUA_CORE_VERSION >= 52
+    return lua_compare(pState, index1, index2, op);
+#else
+    switch (op)
+    {
+        case LUA_OPEQ: return lua_equal(pState, index1, index2);
+        case LUA_OPLT: return lua_lessthan(pState, index1, index2);
+        case LUA_OPLE: return (lua_lessthan(pState, index1, index2) || lua_equal(pState, index1, index2)) ? 1 : 0;
+        default: return 0;
+    }
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Allocates a new full userdata block and pushes it onto the stack.  Lua 5.4 replaced lua_newuserdata() with 
+// lua_newuserdatauv(), which also allocates user values.  Its compatibility macro asks for one user value, but most 
+// userdata never uses them, so we default to zero.  Earlier versions always have exactly one.
+//      -pState:            The Lua state.
+//      -size:              The size of the block in bytes.
+//      -numUserValues:     The number of user values to allocate (0 or 1; see SetUserValue()).
+//      -return:            The newly allocated block.
+//---------------------------------------------------------------------------------------------------------------------
+inline void* NewUserData(lua_State* pState, size_t size, int numUserValues = 0)
+{
+#if BLEACHLUA_CORE_VERSION >= 54
+    return lua_newuserdatauv(pState, size, numUserValues);
+#else
+    (void)numUserValues;
+    return lua_newuserdata(pState, size);
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Pops a table from the stack and sets it as the user value of the userdata at stackIndex.  This is how a userdata 
+// keeps Lua values alive without a registry ref.  In Lua 5.4, the userdata must have been created with a user value; 
+// in Lua 5.1, this is the userdata's environment table.
+//      -pState:        The Lua state.
+//      -stackIndex:    The index of the userdata.
+//---------------------------------------------------------------------------------------------------------------------
+inline void SetUserValue(lua_State* pState, int stackIndex)
+{
+#if BLEACHLUA_CORE_VERSION >= 54
+    lua_setiuservalue(pState, stackIndex, 1);
+#elif BLEACHLUA_CORE_VERSION >= 52
+    lua_setuservalue(pState, stackIndex);
+#else
+    lua_setfenv(pState, stackIndex);
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Pushes the user value set by SetUserValue().
+//      -pState:        The Lua state.
+//      -stackIndex:    The index of the userdata.
+//---------------------------------------------------------------------------------------------------------------------
+inline void GetUserValue(lua_State* pState, int stackIndex)
+{
+#if BLEACHLUA_CORE_VERSION >= 54
+    lua_getiuservalue(pState, stackIndex, 1);
+#elif BLEACHLUA_CORE_VERSION >= 52
+    lua_getuservalue(pState, stackIndex);
+#else
+    lua_getfenv(pState, stackIndex);
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Pops a table from the stack and makes it the global environment of a freshly loaded chunk.  In Lua 5.2 and later, 
+// that's the chunk's first upvalue (_ENV); in Lua 5.1, it's the function environment.
+//      -pState:        The Lua state.
+//      -funcIndex:     The absolute index of the chunk.
+//---------------------------------------------------------------------------------------------------------------------
+inline void SetChunkEnvironment(lua_State* pState, int funcIndex)
+{
+#if BLEACHLUA_CORE_VERSION >= 52
+    if (!lua_setupvalue(pState, funcIndex, 1))  // a chunk that uses no globals may not have an _ENV upvalue
+        lua_pop(pState, 1);
+#else
+    lua_setfenv(pState, funcIndex);
+#endif
+}
+
+}  // end namespace BleachLua::Compat
@@ -31,8 +31,12 @@
 //---------------------------------------------------------------------------------------------------------------------
 
 // Divide this by ten for the true major version.  For eample, 52 means Lua 5.2.  We ignore build versions since 
-// they are guaranteed to be compatible.
-#define BLEACHLUA_CORE_VERSION 53  // valid values are 52 and 53
+// they are guaranteed to be compatible.  Note that the Lua headers in include/lua are from Lua 5.3, so you'll need 
+// to replace them with the headers from the version you're linking against if you change this.
+// 
+// 51 means LuaJIT 2.1, which implements the Lua 5.1 API.  Stock Lua 5.1 isn't supported since BleachLua relies on 
+// several 5.2 functions that LuaJIT provides.  Like 5.2, LuaJIT has no extra space, so only one LuaState can exist.
+#define BLEACHLUA_CORE_VERSION 53  // valid values are 51 (LuaJIT), 52, 53, and 54
 
 // If set to 1, this will enable BleachLua unit tests to be called.  You have to call them manually (see LuaError.h 
 // for details).
@@ -76,24 +80,25 @@
     #endif
 #endif
 
-// Macros to wrap new & delete.  There is only one place BleachLua does heap allocation, which for the ref counts in 
-// LuaVar.  In the Bleach engine, I use a memory leak detector, so I have a specific macro that replaces new/delete.
-// You can find it here: https://github.com/bleachkitty/BleachLeakDetector
-// 
-// If you're using the Bleach Leak Detector, feel free to delete the conditional here.  You can also replace the 
-// #else clause if your code has its own system, or if you want to pool them or something.
-#if BLEACHLUA_USING_BLEACH_ENGINE
-    #define BLEACHLUA_NEW BLEACH_NEW
-    #define BLEACHLUA_DELETE BLEACH_DELETE
-#else
-    #define BLEACHLUA_NEW new
-    #define BLEACHLUA_DELETE delete
-#endif
+// In debug mode, every bound function call can record where it was called from in a small ring buffer so you can see 
+// the last few calls into C++ after a crash (see Debug::DumpRecentBoundCalls()).  Each entry costs a lua_getinfo() 
+// call, so this is off by default.  Set it to the number of calls to remember, or 0 to disable it.
+#define BLEACHLUA_BOUND_CALL_HISTORY_SIZE 0
 
-// This shouldn't be modified.  The Bleach engine uses memory pooling for LuaVar's ref count.  I have an extra flag 
-// for it because I need to be able to turn off memory pooling in case I need to debug a memory pool issue.
-#if BLEACHLUA_USING_BLEACH_ENGINE
-    #define BLEACHLUA_USE_MEMORY_POOLS 1
+// The libraries BleachLua provides to scripts (typed arrays, etc.) are registered under this global table.  Each one 
+// has to be opened explicitly with its Open***Lib() function.
+#define BLEACHLUA_LIB_TABLE_NAME "bleach"
+
+// The size of a StringId hash, in bits (32 or 64).  StringIds cross into Lua as integers, so 64-bit hashes require 
+// native 64-bit integers (Lua 5.3 or later); a double can only hold 32-bit hashes exactly.
+#define BLEACHLUA_STRING_ID_BITS 32
+
+// Set this to 1 to use SSE2 intrinsics in BleachLua's numeric kernels.  By default, it's enabled for any target that 
+// guarantees SSE2 (which includes all x64 targets).  If it's 0, the kernels are plain loops that are left to the 
+// compiler to vectorize.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define BLEACHLUA_USE_SSE 1
 #else
-    #define BLEACHLUA_USE_MEMORY_POOLS 0
+    #define BLEACHLUA_USE_SSE 0
 #endif
+
@@ -0,0 +1,218 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaVar.h"
+#include "LuaStl.h"
+#include <cstdint>
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaConfigCache flattens a tree of config tables into a C++ open-addressing hash map keyed by the hash of each dotted 
+// path, so reading a tuning value is a hash probe with no Lua API calls instead of a Lookup() through every table on 
+// the path.
+// 
+//      LuaConfigCache tuning(pState);
+//      tuning.Build(pState->GetGlobals().GetTableVar("Tuning"));
+//      float speed = tuning.Get<float>("Player.Movement.speed");
+//      constexpr auto kJumpHeight = LuaConfigCache::HashPath("Player.Movement.jumpHeight");
+//      float jump = tuning.Get<float>(kJumpHeight, 1.f);                  // default if it's missing
+//      auto hp = tuning.GetHandle<int>("Enemies.Grunt.hp");               // follows reloads
+//      int currentHp = hp.Get();
+// 
+// Every string or integer key becomes an entry (array elements are "list.1", "list.2", ...), including the keys of 
+// nested tables, which are stored as LuaVars.  Numbers are readable as any arithmetic type, strings as const char* or 
+// luastl::string, booleans as bool, and anything else (tables, functions, userdata) as a LuaVar.  Reading a value as 
+// the wrong type returns the default.
+// 
+// After the config script is reloaded, call Build() again with the new root, or RebuildSubtree() if only part of it 
+// changed.  Entries are diffed against the cache: values that didn't change aren't touched, entries that disappeared 
+// read as missing, and handles keep pointing at their entry, so they see new values without being looked up again.  
+// A const char* returned by Get() is only valid until the next rebuild.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+class LuaConfigCache;
+
+//---------------------------------------------------------------------------------------------------------------------
+// A handle to one entry in a LuaConfigCache.  It's a pointer to the cache and an index, so it's cheap to copy and 
+// reading it is an array access.  The handle must not outlive its cache.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+class LuaConfigHandle
+{
+    const LuaConfigCache* m_pCache;
+    uint32_t m_index;
+
+public:
+    LuaConfigHandle() : m_pCache(nullptr), m_index(0) { }
+    LuaConfigHandle(const LuaConfigCache* pCache, uint32_t index) : m_pCache(pCache), m_index(index) { }
+
+    Type Get(Type defaultValue = Type()) const;
+    bool IsPresent() const;  // false if the path isn't in the current config
+    bool IsValid() const { return m_pCache != nullptr; }
+    operator Type() const { return Get(); }
+};
+
+class LuaConfigCache
+{
+public:
+    using PathHash = uint64_t;
+    static constexpr PathHash kOffsetBasis = 14695981039346656037ull;
+    static constexpr PathHash kPrime = 1099511628211ull;
+
+    enum class ValueType : uint8_t
+    {
+        kMissing,
+        kNumber,
+        kBool,
+        kString,
+        kOther,  // tables, functions, userdata; read as a LuaVar
+    };
+
+private:
+    template <class Type> friend class LuaConfigHandle;
+
+    struct Value
+    {
+        ValueType m_type = ValueType::kMissing;
+        bool m_bool = false;
+        int64_t m_integer = 0;
+        double m_number = 0;
+        luastl::string m_string;
+        LuaVar m_var;
+        const void* m_pPointer = nullptr;  // identity of m_var, for diffing
+        luastl::string m_path;
+        PathHash m_hash = 0;
+        uint32_t m_buildId = 0;  // the last build that saw this entry
+    };
+
+    struct Slot
+    {
+        PathHash m_hash;  // 0 if empty
+        uint32_t m_index;
+    };
+
+    LuaState* m_pState;
+    luastl::vector<Slot> m_slots;  // power of two
+    luastl::vector<Value> m_values;  // never shrinks, so handle indices stay valid
+    luastl::vector<const void*> m_ancestors;  // tables on the path being flattened, to stop at cycles
+    size_t m_numPresent;
+    uint32_t m_buildId;
+    uint32_t m_version;
+
+public:
+    explicit LuaConfigCache(LuaState* pState);
+
+    // building
+    size_t Build(const LuaVar& root);  // returns the number of entries that changed
+    size_t RebuildSubtree(const char* path, const LuaVar& subtree);
+    void Clear();
+
+    // reading
+    static constexpr PathHash HashPath(const char* path, PathHash hash = kOffsetBasis);
+    template <class Type> Type Get(const char* path, Type defaultValue = Type()) const { return Get<Type>(HashPath(path), defaultValue); }
+    template <class Type> Type Get(PathHash hash, Type defaultValue = Type()) const;
+    template <class Type> LuaConfigHandle<Type> GetHandle(const char* path);
+    bool Has(const char* path) const;
+    ValueType GetType(const char* path) const;
+
+    size_t GetNumEntries() const { return m_numPresent; }
+    uint32_t GetVersion() const { return m_version; }  // changes whenever a rebuild changes a value
+
+private:
+    const Value* FindValue(PathHash hash) const;
+    uint32_t FindOrAddIndex(PathHash hash, const luastl::string& path);
+    void Grow();
+    void FlattenTable(lua_State* pState, int tableIndex, luastl::string& path, PathHash pathHash, size_t& numChanged);
+    bool SetValueFromStack(lua_State* pState, uint32_t index);
+    size_t RemoveStaleEntries(const char* prefix);
+
+    template <class Type> static Type ReadValue(const Value& value, Type defaultValue);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Hashes a path with 64-bit FNV-1a.  Passing the hash of a prefix continues from there, which is how the flattening 
+// hashes child paths without rehashing the parent.
+//---------------------------------------------------------------------------------------------------------------------
+constexpr LuaConfigCache::PathHash LuaConfigCache::HashPath(const char* path, PathHash hash)
+{
+    for (; *path; ++path)
+    {
+        hash ^= static_cast<PathHash>(static_cast<unsigned char>(*path));
+        hash *= kPrime;
+    }
+    return hash;
+}
+
+template <class Type>
+Type LuaConfigCache::Get(PathHash hash, Type defaultValue) const
+{
+    const Value* pValue = FindValue(hash);
+    return pValue ? ReadValue<Type>(*pValue, defaultValue) : defaultValue;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Returns a handle to a path.  The path doesn't have to exist yet; the handle reads as missing until a rebuild adds 
+// it.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+LuaConfigHandle<Type> LuaConfigCache::GetHandle(const char* path)
+{
+    return LuaConfigHandle<Type>(this, FindOrAddIndex(HashPath(path), luastl::string(path)));
+}
+
+template <class Type>
+Type LuaConfigCache::ReadValue(const Value& value, Type defaultValue)
+{
+    if constexpr (std::is_same<Type, bool>::value)
+        return (value.m_type == ValueType::kBool) ? value.m_bool : defaultValue;
+    else if constexpr (std::is_integral<Type>::value)
+        return (value.m_type == ValueType::kNumber) ? static_cast<Type>(value.m_integer) : defaultValue;
+    else if constexpr (std::is_floating_point<Type>::value)
+        return (value.m_type == ValueType::kNumber) ? static_cast<Type>(value.m_number) : defaultValue;
+    else if constexpr (std::is_same<Type, const char*>::value)
+        return (value.m_type == ValueType::kString) ? value.m_string.c_str() : defaultValue;
+    else if constexpr (std::is_same<Type, luastl::string>::value)
+        return (value.m_type == ValueType::kString) ? value.m_string : defaultValue;
+    else if constexpr (std::is_same<Type, LuaVar>::value)
+        return (value.m_type == ValueType::kOther) ? value.m_var : defaultValue;
+    else
+        static_assert(std::is_same<Type, void>::value, "LuaConfigCache can't read this type.");
+}
+
+template <class Type>
+Type LuaConfigHandle<Type>::Get(Type defaultValue) const
+{
+    LUA_ASSERT(m_pCache);
+    return LuaConfigCache::ReadValue<Type>(m_pCache->m_values[m_index], defaultValue);
+}
+
+template <class Type>
+bool LuaConfigHandle<Type>::IsPresent() const
+{
+    return m_pCache && m_pCache->m_values[m_index].m_type != LuaConfigCache::ValueType::kMissing;
+}
+
+}  // end namespace BleachLua
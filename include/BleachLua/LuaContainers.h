@@ -0,0 +1,99 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaVar.h"
+#include <cstdint>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Container userdata for the data structures scripts otherwise have to build on top of tables.  The bookkeeping 
+// (indices, heap order, sorted keys, bits) lives in C++.  Lua values are kept alive by a table stored as the 
+// container's user value, so the containers hold no registry refs and are collected like any other value.
+// 
+// Call OpenContainerLib() once to add the constructors to the BleachLua library table:
+//      local open = bleach.Heap()                      -- min-heap; bleach.Heap("max") for a max-heap
+//      open:push(startNode, 0)
+//      local node, cost = open:pop()                   -- equal priorities pop in insertion order
+// 
+//      local queue = bleach.Deque()                    -- ring buffer; grows by doubling
+//      queue:push_back(a); queue:push_front(b)
+//      local first = queue:pop_front()
+// 
+//      local byTime = bleach.SortedMap()               -- number or string keys, kept in order
+//      byTime:set(12.5, event)
+//      for time, event in byTime:pairs(10, 20) do ... end
+// 
+//      local visited = bleach.Bitset(4096)             -- 1-indexed, like tables
+//      visited:set(17)
+//      print(visited:test(17), visited:count())
+// 
+// None of these containers store nil.  See LuaContainers.cpp for the full list of methods.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaBitset
+// 
+// A fixed-size set of bits.  This class is the header of the userdata block; the bits follow it directly in the same 
+// allocation.  Unlike the other containers, this one is also useful from C++, so it's exposed here.  Indices in the 
+// C++ interface are 0-based.
+//---------------------------------------------------------------------------------------------------------------------
+class LuaBitset
+{
+    size_t m_size;
+
+public:
+    // The header is padded so the words stay as aligned as the userdata block itself.
+    static constexpr size_t kHeaderSize = 16;
+    static constexpr size_t kBitsPerWord = 64;
+
+    LuaBitset(const LuaBitset&) = delete;
+    LuaBitset& operator=(const LuaBitset&) = delete;
+
+    static LuaVar Create(LuaState* pState, size_t size);  // creates a new bitset with all bits cleared
+    static LuaBitset* FromVar(const LuaVar& var);  // returns nullptr if var isn't a bitset
+    static LuaBitset* FromStack(lua_State* pState, int stackIndex);  // returns nullptr if the value isn't a bitset
+    static LuaBitset* PushNew(lua_State* pState, size_t size);  // pushes a new bitset with all bits cleared
+
+    size_t GetSize() const { return m_size; }
+    size_t GetNumWords() const { return (m_size + kBitsPerWord - 1) / kBitsPerWord; }
+    uint64_t* GetWords() { return reinterpret_cast<uint64_t*>(reinterpret_cast<unsigned char*>(this) + kHeaderSize); }
+    const uint64_t* GetWords() const { return reinterpret_cast<const uint64_t*>(reinterpret_cast<const unsigned char*>(this) + kHeaderSize); }
+
+    bool Test(size_t index) const { LUA_ASSERT(index < m_size); return (GetWords()[index / kBitsPerWord] >> (index % kBitsPerWord)) & 1; }
+    void Set(size_t index, bool value = true);
+    void Reset(size_t index) { Set(index, false); }
+    void Toggle(size_t index) { LUA_ASSERT(index < m_size); GetWords()[index / kBitsPerWord] ^= (uint64_t(1) << (index % kBitsPerWord)); }
+    void SetAll(bool value);
+    size_t Count() const;
+    size_t FindNextSet(size_t index) const;  // returns GetSize() if there are no set bits at or after index
+
+private:
+    explicit LuaBitset(size_t size) : m_size(size) { }
+};
+
+void OpenContainerLib(LuaState* pState);
+
+}  // end namespace BleachLua
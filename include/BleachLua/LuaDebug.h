@@ -24,6 +24,7 @@
 
 #pragma once
 #include "LuaConfig.h"
+#include "LuaIncludes.h"
 
 #if BLEACHLUA_DEBUG_MODE
 
@@ -36,7 +37,81 @@ namespace BleachLua
     namespace Debug
     {
         luastl::string GetTraceback(LuaState* pState);
+
+        // Bound C++ functions place one of these on the stack for the duration of the call.  It remembers the 
+        // lua_State, and the Lua traceback is only built by GetBoundCallTraceback() if and when an error actually 
+        // fires (LUA_ERROR calls it in debug mode).  If you hit an assert instead, you can call it from the debugger's 
+        // immediate window.
+        // 
+        // A Lua error longjmps straight past the destructor, so the recorded state can outlive the scope, and there's 
+        // no hook to anchor it at the moment that happens.  Coroutines are anchored in the registry while a scope 
+        // points at them so that state never dangles.  That's the real cost: on the main thread, a scope is a 
+        // lua_pushthread() and two pointer writes, but a scope on a coroutine also does a registry lookup plus a 
+        // rawget and rawset on the anchor table at each end, unless the enclosing bound call is on the same coroutine 
+        // and already anchors it.  Every protected call from C++ goes through ProtectedCall() below, which saves and 
+        // restores one pointer and, when it's the outermost, does one registry rawset to release leftover anchors.
+        class BoundCallScope
+        {
+            lua_State* m_pPrevState;
+            lua_State* m_pAnchoredThread;
+
+        public:
+            explicit BoundCallScope(lua_State* pState);
+            BoundCallScope(const BoundCallScope&) = delete;
+            BoundCallScope& operator=(const BoundCallScope&) = delete;
+            ~BoundCallScope();
+        };
+
+        // Restores the innermost bound call to whatever it was when this was constructed.  The outermost barrier 
+        // also releases any coroutine anchors that were left behind by scopes an error skipped.
+        class BoundCallBarrier
+        {
+            lua_State* m_pState;
+            lua_State* m_pSavedState;
+
+        public:
+            explicit BoundCallBarrier(lua_State* pState);
+            BoundCallBarrier(const BoundCallBarrier&) = delete;
+            BoundCallBarrier& operator=(const BoundCallBarrier&) = delete;
+            ~BoundCallBarrier();
+        };
+
+        luastl::string GetBoundCallTraceback();
+
+        // Appends the bound call traceback to message, unless it already carries one (for example, anything that came 
+        // through an OnLuaException() handler).
+        luastl::string AppendBoundCallTraceback(luastl::string message);
+
+#if BLEACHLUA_BOUND_CALL_HISTORY_SIZE > 0
+        // One entry in the ring buffer of recent bound calls.  The source is copied since the Lua string it comes 
+        // from may be collected by the time anyone looks at it.
+        struct BoundCallSite
+        {
+            char m_source[LUA_IDSIZE];
+            int m_line;
+        };
+
+        void DumpRecentBoundCalls();
+#endif
     }
 }
 
-#endif  // NDEBUG
+#endif  // BLEACHLUA_DEBUG_MODE
+
+namespace BleachLua
+{
+    namespace Debug
+    {
+        //-------------------------------------------------------------------------------------------------------------
+        // Drop-in replacement for lua_pcall() for C++ code that calls into Lua.  In debug mode, it makes sure the 
+        // bound call tracking doesn't keep pointing at a scope that the error unwound past.
+        //-------------------------------------------------------------------------------------------------------------
+        inline int ProtectedCall(lua_State* pState, int numArgs, int numResults, int handlerIndex)
+        {
+#if BLEACHLUA_DEBUG_MODE
+            BoundCallBarrier barrier(pState);
+#endif
+            return lua_pcall(pState, numArgs, numResults, handlerIndex);
+        }
+    }
+}
@@ -38,7 +38,14 @@
 
     #define LUA_ASSERT assert
     #define LUA_ASSERT_MSG(_expr, _) assert((_expr))
-    #define LUA_ERROR(_str) std::cerr << (_str)
+    #if BLEACHLUA_DEBUG_MODE
+        // In debug mode, errors that fire from inside a bound function call also log the Lua traceback that led 
+        // there.  This is built lazily, so it only costs anything when an error actually happens.
+        #include "LuaDebug.h"
+        #define LUA_ERROR(_str) std::cerr << BleachLua::Debug::AppendBoundCallTraceback(_str)
+    #else
+        #define LUA_ERROR(_str) std::cerr << (_str)
+    #endif
     #define LUA_INFO(_str) std::cout << (_str)
 #endif
 
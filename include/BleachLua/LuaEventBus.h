@@ -0,0 +1,160 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaVar.h"
+#include "LuaStringId.h"
+#include <cstdint>
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaEventBus broadcasts events from C++ to Lua listener functions.  Listeners are stored per event as registry refs 
+// in a contiguous array, sorted by priority.  A dispatch converts the payload once and then calls every listener from 
+// inside a single protected call, instead of paying for a LuaFunction lookup, validation, and pcall per listener.  If 
+// a listener raises an error, it's logged and dispatch continues with the next listener.
+// 
+//      LuaEventBus bus(pState);
+//      auto id = bus.AddListener("OnDamage"_sid, scriptTable.GetTableVar("OnDamage"), 10);  // higher runs first
+//      bus.Dispatch("OnDamage"_sid, entityId, 25.f);       // immediately
+//      bus.Queue("OnDeath"_sid, entityId);                 // deferred until FlushQueue()
+//      bus.FlushQueue();                                   // once per frame
+// 
+// Listeners can be added and removed while the event is being dispatched.  Removal takes effect immediately; 
+// listeners added during a dispatch are first called on the next dispatch.  The bus must be destroyed before its 
+// LuaState.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+class LuaEventBus
+{
+public:
+    using ListenerId = uint32_t;
+    static constexpr ListenerId kInvalidListenerId = 0;
+
+private:
+    struct Listener
+    {
+        int m_ref;  // LUA_NOREF once removed
+        int m_priority;
+        ListenerId m_id;
+    };
+
+    struct EventListeners
+    {
+        luastl::vector<Listener> m_listeners;
+        luastl::vector<Listener> m_pendingAdds;  // listeners added while dispatching
+        int m_dispatchDepth = 0;
+        bool m_needsCompaction = false;
+    };
+
+    struct DispatchContext
+    {
+        const luastl::vector<Listener>* m_pListeners;
+        size_t m_next;  // the next listener to call
+    };
+
+    struct QueuedEvent
+    {
+        StringId m_eventId;
+        int m_firstArg;  // index of the first payload value in the queue table
+        int m_numArgs;
+    };
+
+    LuaState* m_pState;
+    luastl::unordered_map<StringId::HashType, EventListeners> m_events;
+    luastl::vector<QueuedEvent> m_queuedEvents;
+    luastl::vector<QueuedEvent> m_flushingEvents;  // kept around to reuse its memory
+    LuaVar m_queueTable;  // the payloads of queued events, stored flat
+    LuaVar m_spareQueueTable;  // swapped with m_queueTable on each flush
+    int m_queueTableSize;
+    ListenerId m_nextListenerId;
+    bool m_isFlushing;
+    bool m_isFlushRequested;  // FlushQueue() was called from inside a listener during a flush
+
+public:
+    explicit LuaEventBus(LuaState* pState);
+    ~LuaEventBus();
+    LuaEventBus(const LuaEventBus&) = delete;
+    LuaEventBus& operator=(const LuaEventBus&) = delete;
+
+    // listeners
+    ListenerId AddListener(StringId eventId, const LuaVar& function, int priority = 0);
+    bool RemoveListener(StringId eventId, ListenerId listenerId);
+    void RemoveAllListeners(StringId eventId);
+    size_t GetNumListeners(StringId eventId) const;
+
+    // dispatch
+    template <class... Args> void Dispatch(StringId eventId, Args&&... args);  // calls the listeners now
+    template <class... Args> void Queue(StringId eventId, Args&&... args);  // calls the listeners on FlushQueue()
+    void FlushQueue();
+
+private:
+    EventListeners* FindListeners(StringId eventId);
+    void FlushQueuedEvents();
+    void DispatchFromStack(EventListeners& listeners, int numArgs);
+    static int CallListeners(lua_State* pState);
+    void FinishDispatch(EventListeners& listeners);
+    void InsertListener(luastl::vector<Listener>& listeners, const Listener& listener);
+    void PushQueueTable();
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Calls every listener for an event with the given payload.  If there are no listeners, the payload isn't converted.
+//      -eventId:   The event.
+//      -args:      The payload, which can be anything StackHelpers can push.
+//---------------------------------------------------------------------------------------------------------------------
+template <class... Args>
+void LuaEventBus::Dispatch(StringId eventId, Args&&... args)
+{
+    EventListeners* pListeners = FindListeners(eventId);
+    if (!pListeners || pListeners->m_listeners.empty())
+        return;
+
+    (StackHelpers::Push(m_pState, std::forward<Args>(args)), ...);         //  [args...]
+    DispatchFromStack(*pListeners, static_cast<int>(sizeof...(Args)));     //  []
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Queues an event to be dispatched on the next call to FlushQueue().  The payload is converted now.
+//      -eventId:   The event.
+//      -args:      The payload, which can be anything StackHelpers can push.
+//---------------------------------------------------------------------------------------------------------------------
+template <class... Args>
+void LuaEventBus::Queue(StringId eventId, Args&&... args)
+{
+    lua_State* pState = m_pState->GetState();
+    const int firstArg = m_queueTableSize + 1;
+
+    PushQueueTable();                                                       //  [queue]
+    ([&]()
+    {
+        StackHelpers::Push(m_pState, std::forward<Args>(args));             //  [queue, arg]
+        lua_rawseti(pState, -2, ++m_queueTableSize);                        //  [queue]
+    }(), ...);
+    lua_pop(pState, 1);                                                     //  []
+
+    m_queuedEvents.push_back(QueuedEvent{ eventId, firstArg, static_cast<int>(sizeof...(Args)) });
+}
+
+}  // end namespace BleachLua
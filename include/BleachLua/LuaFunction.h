@@ -27,9 +27,12 @@
 #include "StackHelpers.h"
 #include "LuaVar.h"
 #include "LuaState.h"
+#include "LuaResult.h"
 
 namespace BleachLua {
 
+template <class RetType> class LuaMemoizedFunction;
+
 //---------------------------------------------------------------------------------------------------------------------
 // Base Lua Function.  This is an internal class; use the template class below.
 //---------------------------------------------------------------------------------------------------------------------
@@ -45,6 +48,7 @@ public:
 protected:
     template <class Arg, class... RemainingArgs> void PushArguments(Arg arg, RemainingArgs... remainingArgs) const;
     template <class Arg> void PushArguments(Arg arg) const;
+    template <class RetType, class... Args> LuaResult<RetType> TryCallHelper(Args... args) const;
 
     bool CheckFunctionVar() const;
     static int OnLuaException(lua_State* pState);
@@ -65,6 +69,46 @@ void BaseLuaFunction::PushArguments(Arg arg) const
     StackHelpers::Push<Arg>(m_functionVar.GetLuaState(), arg);
 }
 
+//---------------------------------------------------------------------------------------------------------------------
+// Worker function for TryCall().  Unlike operator(), this doesn't push OnLuaException() as the message handler since 
+// that builds the full traceback string on every failure.  Instead, the raw error object is kept in the returned 
+// LuaErrorInfo and the message is only built if someone asks for it.
+//      -args:      The arguments to pass to the Lua function.
+//      -return:    The converted return value or the reason the call failed.
+//---------------------------------------------------------------------------------------------------------------------
+template <class RetType, class... Args>
+LuaResult<RetType> BaseLuaFunction::TryCallHelper(Args... args) const
+{
+    LuaState* pCppState = m_functionVar.GetLuaState();
+    if (!m_functionVar.IsValid())
+        return LuaErrorInfo(LuaErrorCode::kInvalidFunction, LUA_TNIL);
+
+    lua_State* pState = pCppState->GetState();
+    StackHelpers::StackResetter resetter(pState, lua_gettop(pState));
+
+    // push the function and make sure it's actually a function
+    m_functionVar.PushValueToStack();                                                   //  [func]
+    if (const int type = lua_type(pState, -1); type != LUA_TFUNCTION)
+        return LuaErrorInfo(LuaErrorCode::kInvalidFunction, type);                      //  []  <-- from StackResetter
+
+    // push the params and call the function
+    if constexpr (sizeof...(Args) > 0)
+        PushArguments(args...);                                                         //  [func, args...]
+    constexpr int kNumResults = luastl::is_void_v<RetType> ? 0 : 1;
+    const int result = Debug::ProtectedCall(pState, sizeof...(Args), kNumResults, 0);   //  [ret|error]
+    if (result != LUA_OK)
+    {
+        const LuaErrorCode code = (result == LUA_ERRMEM) ? LuaErrorCode::kMemoryError : LuaErrorCode::kRuntimeError;
+        return LuaErrorInfo(code, LuaVar::CreateFromStack(pCppState));                  //  []
+    }
+
+    // get the return
+    if constexpr (luastl::is_void_v<RetType>)
+        return LuaResult<void>();
+    else
+        return StackHelpers::TryGet<RetType>(pCppState);                                //  []  <-- from StackResetter
+}
+
 
 //---------------------------------------------------------------------------------------------------------------------
 // Lua Function.  This defines a single, callable Lua function.
@@ -78,6 +122,12 @@ public:
 
     template <class... Args> RetType operator()(Args... args) const;
     RetType operator()() const;
+
+    // Error-code version of operator().  Nothing is logged; check the result instead.
+    template <class... Args> LuaResult<RetType> TryCall(Args... args) const { return TryCallHelper<RetType>(args...); }
+
+    // Wraps a pure function in a C++ result cache.  See LuaMemoize.h, which defines this.
+    LuaMemoizedFunction<RetType> Memoize(size_t capacity) const;
 };
 
 template <class RetType>
@@ -99,7 +149,7 @@ RetType LuaFunction<RetType>::operator()(Args... args) const
 
     // push the params
     PushArguments(args...);                                                                                     //  [exHandler, func, args...]
-    const int result = lua_pcall(pState, sizeof...(Args), 1, GetExceptionHandlerStackOffset(sizeof...(Args)));  //  [exHandler, ret|error]
+    const int result = Debug::ProtectedCall(pState, sizeof...(Args), 1, GetExceptionHandlerStackOffset(sizeof...(Args)));  //  [exHandler, ret|error]
     if (result != LUA_OK)
     {
         LUA_ERROR(lua_tostring(pState, -1));
@@ -125,7 +175,7 @@ RetType LuaFunction<RetType>::operator()() const
 
     // call the function
     m_functionVar.PushValueToStack();                                                   //  [exHandler, func]
-    const int result = lua_pcall(pState, 0, 1, -2);                                     //  [exHandler, ret|error]
+    const int result = Debug::ProtectedCall(pState, 0, 1, -2);                          //  [exHandler, ret|error]
     if (result != LUA_OK)
     {
         LUA_ERROR(lua_tostring(pState, -1));
@@ -148,6 +198,9 @@ public:
 
     template <class... Args> void operator()(Args... args) const;
     void operator()() const;
+
+    // Error-code version of operator().  Nothing is logged; check the result instead.
+    template <class... Args> LuaResult<void> TryCall(Args... args) const { return TryCallHelper<void>(args...); }
 };
 
 template <class... Args>
@@ -168,7 +221,7 @@ void LuaFunction<void>::operator()(Args... args) const
 
     // push the params
     PushArguments(args...);                                                                                     //  [exHandler, func, args...]
-    const int result = lua_pcall(pState, sizeof...(Args), 0, GetExceptionHandlerStackOffset(sizeof...(Args)));  //  [exHandler, ret|error]
+    const int result = Debug::ProtectedCall(pState, sizeof...(Args), 0, GetExceptionHandlerStackOffset(sizeof...(Args)));  //  [exHandler, ret|error]
     if (result != LUA_OK)
         LUA_ERROR(lua_tostring(pState, -1));
 }                                                                                                               //  []  <-- from StackResetter
@@ -34,5 +34,8 @@ extern "C" {
 
 #ifdef __cplusplus
 }
+
+// shims for differences between Lua versions
+#include "LuaCompat.h"
 #endif
 
@@ -0,0 +1,81 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaTypeTraits.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+// Small vector math types for gameplay code.  Each value is a userdata that holds its floats inline (a vec3 is 12 
+// bytes of payload), so there's no table, no string keys, and no per-component TValue.  The arithmetic runs in C++ as 
+// metamethods; vec4, quat, and mat4 use SSE when BLEACHLUA_USE_SSE is on.  vec2 and vec3 are too narrow for SIMD to 
+// pay for the loads, so they use plain loops the compiler can unroll.
+// 
+// Operators always create a new value.  In hot loops, use the _inplace methods instead, which write into the left 
+// operand and return it, so no garbage is created at all:
+//      local pos = bleach.vec3(0, 1, 0)
+//      local vel = bleach.vec3(1, 0, 0)
+//      local next = pos + vel * dt                     -- two new vec3s
+//      pos:add_scaled_inplace(vel, dt)                 -- no allocations
+//      local rot = bleach.quat_axis_angle(bleach.vec3(0, 1, 0), math.pi / 2)
+//      local world = bleach.mat4_trs(pos, rot, bleach.vec3(1, 1, 1))
+//      print(world * bleach.vec3(1, 0, 0), pos.x, #pos)
+// 
+// Call OpenMathLib() once to register the types and add their constructors to the BleachLua library table.  See 
+// LuaMath.cpp for the full list of methods.
+// 
+// The matching C++ types have LuaTraits, so bound functions and LuaFunction calls can use them directly as 
+// parameters and return values; getting one is a 4-16 float copy straight out of the userdata.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+struct LuaVec2 { float x, y; };
+struct LuaVec3 { float x, y, z; };
+struct LuaVec4 { float x, y, z, w; };
+struct LuaQuat { float x, y, z, w; };  // identity is (0, 0, 0, 1)
+struct LuaMat4 { float m[16]; };  // column-major: m[column * 4 + row]
+
+//---------------------------------------------------------------------------------------------------------------------
+// Shared LuaTraits implementation for the math types.  Pushing requires OpenMathLib() to have been called on the 
+// state.  Getting a value that isn't the right type returns the default (zero for vectors, identity for quat and 
+// mat4), the same way Get<int>() returns 0 for a non-number.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+struct LuaMathTraits
+{
+    static void Push(LuaState* pState, const Type& value);
+    static Type Get(LuaState* pState, int stackIndex);
+    static bool Is(LuaState* pState, int stackIndex);
+    static Type GetDefault();
+};
+
+template <> struct LuaTraits<LuaVec2> : LuaMathTraits<LuaVec2> { };
+template <> struct LuaTraits<LuaVec3> : LuaMathTraits<LuaVec3> { };
+template <> struct LuaTraits<LuaVec4> : LuaMathTraits<LuaVec4> { };
+template <> struct LuaTraits<LuaQuat> : LuaMathTraits<LuaQuat> { };
+template <> struct LuaTraits<LuaMat4> : LuaMathTraits<LuaMat4> { };
+
+void OpenMathLib(LuaState* pState);
+
+}  // end namespace BleachLua
@@ -0,0 +1,349 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaFunction.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaMemoizedFunction wraps a pure Lua function (damage formulas, procedural lookups, etc.) in an LRU cache on the 
+// C++ side.  The arguments are packed into a small key and hashed without touching Lua, so a hit returns the cached 
+// result without pushing anything or calling lua_pcall().  A miss calls the function and caches the converted result.
+// 
+//      LuaMemoizedFunction<float> damage = LuaFunction<float>(globals.GetTableVar("CalcDamage")).Memoize(256);
+//      float amount = damage(attackerLevel, "fire");
+//      damage.Invalidate();                            // after the formula is reloaded
+//      float hitRate = damage.GetHitRate();
+// 
+// Only numbers, bools, and strings can be part of a key.  Calls with any other argument type (tables, LuaVars, etc.), 
+// or whose key doesn't fit in kMaxKeyBytes, go straight through to the function and are counted as uncacheable.  
+// Integers and floats make different keys, so f(1) and f(1.0) are cached separately.  Calls that fail aren't cached.
+// 
+// The function must actually be pure; nothing checks.  Results are copies, so a LuaVar result (like a table or a 
+// string) is shared by every hit.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+template <class RetType>
+class LuaMemoizedFunction
+{
+    static_assert(!std::is_void<RetType>::value, "There's nothing to memoize for a function with no return value.");
+    static_assert(!std::is_same<RetType, const char*>::value, "A memoized function can't return const char* since the string isn't kept alive; use LuaVar.");
+
+public:
+    static constexpr size_t kMaxKeyBytes = 48;
+
+private:
+    static constexpr uint32_t kEmpty = 0xffffffff;
+
+    struct Entry
+    {
+        uint64_t m_hash = 0;
+        uint32_t m_prev = kEmpty;  // towards most recently used
+        uint32_t m_next = kEmpty;  // towards least recently used
+        uint8_t m_keyLength = 0;
+        char m_key[kMaxKeyBytes];
+        RetType m_value = RetType();
+    };
+
+    LuaFunction<RetType> m_function;
+    luastl::vector<Entry> m_entries;
+    luastl::vector<uint32_t> m_slots;  // open addressing over m_entries, power of two
+    uint32_t m_mostRecent;
+    uint32_t m_leastRecent;
+    size_t m_capacity;
+    size_t m_numHits;
+    size_t m_numMisses;
+    size_t m_numUncacheable;
+
+public:
+    LuaMemoizedFunction(const LuaFunction<RetType>& function, size_t capacity);
+
+    template <class... Args> RetType operator()(const Args&... args);
+    void Invalidate();
+
+    // stats
+    size_t GetNumHits() const { return m_numHits; }
+    size_t GetNumMisses() const { return m_numMisses; }
+    size_t GetNumUncacheable() const { return m_numUncacheable; }
+    float GetHitRate() const { const size_t total = m_numHits + m_numMisses; return (total > 0) ? static_cast<float>(m_numHits) / static_cast<float>(total) : 0.f; }
+    void ResetStats() { m_numHits = m_numMisses = m_numUncacheable = 0; }
+    size_t GetSize() const { return m_entries.size(); }
+    size_t GetCapacity() const { return m_capacity; }
+
+private:
+    template <class Arg> static bool AppendKey(char* pKey, size_t& length, const Arg& arg);
+    static bool AppendBytes(char* pKey, size_t& length, char tag, const void* pData, size_t size);
+    static uint64_t HashKey(const char* pKey, size_t length);
+
+    uint32_t Find(uint64_t hash, const char* pKey, size_t length) const;
+    void Insert(uint64_t hash, const char* pKey, size_t length, RetType&& value);
+    void RemoveFromSlots(uint32_t entryIndex);
+    void Unlink(uint32_t entryIndex);
+    void LinkAsMostRecent(uint32_t entryIndex);
+};
+
+template <class RetType>
+LuaMemoizedFunction<RetType> LuaFunction<RetType>::Memoize(size_t capacity) const
+{
+    return LuaMemoizedFunction<RetType>(*this, capacity);
+}
+
+template <class RetType>
+LuaMemoizedFunction<RetType>::LuaMemoizedFunction(const LuaFunction<RetType>& function, size_t capacity)
+    : m_function(function)
+    , m_mostRecent(kEmpty)
+    , m_leastRecent(kEmpty)
+    , m_capacity(capacity > 0 ? capacity : 1)
+    , m_numHits(0)
+    , m_numMisses(0)
+    , m_numUncacheable(0)
+{
+    size_t numSlots = 8;
+    while (numSlots < m_capacity * 2)
+        numSlots *= 2;
+    m_slots.assign(numSlots, kEmpty);
+    m_entries.reserve(m_capacity);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Returns the cached result for these arguments, or calls the function and caches the result.
+//      -args:      The arguments.
+//      -return:    The result, or the default value if the call failed.
+//---------------------------------------------------------------------------------------------------------------------
+template <class RetType>
+template <class... Args>
+RetType LuaMemoizedFunction<RetType>::operator()(const Args&... args)
+{
+    char key[kMaxKeyBytes];
+    size_t length = 0;
+    const bool cacheable = (AppendKey(key, length, args) && ...);
+    if (!cacheable)
+    {
+        ++m_numUncacheable;
+        return m_function(args...);
+    }
+
+    const uint64_t hash = HashKey(key, length);
+    const uint32_t found = Find(hash, key, length);
+    if (found != kEmpty)
+    {
+        ++m_numHits;
+        Unlink(found);
+        LinkAsMostRecent(found);
+        return m_entries[found].m_value;
+    }
+
+    ++m_numMisses;
+    LuaResult<RetType> result = m_function.TryCall(args...);
+    if (!result.IsOk())
+    {
+        LUA_ERROR("Memoized function failed: " + result.GetError().GetMessage());
+        return StackHelpers::GetDefault<RetType>();
+    }
+
+    RetType value = std::move(result.GetValue());
+    Insert(hash, key, length, RetType(value));
+    return value;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Drops every cached result, for when the function (or anything it reads) changes.  The stats are kept.
+//---------------------------------------------------------------------------------------------------------------------
+template <class RetType>
+void LuaMemoizedFunction<RetType>::Invalidate()
+{
+    m_entries.clear();
+    std::fill(m_slots.begin(), m_slots.end(), kEmpty);
+    m_mostRecent = kEmpty;
+    m_leastRecent = kEmpty;
+}
+
+template <class RetType>
+template <class Arg>
+bool LuaMemoizedFunction<RetType>::AppendKey(char* pKey, size_t& length, const Arg& arg)
+{
+    using DecayedArg = std::decay_t<Arg>;
+    if constexpr (std::is_same<DecayedArg, bool>::value)
+    {
+        const char value = arg ? 1 : 0;
+        return AppendBytes(pKey, length, 'b', &value, 1);
+    }
+    else if constexpr (std::is_integral<DecayedArg>::value || std::is_enum<DecayedArg>::value)
+    {
+        const int64_t value = static_cast<int64_t>(arg);
+        return AppendBytes(pKey, length, 'i', &value, sizeof(value));
+    }
+    else if constexpr (std::is_floating_point<DecayedArg>::value)
+    {
+        const double value = (arg == 0) ? 0.0 : static_cast<double>(arg);  // -0 and +0 are the same key
+        return AppendBytes(pKey, length, 'f', &value, sizeof(value));
+    }
+    else if constexpr (std::is_same<DecayedArg, const char*>::value || std::is_same<DecayedArg, char*>::value)
+    {
+        // a string literal comes through as an array, which can't be null (and testing it would warn)
+        size_t size = 0;
+        if constexpr (std::is_pointer<Arg>::value)
+            size = arg ? strlen(arg) : 0;
+        else
+            size = strlen(arg);
+        if (size > 255)
+            return false;
+
+        const uint8_t sizeByte = static_cast<uint8_t>(size);
+        return AppendBytes(pKey, length, 's', &sizeByte, 1) && AppendBytes(pKey, length, ':', arg, size);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+// Appends a type tag and the bytes of a value.
+template <class RetType>
+bool LuaMemoizedFunction<RetType>::AppendBytes(char* pKey, size_t& length, char tag, const void* pData, size_t size)
+{
+    if (length + 1 + size > kMaxKeyBytes)
+        return false;
+    pKey[length++] = tag;
+    if (size > 0)
+        memcpy(pKey + length, pData, size);
+    length += size;
+    return true;
+}
+
+template <class RetType>
+uint64_t LuaMemoizedFunction<RetType>::HashKey(const char* pKey, size_t length)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= static_cast<uint64_t>(static_cast<unsigned char>(pKey[i]));
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+template <class RetType>
+uint32_t LuaMemoizedFunction<RetType>::Find(uint64_t hash, const char* pKey, size_t length) const
+{
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = static_cast<size_t>(hash) & mask; m_slots[i] != kEmpty; i = (i + 1) & mask)
+    {
+        const Entry& entry = m_entries[m_slots[i]];
+        if (entry.m_hash == hash && entry.m_keyLength == length && memcmp(entry.m_key, pKey, length) == 0)
+            return m_slots[i];
+    }
+    return kEmpty;
+}
+
+template <class RetType>
+void LuaMemoizedFunction<RetType>::Insert(uint64_t hash, const char* pKey, size_t length, RetType&& value)
+{
+    // reuse the least recently used entry when full
+    uint32_t entryIndex;
+    if (m_entries.size() < m_capacity)
+    {
+        entryIndex = static_cast<uint32_t>(m_entries.size());
+        m_entries.emplace_back();
+    }
+    else
+    {
+        entryIndex = m_leastRecent;
+        RemoveFromSlots(entryIndex);
+        Unlink(entryIndex);
+    }
+
+    Entry& entry = m_entries[entryIndex];
+    entry.m_hash = hash;
+    entry.m_keyLength = static_cast<uint8_t>(length);
+    memcpy(entry.m_key, pKey, length);
+    entry.m_value = std::move(value);
+    LinkAsMostRecent(entryIndex);
+
+    const size_t mask = m_slots.size() - 1;
+    size_t i = static_cast<size_t>(hash) & mask;
+    while (m_slots[i] != kEmpty)
+        i = (i + 1) & mask;
+    m_slots[i] = entryIndex;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Removes an entry from the open-addressing table with backward-shift deletion, which keeps probe sequences intact 
+// without tombstones.
+//---------------------------------------------------------------------------------------------------------------------
+template <class RetType>
+void LuaMemoizedFunction<RetType>::RemoveFromSlots(uint32_t entryIndex)
+{
+    const size_t mask = m_slots.size() - 1;
+    size_t hole = static_cast<size_t>(m_entries[entryIndex].m_hash) & mask;
+    while (m_slots[hole] != entryIndex)
+        hole = (hole + 1) & mask;
+
+    for (size_t i = (hole + 1) & mask; m_slots[i] != kEmpty; i = (i + 1) & mask)
+    {
+        // move the entry back into the hole unless its home slot is between the hole and where it is now
+        const size_t home = static_cast<size_t>(m_entries[m_slots[i]].m_hash) & mask;
+        const size_t distanceFromHome = (i - home) & mask;
+        const size_t distanceToHole = (i - hole) & mask;
+        if (distanceFromHome >= distanceToHole)
+        {
+            m_slots[hole] = m_slots[i];
+            hole = i;
+        }
+    }
+    m_slots[hole] = kEmpty;
+}
+
+template <class RetType>
+void LuaMemoizedFunction<RetType>::Unlink(uint32_t entryIndex)
+{
+    Entry& entry = m_entries[entryIndex];
+    if (entry.m_prev != kEmpty)
+        m_entries[entry.m_prev].m_next = entry.m_next;
+    else
+        m_mostRecent = entry.m_next;
+    if (entry.m_next != kEmpty)
+        m_entries[entry.m_next].m_prev = entry.m_prev;
+    else
+        m_leastRecent = entry.m_prev;
+    entry.m_prev = entry.m_next = kEmpty;
+}
+
+template <class RetType>
+void LuaMemoizedFunction<RetType>::LinkAsMostRecent(uint32_t entryIndex)
+{
+    Entry& entry = m_entries[entryIndex];
+    entry.m_prev = kEmpty;
+    entry.m_next = m_mostRecent;
+    if (m_mostRecent != kEmpty)
+        m_entries[m_mostRecent].m_prev = entryIndex;
+    m_mostRecent = entryIndex;
+    if (m_leastRecent == kEmpty)
+        m_leastRecent = entryIndex;
+}
+
+}  // end namespace BleachLua
@@ -0,0 +1,90 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaStl.h"
+#include <cstdint>
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaModuleReloader hot-reloads modules loaded with require().  It remembers which file each module came from, polls 
+// their modification times, and when one changes, re-runs only that file and patches the result into the module 
+// table that's already in package.loaded, so nothing that required it has to be rebuilt.
+// 
+//      LuaModuleReloader reloader(pState);
+//      reloader.TrackLoadedModules();     // after startup has required everything
+//      ...
+//      reloader.Poll();                   // every second or so in development builds
+// 
+// When a module is reloaded:
+//      - Functions in the old module table are replaced by the new ones.  The new functions' upvalues are joined with 
+//        the old functions' upvalues of the same name, so module-level locals (caches, counters, the module table 
+//        itself) keep their state.  Upvalues holding functions aren't joined, so local helper functions run new code.
+//      - Every registry value that was one of the old functions is replaced with the new one.  Since LuaVar, 
+//        LuaFunction, and everything built on them hold registry refs, C++ handles call the new code without being 
+//        looked up again.
+//      - Nested tables are patched the same way.  Other values keep their current state; keys that are new in the 
+//        file are added.
+//      - Lua code that copied an old function somewhere else (local f = M.f) keeps the old one.
+// 
+// If the file fails to load or run, the error is logged and the old module stays as it was.  On Lua 5.1 and LuaJIT, 
+// there's no lua_upvaluejoin(), so upvalues are copied instead of shared; tables are still shared, numbers aren't.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+class LuaState;
+
+class LuaModuleReloader
+{
+    struct Module
+    {
+        luastl::string m_name;
+        luastl::string m_path;
+        int64_t m_lastWriteTime;
+    };
+
+    LuaState* m_pState;
+    luastl::vector<Module> m_modules;
+
+public:
+    explicit LuaModuleReloader(LuaState* pState);
+
+    // tracking
+    bool Track(const char* moduleName);  // finds the file through package.path
+    bool Track(const char* moduleName, const char* path);
+    size_t TrackLoadedModules();  // tracks every module in package.loaded that came from a file
+    void Untrack(const char* moduleName);
+    size_t GetNumTrackedModules() const { return m_modules.size(); }
+
+    // reloading
+    size_t Poll();  // reloads every module whose file changed, and returns how many were reloaded
+    bool Reload(const char* moduleName);
+
+private:
+    Module* FindModule(const char* moduleName);
+    luastl::string FindModuleFile(const char* moduleName) const;
+    bool ReloadModule(const Module& module);
+};
+
+}  // end namespace BleachLua
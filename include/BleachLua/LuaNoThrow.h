@@ -0,0 +1,67 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+    #include <exception>
+    #define BLEACHLUA_HAS_EXCEPTIONS 1
+#else
+    #define BLEACHLUA_HAS_EXCEPTIONS 0
+#endif
+
+namespace BleachLua {
+
+//---------------------------------------------------------------------------------------------------------------------
+// Runs C++ code that can throw, usually a container growing, from inside a lua_CFunction.  An exception must never 
+// unwind through Lua's C frames, so anything thrown is turned into a Lua error.  The error is raised after the catch 
+// block is done, since longjmp-ing out of a handler would skip the exception's cleanup.  If exceptions are disabled 
+// (as they often are with EASTL), this just runs the code.
+//      -pState:    The Lua state to raise the error on.
+//      -what:      A description of the operation for the error message.
+//      -func:      The code to run.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Func>
+void CallNoThrow(lua_State* pState, const char* what, Func&& func)
+{
+#if BLEACHLUA_HAS_EXCEPTIONS
+    const char* pError = nullptr;
+    try
+    {
+        func();
+    }
+    catch (const std::exception&)
+    {
+        pError = "not enough memory";
+    }
+    if (pError)
+        luaL_error(pState, "%s failed: %s", what, pError);
+#else
+    (void)pState;
+    (void)what;
+    func();
+#endif
+}
+
+}  // end namespace BleachLua
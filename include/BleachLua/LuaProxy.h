@@ -0,0 +1,361 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaVar.h"
+#include "LuaState.h"
+#include "LuaTypes.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+// Proxies expose a live C++ container to Lua without copying it into a table.  The proxy is a userdata holding a 
+// pointer to the container; indexing it converts just the element being accessed (through StackHelpers, so any type 
+// with LuaTraits works).  A script that samples a few elements of a large container only pays for those elements.
+// 
+// Sequences (anything with size() and operator[], like vector or deque) are indexed 1..#proxy.  Maps (anything with 
+// mapped_type and find()) are indexed by key.  Both support #proxy and, in Lua 5.2+, pairs(proxy).  Writes are only 
+// allowed if the proxy was created with allowWrites; sequences can only assign existing elements, while maps insert 
+// and assigning nil erases.
+// 
+//      m_itemsProxy = LuaVar::MakeProxy(pState, m_items);
+//      globals.SetTableVar("items", m_itemsProxy.GetVar());
+// 
+// The proxy doesn't own the container.  The returned LuaProxyHandle must not outlive it: when the handle is 
+// destroyed (or Invalidate() is called), the proxy is cut off and scripts that still hold it get an error on 
+// access.  Keep the handle next to the container so they die together.  Adding or removing elements while a script 
+// is iterating a map proxy can end the iteration with an error, the same as modifying a table during next().
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+namespace _Internal {
+
+// The userdata block for every proxy.
+struct ProxyBlock
+{
+    void* m_pContainer;  // nullptr once invalidated
+    bool m_allowWrites;
+};
+
+template <class Type, class = void> struct IsProxyMap { static constexpr bool value = false; };
+template <class Type> struct IsProxyMap<Type, luastl::void_t<typename Type::mapped_type>> { static constexpr bool value = true; };
+
+//---------------------------------------------------------------------------------------------------------------------
+// Element conversion.  This is StackHelpers, plus owning strings, which StackHelpers doesn't handle.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+struct ProxyConvert
+{
+    static void Push(LuaState* pState, const Type& value) { StackHelpers::Push<Type>(pState, value); }
+    static Type Get(LuaState* pState, int stackIndex) { return StackHelpers::Get<Type>(pState, stackIndex); }
+    static bool Is(LuaState* pState, int stackIndex) { return StackHelpers::Is<Type>(pState, stackIndex); }
+};
+
+template <>
+struct ProxyConvert<luastl::string>
+{
+    static void Push(LuaState* pState, const luastl::string& value) { lua_pushlstring(pState->GetState(), value.data(), value.size()); }
+    static luastl::string Get(LuaState* pState, int stackIndex)
+    {
+        size_t length = 0;
+        const char* str = lua_tolstring(pState->GetState(), stackIndex, &length);
+        return str ? luastl::string(str, length) : luastl::string();
+    }
+    static bool Is(LuaState* pState, int stackIndex) { return lua_type(pState->GetState(), stackIndex) == LUA_TSTRING; }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// The metamethods for one container type.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Container>
+class ProxyOps
+{
+    using MutableContainer = luastl::remove_const_t<Container>;
+    static constexpr bool kIsMap = IsProxyMap<MutableContainer>::value;
+
+public:
+    static void PushMetatable(lua_State* pState);
+
+private:
+    static ProxyBlock* CheckBlock(lua_State* pState);
+    static Container& CheckContainer(lua_State* pState);
+    static void CheckWritable(lua_State* pState);
+    static int Index(lua_State* pState);
+    static int NewIndex(lua_State* pState);
+    static int Len(lua_State* pState);
+    static int Pairs(lua_State* pState);
+    static int Next(lua_State* pState);
+};
+
+// Returns the block of the proxy at argument 1.  Scripts can get at Next() through pairs() and call it with anything, 
+// so the argument has to be checked against this container type's metatable before the block can be trusted.
+template <class Container>
+ProxyBlock* ProxyOps<Container>::CheckBlock(lua_State* pState)
+{
+    bool isProxy = false;
+    if (lua_type(pState, 1) == LUA_TUSERDATA && lua_getmetatable(pState, 1))  //  [mt]
+    {
+        PushMetatable(pState);                                              //  [mt, proxyMt]
+        isProxy = lua_rawequal(pState, -1, -2) != 0;
+        lua_pop(pState, 2);                                                 //  []
+    }
+    if (!isProxy)
+        luaL_argerror(pState, 1, "expected a proxy of this container type");
+    return static_cast<ProxyBlock*>(lua_touserdata(pState, 1));
+}
+
+template <class Container>
+Container& ProxyOps<Container>::CheckContainer(lua_State* pState)
+{
+    ProxyBlock* pBlock = CheckBlock(pState);
+    if (!pBlock->m_pContainer)
+        luaL_error(pState, "attempt to use an invalidated proxy");
+    return *static_cast<Container*>(pBlock->m_pContainer);
+}
+
+template <class Container>
+void ProxyOps<Container>::CheckWritable(lua_State* pState)
+{
+    const ProxyBlock* pBlock = CheckBlock(pState);
+    if (luastl::is_const<Container>::value || !pBlock->m_allowWrites)
+        luaL_error(pState, "attempt to modify a read-only proxy");
+}
+
+// __index(proxy, key)
+template <class Container>
+int ProxyOps<Container>::Index(lua_State* pState)
+{
+    Container& container = CheckContainer(pState);
+    LuaState* pCppState = GetCppStateFromCState(pState);
+
+    if constexpr (kIsMap)
+    {
+        using KeyType = typename MutableContainer::key_type;
+        using ValueType = typename MutableContainer::mapped_type;
+        if (!ProxyConvert<KeyType>::Is(pCppState, 2))
+            return 0;
+
+        auto findIt = container.find(ProxyConvert<KeyType>::Get(pCppState, 2));
+        if (findIt == container.end())
+            return 0;
+        ProxyConvert<ValueType>::Push(pCppState, findIt->second);
+    }
+    else
+    {
+        using ValueType = luastl::remove_const_t<typename MutableContainer::value_type>;
+        if (lua_type(pState, 2) != LUA_TNUMBER)
+            return 0;
+
+        const lua_Integer index = lua_tointeger(pState, 2);
+        if (index < 1 || static_cast<size_t>(index) > container.size())
+            return 0;
+        ProxyConvert<ValueType>::Push(pCppState, container[static_cast<size_t>(index - 1)]);
+    }
+    return 1;
+}
+
+// __newindex(proxy, key, value)
+template <class Container>
+int ProxyOps<Container>::NewIndex(lua_State* pState)
+{
+    Container& container = CheckContainer(pState);
+    CheckWritable(pState);
+
+    if constexpr (!luastl::is_const<Container>::value)
+    {
+        LuaState* pCppState = GetCppStateFromCState(pState);
+        if constexpr (kIsMap)
+        {
+            using KeyType = typename MutableContainer::key_type;
+            using ValueType = typename MutableContainer::mapped_type;
+            luaL_argcheck(pState, ProxyConvert<KeyType>::Is(pCppState, 2), 2, "invalid key type");
+
+            KeyType key = ProxyConvert<KeyType>::Get(pCppState, 2);
+            if (lua_isnil(pState, 3))
+                container.erase(key);
+            else
+                container[key] = ProxyConvert<ValueType>::Get(pCppState, 3);
+        }
+        else
+        {
+            using ValueType = luastl::remove_const_t<typename MutableContainer::value_type>;
+            const lua_Integer index = luaL_checkinteger(pState, 2);
+            luaL_argcheck(pState, index >= 1 && static_cast<size_t>(index) <= container.size(), 2, "index out of range");
+            container[static_cast<size_t>(index - 1)] = ProxyConvert<ValueType>::Get(pCppState, 3);
+        }
+    }
+    return 0;
+}
+
+// __len(proxy)
+template <class Container>
+int ProxyOps<Container>::Len(lua_State* pState)
+{
+    lua_pushinteger(pState, static_cast<lua_Integer>(CheckContainer(pState).size()));
+    return 1;
+}
+
+// The iterator returned by __pairs.  For sequences, the control variable is the index; for maps, it's the key.
+template <class Container>
+int ProxyOps<Container>::Next(lua_State* pState)
+{
+    Container& container = CheckContainer(pState);
+    LuaState* pCppState = GetCppStateFromCState(pState);
+
+    if constexpr (kIsMap)
+    {
+        using KeyType = typename MutableContainer::key_type;
+        using ValueType = typename MutableContainer::mapped_type;
+
+        auto it = container.begin();
+        if (!lua_isnil(pState, 2))
+        {
+            it = container.find(ProxyConvert<KeyType>::Get(pCppState, 2));
+            if (it == container.end())
+                return luaL_error(pState, "invalid key to 'next' (was the container modified during iteration?)");
+            ++it;
+        }
+
+        if (it == container.end())
+            return 0;
+        ProxyConvert<KeyType>::Push(pCppState, it->first);
+        ProxyConvert<ValueType>::Push(pCppState, it->second);
+    }
+    else
+    {
+        using ValueType = luastl::remove_const_t<typename MutableContainer::value_type>;
+        const lua_Integer index = luaL_optinteger(pState, 2, 0) + 1;
+        if (index < 1 || static_cast<size_t>(index) > container.size())
+            return 0;
+
+        lua_pushinteger(pState, index);
+        ProxyConvert<ValueType>::Push(pCppState, container[static_cast<size_t>(index - 1)]);
+    }
+    return 2;
+}
+
+// __pairs(proxy) -> next, proxy, nil
+template <class Container>
+int ProxyOps<Container>::Pairs(lua_State* pState)
+{
+    CheckContainer(pState);
+    lua_pushcfunction(pState, &Next);                                       //  [proxy, next]
+    lua_pushvalue(pState, 1);                                               //  [proxy, next, proxy]
+    lua_pushnil(pState);                                                    //  [proxy, next, proxy, nil]
+    return 3;
+}
+
+// Pushes the metatable for this container type, creating it the first time.  It's stored in the registry under the 
+// address of a static, which is unique for each container type.
+template <class Container>
+void ProxyOps<Container>::PushMetatable(lua_State* pState)
+{
+    static const char s_registryKey = 0;
+    lua_pushlightuserdata(pState, const_cast<char*>(&s_registryKey));      //  [key]
+    lua_rawget(pState, LUA_REGISTRYINDEX);                                  //  [mt?]
+    if (lua_istable(pState, -1))
+        return;
+
+    lua_pop(pState, 1);                                                     //  []
+    lua_createtable(pState, 0, 5);                                          //  [mt]
+    lua_pushcfunction(pState, &Index);                                      //  [mt, __index]
+    lua_setfield(pState, -2, "__index");                                    //  [mt]
+    lua_pushcfunction(pState, &NewIndex);                                   //  [mt, __newindex]
+    lua_setfield(pState, -2, "__newindex");                                 //  [mt]
+    lua_pushcfunction(pState, &Len);                                        //  [mt, __len]
+    lua_setfield(pState, -2, "__len");                                      //  [mt]
+    lua_pushcfunction(pState, &Pairs);                                      //  [mt, __pairs]
+    lua_setfield(pState, -2, "__pairs");                                    //  [mt]
+    lua_pushboolean(pState, 0);                                             //  [mt, false]
+    lua_setfield(pState, -2, "__metatable");                                //  [mt]
+
+    lua_pushlightuserdata(pState, const_cast<char*>(&s_registryKey));      //  [mt, key]
+    lua_pushvalue(pState, -2);                                              //  [mt, key, mt]
+    lua_rawset(pState, LUA_REGISTRYINDEX);                                  //  [mt]
+}
+
+}  // end namespace BleachLua::_Internal
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaProxyHandle
+// 
+// Owns the C++ side of a proxy.  Destroying the handle invalidates the proxy.
+//---------------------------------------------------------------------------------------------------------------------
+class LuaProxyHandle
+{
+    LuaVar m_proxy;
+
+public:
+    LuaProxyHandle() = default;
+    explicit LuaProxyHandle(LuaVar&& proxy) : m_proxy(std::move(proxy)) { }
+    LuaProxyHandle(const LuaProxyHandle&) = delete;
+    LuaProxyHandle& operator=(const LuaProxyHandle&) = delete;
+    LuaProxyHandle(LuaProxyHandle&& right) noexcept : m_proxy(std::move(right.m_proxy)) { }
+    LuaProxyHandle& operator=(LuaProxyHandle&& right) noexcept
+    {
+        if (&right == this)
+            return *this;
+        Invalidate();
+        m_proxy = std::move(right.m_proxy);
+        return *this;
+    }
+    ~LuaProxyHandle() { Invalidate(); }
+
+    const LuaVar& GetVar() const { return m_proxy; }  // the proxy userdata, for handing to Lua
+    bool IsValid() const { return m_proxy.IsValid(); }
+
+    // Cuts the proxy off from the container.  Call this before the container is destroyed or moved if the handle 
+    // will outlive it.
+    void Invalidate()
+    {
+        if (!m_proxy.IsValid())
+            return;
+
+        if (_Internal::ProxyBlock* pBlock = static_cast<_Internal::ProxyBlock*>(m_proxy.GetUserData()))
+            pBlock->m_pContainer = nullptr;
+        m_proxy.ClearRef();
+    }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Creates a proxy userdata over a live container.  See the comment at the top of this file.
+//      -pState:        The Lua state.
+//      -container:     The container to expose.  This must outlive the returned handle.
+//      -allowWrites:   If true, scripts can assign through the proxy.  Ignored for const containers.
+//      -return:        The handle that owns the proxy.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Container>
+LuaProxyHandle LuaVar::MakeProxy(LuaState* pState, Container& container, bool allowWrites)
+{
+    LUA_ASSERT(pState);
+    lua_State* pLuaState = pState->GetState();
+
+    _Internal::ProxyBlock* pBlock = static_cast<_Internal::ProxyBlock*>(Compat::NewUserData(pLuaState, sizeof(_Internal::ProxyBlock)));   //  [proxy]
+    pBlock->m_pContainer = const_cast<void*>(static_cast<const void*>(&container));
+    pBlock->m_allowWrites = allowWrites;
+    _Internal::ProxyOps<Container>::PushMetatable(pLuaState);                                           //  [proxy, mt]
+    lua_setmetatable(pLuaState, -2);                                                                    //  [proxy]
+    return LuaProxyHandle(CreateFromStack(pState));                                                     //  []
+}
+
+}  // end namespace BleachLua
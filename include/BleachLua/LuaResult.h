@@ -0,0 +1,205 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "StackHelpers.h"
+#include "LuaVar.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaResult is the error-code alternative to the log-and-return-default behavior of LuaFunction::operator() and 
+// StackHelpers::Get().  It holds either a value or a LuaErrorInfo describing what went wrong.  The error info is 
+// deliberately cheap to build: it stores an error code, the Lua type that was found, and (for runtime errors) a 
+// reference to the error object Lua threw.  No string is built until someone calls GetMessage(), so failing on a 
+// hot path costs about the same as succeeding.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+enum class LuaErrorCode
+{
+    kNone,
+    kInvalidFunction,   // the LuaFunction didn't point at a function
+    kTypeMismatch,      // the value couldn't be converted to the requested type
+    kRuntimeError,      // Lua threw an error during the call
+    kMemoryError,       // Lua ran out of memory during the call
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaErrorInfo
+//---------------------------------------------------------------------------------------------------------------------
+class LuaErrorInfo
+{
+    LuaVar m_errorObject;  // only set for kRuntimeError and kMemoryError
+    const char* m_pExpectedType;  // only set for kTypeMismatch; always a string literal
+    LuaErrorCode m_code;
+    int m_luaType;  // the type of the offending value, or LUA_TNONE
+
+public:
+    LuaErrorInfo() noexcept : m_pExpectedType(nullptr), m_code(LuaErrorCode::kNone), m_luaType(LUA_TNONE) { }
+    LuaErrorInfo(LuaErrorCode code, int luaType, const char* pExpectedType = nullptr) noexcept : m_pExpectedType(pExpectedType), m_code(code), m_luaType(luaType) { }
+    LuaErrorInfo(LuaErrorCode code, LuaVar&& errorObject) noexcept : m_errorObject(std::move(errorObject)), m_pExpectedType(nullptr), m_code(code), m_luaType(LUA_TNONE) { }
+
+    LuaErrorCode GetCode() const { return m_code; }
+    int GetLuaType() const { return m_luaType; }
+    const LuaVar& GetErrorObject() const { return m_errorObject; }
+    luastl::string GetMessage() const;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaResult
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+class LuaResult
+{
+    Type m_value;
+    LuaErrorInfo m_error;
+
+public:
+    LuaResult(Type value) : m_value(std::move(value)) { }
+    LuaResult(LuaErrorInfo&& error) : m_value(StackHelpers::GetDefault<Type>()), m_error(std::move(error)) { }
+
+    bool IsOk() const { return m_error.GetCode() == LuaErrorCode::kNone; }
+    explicit operator bool() const { return IsOk(); }
+
+    const Type& GetValue() const { LUA_ASSERT(IsOk()); return m_value; }
+    Type& GetValue() { LUA_ASSERT(IsOk()); return m_value; }
+    Type GetValueOr(Type defaultValue) const { return IsOk() ? m_value : defaultValue; }
+    const LuaErrorInfo& GetError() const { return m_error; }
+};
+
+template <>
+class LuaResult<void>
+{
+    LuaErrorInfo m_error;
+
+public:
+    LuaResult() = default;
+    LuaResult(LuaErrorInfo&& error) : m_error(std::move(error)) { }
+
+    bool IsOk() const { return m_error.GetCode() == LuaErrorCode::kNone; }
+    explicit operator bool() const { return IsOk(); }
+
+    const LuaErrorInfo& GetError() const { return m_error; }
+};
+
+namespace StackHelpers {
+
+//---------------------------------------------------------------------------------------------------------------------
+// TryGet()
+// 
+// Like Get(), except that it never logs and reports failure through the returned LuaResult instead of silently 
+// returning GetDefault().  The type check and the conversion are done in a single Lua API call wherever Lua allows 
+// it, so this is cheaper than calling Is() followed by Get().
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+LuaResult<Type> TryGet(LuaState* pState, int stackIndex = -1)
+{
+    LUA_ASSERT(pState);
+    lua_State* pLuaState = pState->GetState();
+
+    if constexpr (luastl::is_same<Type, LuaVar>::value)
+    {
+        return Get<LuaVar>(pState, stackIndex);  // everything is a valid LuaVar
+    }
+    else if constexpr (IsLuaBool<Type>::value)
+    {
+        if (lua_isboolean(pLuaState, stackIndex))
+            return static_cast<Type>(lua_toboolean(pLuaState, stackIndex));
+        return LuaErrorInfo(LuaErrorCode::kTypeMismatch, lua_type(pLuaState, stackIndex), "boolean");
+    }
+    else if constexpr (IsLuaInteger<Type>::value)
+    {
+        // See the note about unsigned 64-bit ints at the top of StackHelpers.h.  uint64_t goes through the same path 
+        // here, we just don't do the extra debug-only diagnostics that Get() does.
+        int success = 0;
+#if BLEACHLUA_CORE_VERSION >= 53
+        const Type ret = static_cast<Type>(lua_tointegerx(pLuaState, stackIndex, &success));
+#else
+        const Type ret = static_cast<Type>(lua_tonumberx(pLuaState, stackIndex, &success));
+#endif
+        if (success)
+            return ret;
+        return LuaErrorInfo(LuaErrorCode::kTypeMismatch, lua_type(pLuaState, stackIndex), "integer");
+    }
+    else if constexpr (IsLuaNumber<Type>::value)
+    {
+        int success = 0;
+        const Type ret = static_cast<Type>(lua_tonumberx(pLuaState, stackIndex, &success));
+        if (success)
+            return ret;
+        return LuaErrorInfo(LuaErrorCode::kTypeMismatch, lua_type(pLuaState, stackIndex), "number");
+    }
+    else if constexpr (IsLuaString<Type>::value)
+    {
+        if (const char* pResult = lua_tostring(pLuaState, stackIndex))
+            return pResult;
+        return LuaErrorInfo(LuaErrorCode::kTypeMismatch, lua_type(pLuaState, stackIndex), "string");
+    }
+    else if constexpr (IsLuaNil<Type>::value)
+    {
+        if (lua_isnil(pLuaState, stackIndex))
+            return nullptr;
+        return LuaErrorInfo(LuaErrorCode::kTypeMismatch, lua_type(pLuaState, stackIndex), "nil");
+    }
+    else if constexpr (IsLuaFunction<Type>::value)
+    {
+        if (Type pFunc = lua_tocfunction(pLuaState, stackIndex))
+            return pFunc;
+        return LuaErrorInfo(LuaErrorCode::kTypeMismatch, lua_type(pLuaState, stackIndex), "C function");
+    }
+    else if constexpr (HasLuaTraits<Type>::value)
+    {
+        if (LuaTraits<Type>::Is(pState, stackIndex))
+            return LuaTraits<Type>::Get(pState, stackIndex);
+        return LuaErrorInfo(LuaErrorCode::kTypeMismatch, lua_type(pLuaState, stackIndex));
+    }
+    else
+    {
+        static_assert(IsLuaUserData<Type>::value, "TryGet() requires a Lua-convertable type.");
+        if (void* pResult = lua_touserdata(pLuaState, stackIndex))
+            return pResult;
+        return LuaErrorInfo(LuaErrorCode::kTypeMismatch, lua_type(pLuaState, stackIndex), "userdata");
+    }
+}
+
+}  // end namespace BleachLua::StackHelpers
+
+//---------------------------------------------------------------------------------------------------------------------
+// Attempts to get this variable's value as the templated type.  This is the LuaResult version of GetValue() and is 
+// defined here rather than in LuaVar.h to avoid a circular include.
+//      -return:    The value, or the reason it couldn't be converted.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+LuaResult<Type> LuaVar::TryGetValue() const
+{
+    LUA_ASSERT(m_pState);
+
+    // nil is pushed for invalid vars so that TryGet() can decide whether or not that's a failure
+    PushValueToStack();                                             //  [var]
+    LuaResult<Type> result = StackHelpers::TryGet<Type>(m_pState);  //  [var]
+    lua_pop(m_pState->GetState(), 1);                               //  []
+    return result;
+}
+
+}  // end namespace BleachLua
@@ -0,0 +1,158 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaVar.h"
+#include "LuaStringId.h"
+#include <chrono>
+#include <cstdint>
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaScriptScheduler runs per-entity Lua update functions within a time budget.  Each frame, it runs the tasks that 
+// are due, highest priority first, until the budget (in microseconds) is spent, and defers the rest to later frames.  
+// Deferred tasks move ahead of tasks with the same priority that just ran, so they take turns, and a task that has 
+// been deferred for too many frames in a row runs no matter what the budget says.
+// 
+//      LuaScriptScheduler scheduler(pState);
+//      scheduler.SetBudgetMicroseconds(2000);
+//      auto id = scheduler.AddTask(entity.GetTableVar("Update"), 10, 0.f, "Enemy"_sid);     // every frame
+//      scheduler.AddTask(ambient.GetTableVar("Update"), 0, 0.25f, "Ambient"_sid);          // four times a second
+//      ...
+//      scheduler.Update(deltaSeconds);
+// 
+// Each task is called with the seconds since it last ran, which is more than its interval if it was deferred.  The 
+// due tasks for a frame are run from a single protected call; if one raises an error, it's logged and the rest 
+// continue.  Tasks can be added and removed from inside a task.  Added tasks first run on the next frame.
+// 
+// Stats are kept per task class (a StringId passed to AddTask()) and for the last frame, which is how you find out 
+// which kinds of scripts are eating the budget.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+class LuaScriptScheduler
+{
+public:
+    using TaskId = uint32_t;
+    static constexpr TaskId kInvalidTaskId = 0;
+
+    struct ClassStats
+    {
+        uint64_t m_numRuns = 0;
+        uint64_t m_numDeferred = 0;  // how many times a due task of this class was pushed to a later frame
+        uint64_t m_totalMicroseconds = 0;
+        uint32_t m_maxMicroseconds = 0;  // the slowest single run
+    };
+
+    struct FrameStats
+    {
+        uint32_t m_numDue = 0;
+        uint32_t m_numRun = 0;
+        uint32_t m_numDeferred = 0;
+        uint32_t m_numForced = 0;  // starving tasks that ran past the budget
+        uint32_t m_microseconds = 0;
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int kIndexBits = 20;
+    static constexpr uint32_t kNil = 0xffffffff;
+
+    struct Task
+    {
+        int m_ref;  // LUA_NOREF when the slot is free
+        int m_priority;
+        double m_interval;
+        double m_lastRunTime;
+        uint32_t m_framesDeferred;
+        uint32_t m_generation;
+        uint32_t m_classIndex;
+        uint32_t m_nextFree;
+    };
+
+    // The generation is kept so a task that's removed during the frame, and whose slot is reused by a task added 
+    // during the frame, isn't mistaken for the new task.
+    struct DueTask
+    {
+        uint32_t m_index;
+        uint32_t m_generation;
+    };
+
+    struct DispatchContext
+    {
+        LuaScriptScheduler* m_pScheduler;
+        size_t m_next;  // index into m_dueTasks
+        size_t m_numStarving;  // the first m_numStarving due tasks run regardless of the budget
+        Clock::time_point m_deadline;
+        Clock::time_point m_taskStart;
+        uint32_t m_taskClassIndex;
+    };
+
+    LuaState* m_pState;
+    luastl::vector<Task> m_tasks;
+    luastl::vector<DueTask> m_dueTasks;
+    luastl::vector<ClassStats> m_classStats;
+    luastl::unordered_map<StringId::HashType, uint32_t> m_classIndices;
+    FrameStats m_lastFrameStats;
+    double m_currentTime;
+    uint32_t m_freeHead;
+    uint32_t m_budgetMicroseconds;
+    uint32_t m_maxDeferredFrames;
+    bool m_isUpdating;
+
+public:
+    explicit LuaScriptScheduler(LuaState* pState);
+    ~LuaScriptScheduler();
+    LuaScriptScheduler(const LuaScriptScheduler&) = delete;
+    LuaScriptScheduler& operator=(const LuaScriptScheduler&) = delete;
+
+    // tasks
+    TaskId AddTask(const LuaVar& function, int priority = 0, float intervalSeconds = 0.f, StringId taskClass = StringId());
+    bool RemoveTask(TaskId id);
+    bool SetTaskPriority(TaskId id, int priority);
+    size_t GetNumTasks() const;
+
+    // settings
+    void SetBudgetMicroseconds(uint32_t budget) { m_budgetMicroseconds = budget; }
+    uint32_t GetBudgetMicroseconds() const { return m_budgetMicroseconds; }
+    void SetMaxDeferredFrames(uint32_t maxFrames) { m_maxDeferredFrames = maxFrames; }  // starvation limit
+    uint32_t GetMaxDeferredFrames() const { return m_maxDeferredFrames; }
+
+    // update
+    void Update(double deltaSeconds);
+
+    // stats
+    const FrameStats& GetLastFrameStats() const { return m_lastFrameStats; }
+    ClassStats GetClassStats(StringId taskClass) const;
+    void ResetStats();
+
+private:
+    Task* FindTask(TaskId id);
+    uint32_t GetClassIndex(StringId taskClass);
+    void RecordRun(uint32_t classIndex, Clock::time_point start, Clock::time_point end);
+    static int CallDueTasks(lua_State* pState);
+};
+
+}  // end namespace BleachLua
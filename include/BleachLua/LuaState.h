@@ -61,6 +61,7 @@ void LuaState::SetGlobal(const char* key, Type&& value)
 {
     StackHelpers::Push(this, std::forward<Type>(value));
     lua_setglobal(m_pState, key);
+    BumpGlobalsGeneration();
 }
 
 }
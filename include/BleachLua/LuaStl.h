@@ -28,16 +28,22 @@
 
 #if BLEACHLUA_USE_EASTL
     #include <EASTL/string.h>
+    #include <EASTL/string_view.h>
     #include <EASTL/vector.h>
     #include <EASTL/type_traits.h>
     #include <EASTL/tuple.h>
+    #include <EASTL/unordered_map.h>
+    #include <EASTL/optional.h>
 
     namespace luastl = eastl;
 #else
     #include <string>
+    #include <string_view>
     #include <vector>
     #include <type_traits>
     #include <tuple>
+    #include <unordered_map>
+    #include <optional>
 
     namespace luastl = std;
 #endif
@@ -0,0 +1,73 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaVar.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaStringBuilder is a userdata that wraps a growable C++ string buffer.  Building a string with .. in a loop creates 
+// a new Lua string for every step, which is O(n^2) garbage; table.concat() is better but still needs a temporary 
+// table.  Appending to a string builder only touches the buffer, and a Lua string is only created when you ask for 
+// one with tostring().  C++ can read the contents directly through GetView() without creating a Lua string at all.
+// 
+// To use it from Lua, call OpenStringBuilderLib() once.  This adds the constructor to the BleachLua library table:
+//      local sb = bleach.StringBuilder(256)            -- optionally reserves 256 bytes
+//      sb:append("x = ", 10, ", "):append_number(1.5, 2)
+//      sb:appendf(" (%s)", name)                       -- same format rules as string.format()
+//      print(sb:tostring(), #sb)
+//      sb:clear()                                      -- keeps the memory for reuse
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+class LuaStringBuilder
+{
+    luastl::string m_buffer;
+
+public:
+    LuaStringBuilder(const LuaStringBuilder&) = delete;
+    LuaStringBuilder& operator=(const LuaStringBuilder&) = delete;
+    ~LuaStringBuilder() = default;  // called by the userdata's __gc metamethod
+
+    static LuaVar Create(LuaState* pState, size_t reserveSize = 0);
+    static LuaStringBuilder* FromVar(const LuaVar& var);  // returns nullptr if var isn't a string builder
+    static LuaStringBuilder* FromStack(lua_State* pState, int stackIndex);  // returns nullptr if the value isn't a string builder
+    static LuaStringBuilder* PushNew(lua_State* pState, size_t reserveSize = 0);
+
+    // Important: The view is invalidated by anything that modifies the builder, including appends from Lua.
+    luastl::string_view GetView() const { return luastl::string_view(m_buffer.data(), m_buffer.size()); }
+    size_t GetSize() const { return m_buffer.size(); }
+
+    void Append(const char* pStr, size_t length) { m_buffer.append(pStr, length); }
+    void AppendNumber(lua_Number value, int precision = -1);
+    void AppendInteger(lua_Integer value);
+    void Clear() { m_buffer.clear(); }
+
+private:
+    explicit LuaStringBuilder(size_t reserveSize) { m_buffer.reserve(reserveSize); }
+};
+
+void OpenStringBuilderLib(LuaState* pState);
+
+}  // end namespace BleachLua
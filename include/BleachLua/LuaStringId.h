@@ -0,0 +1,114 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaConfig.h"
+#include "LuaStl.h"
+#include "LuaTypeTraits.h"
+#include <cstdint>
+
+//---------------------------------------------------------------------------------------------------------------------
+// StringId is a hashed string (FNV-1a) used to identify entities, events, assets, and so on.  It crosses into Lua as 
+// a plain integer, so passing one to a bound function or using one as a table key is an integer operation instead of 
+// string interning and hashing.
+// 
+// Hashing is constexpr, so ids for literals can be computed at compile time:
+//      constexpr StringId kOnDeath = "OnDeath"_sid;
+// 
+// Reverse lookup (id -> string) goes through a global interning table, which is filled by StringId::Intern(), by 
+// bleach.string_id() in Lua, and in debug builds by every StringId built from a runtime string.  Compile-time ids 
+// aren't in the table unless something interns the same string.  Interning is not thread-safe.
+// 
+// In Lua, after calling OpenStringIdLib():
+//      local onDeath = bleach.string_id("OnDeath")    -- same integer C++ gets from "OnDeath"_sid
+//      print(bleach.string_id_name(onDeath))           -- "OnDeath", or nil if it was never interned
+// 
+// Bound functions that take a StringId also accept a string from Lua, which is hashed on the way in.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+class StringId
+{
+public:
+#if BLEACHLUA_STRING_ID_BITS == 64
+    static_assert(BLEACHLUA_CORE_VERSION >= 53, "64-bit StringIds require Lua 5.3 or later.");
+    using HashType = uint64_t;
+    static constexpr HashType kOffsetBasis = 14695981039346656037ull;
+    static constexpr HashType kPrime = 1099511628211ull;
+#else
+    static_assert(BLEACHLUA_STRING_ID_BITS == 32, "BLEACHLUA_STRING_ID_BITS must be 32 or 64.");
+    using HashType = uint32_t;
+    static constexpr HashType kOffsetBasis = 2166136261u;
+    static constexpr HashType kPrime = 16777619u;
+#endif
+
+private:
+    HashType m_hash;
+
+public:
+    constexpr StringId() : m_hash(0) { }
+    constexpr explicit StringId(HashType hash) : m_hash(hash) { }
+    explicit StringId(luastl::string_view str);  // in debug builds, this also interns the string
+
+    static StringId Intern(luastl::string_view str);  // hashes the string and adds it to the global table
+    static constexpr HashType Hash(luastl::string_view str);
+
+    constexpr HashType GetHash() const { return m_hash; }
+    constexpr bool IsValid() const { return m_hash != 0; }
+    const char* GetString() const;  // returns nullptr if the string was never interned
+
+    constexpr bool operator==(const StringId& right) const { return m_hash == right.m_hash; }
+    constexpr bool operator!=(const StringId& right) const { return m_hash != right.m_hash; }
+    constexpr bool operator<(const StringId& right) const { return m_hash < right.m_hash; }
+};
+
+constexpr StringId::HashType StringId::Hash(luastl::string_view str)
+{
+    HashType hash = kOffsetBasis;
+    for (char c : str)
+    {
+        hash ^= static_cast<HashType>(static_cast<unsigned char>(c));
+        hash *= kPrime;
+    }
+    return hash;
+}
+
+constexpr StringId operator""_sid(const char* str, size_t length)
+{
+    return StringId(StringId::Hash(luastl::string_view(str, length)));
+}
+
+template <>
+struct LuaTraits<StringId>
+{
+    static void Push(LuaState* pState, const StringId& value);
+    static StringId Get(LuaState* pState, int stackIndex);  // strings are hashed
+    static bool Is(LuaState* pState, int stackIndex);  // true for numbers and strings
+    static StringId GetDefault() { return StringId(); }
+};
+
+void OpenStringIdLib(LuaState* pState);
+
+}  // end namespace BleachLua
@@ -0,0 +1,96 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaVar.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaTablePool recycles tables that are only needed for a moment, like event payloads and argument bundles, so they 
+// don't become garbage every frame.  Acquire() hands out a table, and Release() clears it with raw nil writes and 
+// puts it back.  Lua doesn't shrink a table when its fields are set to nil, so a recycled table keeps the array and 
+// hash parts it grew to and filling it again doesn't allocate.
+// 
+//      LuaTablePool payloads(pState, 4, 4);
+//      LuaVar payload = payloads.Acquire();
+//      payload.SetTableValue("damage", 10);
+//      bus.Dispatch("Hit"_sid, payload);
+//      payloads.Release(payload);
+// 
+// Scripts can use the same pool through OpenTablePoolLib():
+//      local t = bleach.pool.acquire()
+//      ...
+//      bleach.pool.release(t)
+// 
+// The pool only takes back tables it handed out.  It keeps a weak-keyed table that maps every table it created to 
+// whether it's currently handed out, so releasing a table twice, or releasing some other table (like _G or a library 
+// table), is an error and leaves the table alone.  Tables that are never released are simply collected.  A table must 
+// not be used after it's released, since it will be handed to the next caller.  Released tables also lose any 
+// metatable that was set on them.  The pool must be destroyed before its LuaState.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+class LuaTablePool
+{
+    LuaState* m_pState;
+    int m_freeTablesRef;  // an array of free tables
+    int m_ownedTablesRef;  // weak keys: every table this pool created -> true if handed out, false if free
+    int m_numFree;
+    int m_maxFree;
+    int m_arraySize;
+    int m_hashSize;
+    size_t m_numCreated;
+
+public:
+    LuaTablePool(LuaState* pState, int arraySize = 0, int hashSize = 0, int maxFree = 256);
+    ~LuaTablePool();
+    LuaTablePool(const LuaTablePool&) = delete;
+    LuaTablePool& operator=(const LuaTablePool&) = delete;
+
+    LuaVar Acquire();
+    void Release(LuaVar& table);
+    void Prewarm(int count);
+    void Clear();
+
+    int GetNumFree() const { return m_numFree; }
+    size_t GetNumCreated() const { return m_numCreated; }
+
+    // These are used by the bleach.pool functions.
+    void PushAcquired(lua_State* pState);
+    bool IsAcquired(lua_State* pState, int stackIndex) const;
+    void ReleaseFromStack(lua_State* pState, int stackIndex);  // the table must be one IsAcquired() accepts
+
+private:
+    void AddFreeTable(lua_State* pState, int stackIndex);
+    void SetOwnedState(lua_State* pState, int stackIndex, bool isAcquired) const;
+    static void ClearTable(lua_State* pState, int stackIndex);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Adds the bleach.pool table, whose acquire() and release(t) functions use pPool.  The pool must outlive the state's 
+// use of these functions.
+//---------------------------------------------------------------------------------------------------------------------
+void OpenTablePoolLib(LuaState* pState, LuaTablePool* pPool);
+
+}  // end namespace BleachLua
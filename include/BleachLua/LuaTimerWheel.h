@@ -0,0 +1,146 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaVar.h"
+#include <cstdint>
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaTimerWheel schedules delayed and repeating Lua callbacks.  Timers live in a hierarchical timer wheel (4 levels 
+// of 64 slots), so scheduling and cancelling a timer is O(1) and a tick only touches the timers that are due, plus an 
+// occasional cascade of one upper slot.  Runs of ticks with nothing due are skipped.  Callbacks are held as registry refs, and every timer that's due in a call to 
+// Advance() is fired from a single protected call.  If a callback raises an error, it's logged and the rest still run.
+// 
+// The game owns the wheel and advances it once per frame:
+//      LuaTimerWheel timers(pState);
+//      OpenTimerLib(pState, &timers);
+//      ...
+//      timers.Advance(deltaSeconds);
+// 
+// Scripts use the bleach.timer table:
+//      local handle = bleach.timer.after(2.5, function() EndBuff(unit) end)
+//      local tick = bleach.timer.every(1, function(handle) DoDamage(unit) end)   -- the callback gets its own handle
+//      bleach.timer.cancel(tick)                                                   -- returns false if it was gone
+// 
+// Times are rounded up to whole ticks, and a timer always waits at least one tick.  Timers further out than 64^4 
+// ticks are parked in the last level and rescheduled as time catches up.  At most 2^24 timers can be pending at 
+// once; past that, scheduling fails.  The wheel must be destroyed before its LuaState.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+class LuaTimerWheel
+{
+public:
+    using TimerHandle = uint64_t;  // fits in a double, so it round-trips through any Lua number
+    static constexpr TimerHandle kInvalidTimerHandle = 0;
+
+private:
+    static constexpr int kSlotBits = 6;
+    static constexpr int kNumSlots = 1 << kSlotBits;
+    static constexpr int kNumLevels = 4;
+    static constexpr int kIndexBits = 24;
+    static constexpr uint32_t kNil = 0xffffffff;
+    static constexpr uint16_t kUnlinked = 0xffff;
+
+    struct TimerNode
+    {
+        uint64_t m_expireTick;
+        uint32_t m_intervalTicks;  // 0 for timers that only fire once
+        uint32_t m_generation;  // bumped when the node is freed, so stale handles don't match
+        uint32_t m_next;
+        uint32_t m_prev;
+        uint16_t m_slot;  // level * kNumSlots + slot, or kUnlinked
+        int m_ref;  // LUA_NOREF when the node is free
+    };
+
+    struct DueTimer
+    {
+        uint32_t m_index;
+        uint32_t m_generation;
+    };
+
+    struct DispatchContext
+    {
+        LuaTimerWheel* m_pWheel;
+        size_t m_next;  // the next due timer to fire
+    };
+
+    LuaState* m_pState;
+    double m_tickSeconds;
+    double m_accumulatedSeconds;
+    uint64_t m_currentTick;
+    luastl::vector<TimerNode> m_nodes;
+    luastl::vector<DueTimer> m_dueTimers;
+    uint32_t m_slotHeads[kNumLevels * kNumSlots];
+    uint32_t m_freeHead;
+    size_t m_numTimers;
+    bool m_isDispatching;
+
+public:
+    explicit LuaTimerWheel(LuaState* pState, double tickSeconds = 1.0 / 60.0);
+    ~LuaTimerWheel();
+    LuaTimerWheel(const LuaTimerWheel&) = delete;
+    LuaTimerWheel& operator=(const LuaTimerWheel&) = delete;
+
+    // scheduling
+    TimerHandle After(double seconds, const LuaVar& function);
+    TimerHandle Every(double seconds, const LuaVar& function);
+    bool Cancel(TimerHandle handle);
+    bool IsPending(TimerHandle handle) const;
+    void CancelAll();
+
+    // time
+    void Advance(double deltaSeconds);
+    uint64_t GetCurrentTick() const { return m_currentTick; }
+    double GetTickSeconds() const { return m_tickSeconds; }
+    size_t GetNumTimers() const { return m_numTimers; }
+
+    // These are used by the bleach.timer functions.  ScheduleFromStack() takes a ref to the function at funcIndex.
+    TimerHandle ScheduleFromStack(lua_State* pState, int funcIndex, double seconds, bool repeat);
+    static void PushTimerHandle(lua_State* pState, TimerHandle handle);
+
+private:
+    uint32_t SecondsToTicks(double seconds) const;
+    uint32_t AllocateNode();
+    void FreeNode(uint32_t index);
+    void LinkNode(uint32_t index);
+    void UnlinkNode(uint32_t index);
+    void AdvanceTicks(uint64_t numTicks);
+    uint64_t CountEmptyTicks(uint64_t maxTicks) const;
+    uint64_t FindNextCascadeTick() const;
+    void Tick();
+    void CascadeSlot(int level, int slot);
+    void FireDueTimers();
+    static int CallDueTimers(lua_State* pState);
+    static TimerHandle MakeHandle(uint32_t index, uint32_t generation);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Adds the bleach.timer table, whose functions schedule timers on pTimers.  The wheel must outlive the state's use of 
+// these functions.
+//---------------------------------------------------------------------------------------------------------------------
+void OpenTimerLib(LuaState* pState, LuaTimerWheel* pTimers);
+
+}  // end namespace BleachLua
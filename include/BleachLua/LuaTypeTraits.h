@@ -59,4 +59,24 @@ template <> struct IsLuaFunction<LuaCFunction>   { static constexpr bool value =
 template <class Type> struct IsLuaUserData  { static constexpr bool value = false; };
 template <> struct IsLuaUserData<void*>     { static constexpr bool value = true; };
 
+//---------------------------------------------------------------------------------------------------------------------
+// LuaTraits
+// 
+// Specialize this to teach BleachLua how to move your own types on and off the Lua stack.  Once a type has traits, it 
+// works everywhere the built-in types do: bound function parameters and return values, LuaFunction arguments and 
+// return values, LuaVar::GetValue(), and so on.  A specialization must provide these four static functions:
+//      static void Push(LuaState* pState, const Type& value);
+//      static Type Get(LuaState* pState, int stackIndex);
+//      static bool Is(LuaState* pState, int stackIndex);
+//      static Type GetDefault();
+// 
+// The specialization must be visible anywhere the type is used with BleachLua.
+//---------------------------------------------------------------------------------------------------------------------
+class LuaState;
+
+template <class Type> struct LuaTraits { };
+
+template <class Type, class = void> struct HasLuaTraits { static constexpr bool value = false; };
+template <class Type> struct HasLuaTraits<Type, luastl::void_t<decltype(LuaTraits<Type>::Get(luastl::declval<LuaState*>(), 0))>> { static constexpr bool value = true; };
+
 }  // end namespace BleachLua
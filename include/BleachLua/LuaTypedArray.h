@@ -0,0 +1,112 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaVar.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+// Typed arrays are fixed-size userdata blocks of contiguous numbers, similar to JavaScript's typed arrays.  Storing 
+// large amounts of numeric data in Lua tables costs a full TValue per element (plus hash part risk), and operating on 
+// it means a round trip through the VM for every element.  Typed arrays store the raw numbers instead, and the bulk 
+// operations (fill, add, scale, dot, sum, etc.) run as native loops.  C++ can read and write the contents directly 
+// through GetSpan() with no copying.
+// 
+// To use them from Lua, call OpenTypedArrayLib() once.  This adds the constructors to the BleachLua library table:
+//      local samples = bleach.Float32Array(1024)       -- 1024 zeroes
+//      local weights = bleach.Float32Array({ 1, 2, 3 }) -- copied from a table
+//      samples[1] = 0.5                                -- 1-indexed, like tables
+//      samples:scale(2)
+//      print(#samples, samples:sum(), samples:dot(samples))
+// 
+// The available types are Float32Array, Float64Array, Int32Array, and Uint8Array.  See LuaTypedArray.cpp for the 
+// full list of methods.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+//---------------------------------------------------------------------------------------------------------------------
+// A non-owning view of contiguous memory.  This is only valid as long as whatever owns the memory is alive.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+class LuaSpan
+{
+    Type* m_pData;
+    size_t m_size;
+
+public:
+    LuaSpan() : m_pData(nullptr), m_size(0) { }
+    LuaSpan(Type* pData, size_t size) : m_pData(pData), m_size(size) { }
+
+    Type* GetData() const { return m_pData; }
+    size_t GetSize() const { return m_size; }
+    bool IsEmpty() const { return m_size == 0; }
+
+    Type& operator[](size_t index) const { LUA_ASSERT(index < m_size); return m_pData[index]; }
+    Type* begin() const { return m_pData; }
+    Type* end() const { return m_pData + m_size; }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaTypedArray
+// 
+// This class is the header of the userdata block; the elements follow it directly in the same allocation.  It is 
+// only implemented for float, double, int32_t, and uint8_t.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+class LuaTypedArray
+{
+    static_assert(luastl::is_arithmetic<Type>::value, "LuaTypedArray requires a numeric type.");
+
+    size_t m_size;
+
+public:
+    // The header is padded so the elements stay as aligned as the userdata block itself.
+    static constexpr size_t kHeaderSize = 16;
+
+    LuaTypedArray(const LuaTypedArray&) = delete;
+    LuaTypedArray& operator=(const LuaTypedArray&) = delete;
+
+    static LuaVar Create(LuaState* pState, size_t size);  // creates a new zero-filled array
+    static LuaTypedArray* FromVar(const LuaVar& var);  // returns nullptr if var isn't an array of this type
+    static LuaTypedArray* FromStack(lua_State* pState, int stackIndex);  // returns nullptr if the value isn't an array of this type
+    static LuaTypedArray* PushNew(lua_State* pState, size_t size);  // pushes a new zero-filled array
+
+    size_t GetSize() const { return m_size; }
+    Type* GetData() { return reinterpret_cast<Type*>(reinterpret_cast<unsigned char*>(this) + kHeaderSize); }
+    const Type* GetData() const { return reinterpret_cast<const Type*>(reinterpret_cast<const unsigned char*>(this) + kHeaderSize); }
+    LuaSpan<Type> GetSpan() { return LuaSpan<Type>(GetData(), m_size); }
+    LuaSpan<const Type> GetSpan() const { return LuaSpan<const Type>(GetData(), m_size); }
+
+private:
+    explicit LuaTypedArray(size_t size) : m_size(size) { }
+};
+
+using LuaFloat32Array = LuaTypedArray<float>;
+using LuaFloat64Array = LuaTypedArray<double>;
+using LuaInt32Array = LuaTypedArray<int32_t>;
+using LuaUint8Array = LuaTypedArray<uint8_t>;
+
+void OpenTypedArrayLib(LuaState* pState);
+
+}  // end namespace BleachLua
@@ -39,6 +39,13 @@ class LuaState;
 using LuaInt = int;
 using LuaFloat = float;
 
+// Used by LuaVar::SortBy() and bleach.sort_by().
+enum class LuaSortOrder
+{
+    kAscending,
+    kDescending,
+};
+
 LuaState* GetCppStateFromCState(lua_State* pState);
 
 }  // end namespace BleachLua
@@ -25,69 +25,28 @@
 #pragma once
 #include "LuaIncludes.h"
 #include "LuaConfig.h"
+#include "LuaCompat.h"
 #include "LuaTypes.h"
 #include "StackHelpers.h"
 #include "LuaError.h"
 #include "LuaDebug.h"
 #include "LuaStl.h"
 
-#if BLEACHLUA_USE_MEMORY_POOLS
-#include <BleachUtils/Memory/MemoryMacros.h>
-#endif
-
 namespace BleachLua {
 
-namespace _Internal {
-
-//---------------------------------------------------------------------------------------------------------------------
-// RefCount
-// 
-// The LuaVar ref count.  This is used to allow multiple LuaVar's to point to the same underlying object.
-//---------------------------------------------------------------------------------------------------------------------
-class RefCount
-{
-#if BLEACHLUA_USE_MEMORY_POOLS
-    BLEACH_MEMORYPOOL_DECLARATION(0)
-#endif
-
-    size_t m_refCount;
-
-public:
-    RefCount() : m_refCount(1) { }  // we're spinning up a new refcount, so start it at one
-    RefCount(const RefCount&) = delete;
-    RefCount& operator=(const RefCount&) = delete;
-    RefCount(RefCount&&) = delete;
-    RefCount& operator=(RefCount&&) = delete;
-
-    void Increment() { ++m_refCount; }
-    bool Decrement()
-    {
-#if BLEACHLUA_DEBUG_MODE
-        if (m_refCount > 0)
-            --m_refCount;
-        else
-            LUA_ERROR("Attempting to decrement ref count, but it's already 0.");
-#else
-        --m_refCount;
-#endif
-
-        return (m_refCount == 0);
-    }
-
-    bool IsValid() const { return m_refCount > 0; }
-};
-
-}  // end namespace BleachLua::_Internal
-
-
 class LuaState;
 class TableIterator;
+template <class Type> class LuaResult;
+class LuaProxyHandle;
 
 //---------------------------------------------------------------------------------------------------------------------
 // LuaVar
 // 
 // This class represents a single Lua variable.  The resource is stored in the Lua registry, so a reference is 
 // maintained as long as this variable exists, even if all references in Lua code are garbage collected.
+// 
+// Copies share the registry entry.  The number of LuaVars sharing each entry is kept by the LuaState in an array 
+// indexed by the registry ref, so a LuaVar is just a state pointer and a ref, and creating one doesn't allocate.
 //---------------------------------------------------------------------------------------------------------------------
 class LuaVar
 {
@@ -102,13 +61,12 @@ private:
     static LuaState* s_pDefaultLuaState;
 
     LuaState* m_pState;
-    _Internal::RefCount* m_pRefCount;
     int m_reference;
 
 public:
     static void SetDefaultLuaState(LuaState* pLuaState) { s_pDefaultLuaState = pLuaState; }
 
-    LuaVar() noexcept : m_pState(s_pDefaultLuaState), m_reference(LUA_REFNIL), m_pRefCount(nullptr) { }
+    LuaVar() noexcept : m_pState(s_pDefaultLuaState), m_reference(LUA_REFNIL) { }
     explicit LuaVar(LuaState* pState) noexcept;
     LuaVar(const LuaVar& right) : LuaVar()      { Copy(right); }
     LuaVar(LuaVar&& right) noexcept : LuaVar()  { Move(std::move(right)); }
@@ -153,6 +111,7 @@ public:
     void* GetLightUserData() const;
     void* GetUserData() const;
     template <class Type> Type GetValue() const;
+    template <class Type> LuaResult<Type> TryGetValue() const;  // never logs; see LuaResult.h
 
     // returns true if the value is of the given type, false if not
     bool IsInteger() const;
@@ -227,6 +186,9 @@ public:
     LuaVar Lookup(const luastl::string& path) const;
     size_t GetLength() const;  // works for strings, tables, and userdata
     size_t GetNumElements() const;
+    bool SortBy(const char* key, LuaSortOrder order = LuaSortOrder::kAscending) const;  // sorts an array of tables by one field
+    bool Freeze(bool deep = false);  // points this variable to a read-only view of the table
+    bool IsFrozen() const;
 
     // indexing into tables
     template <class RetType, class IndexType> RetType GetAt(IndexType) const;
@@ -244,6 +206,7 @@ public:
 
     // special userdata functions
     void WrapObjectPtr(void* pPtr);
+    template <class Container> static LuaProxyHandle MakeProxy(LuaState* pState, Container& container, bool allowWrites = false);  // see LuaProxy.h
 
     // function registration
     template <class Func> void BindFunction(const char* name, Func&& func) const;  // binds a global C function or static class function
@@ -499,7 +462,8 @@ RetType LuaVar::GetAt(IndexType index) const
 template <class IndexType>
 LuaVar LuaVar::GetVarAt(IndexType index) const
 {
-    static_assert(IsLuaString<IndexType>::value || IsLuaInteger<IndexType>::value || luastl::is_same<IndexType, LuaVar>::value, "GetVarAt() requires a string, integral type, or LuaVar as its index paramter.");
+    static_assert(IsLuaString<IndexType>::value || IsLuaInteger<IndexType>::value || luastl::is_same<IndexType, LuaVar>::value || HasLuaTraits<IndexType>::value, 
+        "GetVarAt() requires a string, integral type, LuaVar, or type with LuaTraits as its index paramter.");
 
     return DoLuaAction([this, &index]() -> LuaVar
     {
@@ -555,7 +519,7 @@ void LuaVar::BindFunction(const char* name, ObjType* pObj, Func&& func) const
     // value in the closure like we do for C functions.  The hacky workaround is to create a new userdata buffer 
     // and memcpy() the function into it.  This seems super dangerous and probably not something that's officially 
     // supported, but it does work with MSVC.
-    unsigned char* pBuffer = (unsigned char*)lua_newuserdata(m_pState->GetState(), sizeof(Func));   //  [t, pObj, buffer]
+    unsigned char* pBuffer = (unsigned char*)Compat::NewUserData(m_pState->GetState(), sizeof(Func)); //  [t, pObj, buffer]
     memcpy(pBuffer, &func, sizeof(Func));
 
     lua_pushcclosure(m_pState->GetState(), &CallBoundMemberFunctionObjPair<ObjType, Func>, 2);      //  [t, closure]
@@ -584,7 +548,7 @@ void LuaVar::BindFunction(const char* name, Func&& func) const
     // value in the closure like we do for C functions.  The hacky workaround is to create a new userdata buffer 
     // and memcpy() the function into it.  This seems super dangerous and probably not something that's officially 
     // supported, but it does work with MSVC.
-    unsigned char* pBuffer = (unsigned char*)lua_newuserdata(m_pState->GetState(), sizeof(Func));   //  [t, buffer]
+    unsigned char* pBuffer = (unsigned char*)Compat::NewUserData(m_pState->GetState(), sizeof(Func)); //  [t, buffer]
     memcpy(pBuffer, &func, sizeof(Func));
 
     lua_pushcclosure(m_pState->GetState(), &CallBoundMemberFunction<ObjType, Func>, 1);             //  [t, closure]
@@ -774,10 +738,9 @@ int LuaVar::CallBoundFunction(lua_State* pState)
     LUA_ASSERT(pState);
 
 #if BLEACHLUA_DEBUG_MODE
-    // This string will contain the Lua stack trace that called into this function.  This exists only in debug mode 
-    // and is never used anywhere.  The purpose is so that you can look at the value in the debugger and see what 
-    // Lua call brought you here.
-    [[maybe_unused]] luastl::string traceback = Debug::GetTraceback(GetCppStateFromCState(pState));
+    // Marks this as the innermost bound call.  The Lua stack trace that called into this function is only built if 
+    // an error fires while we're in here.  See Debug::GetBoundCallTraceback().
+    Debug::BoundCallScope boundCallScope(pState);
 #endif
 
     Func pFunc = static_cast<Func>(lua_touserdata(pState, lua_upvalueindex(1)));
@@ -796,10 +759,9 @@ int LuaVar::CallBoundMemberFunctionObjPair(lua_State* pState)
     LUA_ASSERT(pState);
 
 #if BLEACHLUA_DEBUG_MODE
-    // This string will contain the Lua stack trace that called into this function.  This exists only in debug mode 
-    // and is never used anywhere.  The purpose is so that you can look at the value in the debugger and see what 
-    // Lua call brought you here.
-    [[maybe_unused]] luastl::string traceback = Debug::GetTraceback(GetCppStateFromCState(pState));
+    // Marks this as the innermost bound call.  The Lua stack trace that called into this function is only built if 
+    // an error fires while we're in here.  See Debug::GetBoundCallTraceback().
+    Debug::BoundCallScope boundCallScope(pState);
 #endif
 
     Obj* pObj = static_cast<Obj*>(lua_touserdata(pState, lua_upvalueindex(1)));
@@ -823,10 +785,9 @@ int LuaVar::CallBoundMemberFunction(lua_State* pState)
     LUA_ASSERT(pState);
 
 #if BLEACHLUA_DEBUG_MODE
-    // This string will contain the Lua stack trace that called into this function.  This exists only in debug mode 
-    // and is never used anywhere.  The purpose is so that you can look at the value in the debugger and see what 
-    // Lua call brought you here.
-    [[maybe_unused]] luastl::string traceback = Debug::GetTraceback(GetCppStateFromCState(pState));
+    // Marks this as the innermost bound call.  The Lua stack trace that called into this function is only built if 
+    // an error fires while we're in here.  See Debug::GetBoundCallTraceback().
+    Debug::BoundCallScope boundCallScope(pState);
 #endif
 
     // make sure we have a table
@@ -0,0 +1,78 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "LuaIncludes.h"
+#include "LuaVar.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaWeakVar is a reference to a Lua value that doesn't keep it alive.  C++ caches and observer lists can hold these 
+// without leaking script objects: once nothing else references the value, the garbage collector takes it and Lock() 
+// starts returning nil.
+// 
+//      LuaWeakVar m_target;
+//      ...
+//      m_target = enemy;                       // enemy is a LuaVar
+//      ...
+//      LuaVar target = m_target.Lock();        // strong for as long as target lives
+//      if (!target.IsNil())
+//          target.GetTableVar("TakeDamage")...
+// 
+// Each LuaState has one table with weak values (__mode = "v") that holds every weak value in that state.  A LuaWeakVar 
+// owns an integer slot in it, so Lock() and IsAlive() are a couple of raw integer reads.  Slots are handed out from a 
+// free list kept in the table itself rather than by luaL_ref(), since collected values leave holes that would throw 
+// off luaL_ref()'s use of the table's length.
+// 
+// Only collectable values (tables, functions, userdata, threads) can go away.  Strings, numbers, booleans, and light 
+// userdata are never removed from a weak table, so for those a LuaWeakVar behaves like a LuaVar.
+//---------------------------------------------------------------------------------------------------------------------
+
+namespace BleachLua {
+
+class LuaWeakVar
+{
+    LuaState* m_pState;
+    int m_slot;  // LUA_REFNIL when empty
+
+public:
+    LuaWeakVar() noexcept : m_pState(nullptr), m_slot(LUA_REFNIL) { }
+    LuaWeakVar(const LuaVar& var);
+    LuaWeakVar(const LuaWeakVar& right);
+    LuaWeakVar(LuaWeakVar&& right) noexcept : m_pState(right.m_pState), m_slot(right.m_slot) { right.m_slot = LUA_REFNIL; }
+    LuaWeakVar& operator=(const LuaVar& var);
+    LuaWeakVar& operator=(const LuaWeakVar& right);
+    LuaWeakVar& operator=(LuaWeakVar&& right) noexcept;
+    ~LuaWeakVar() { Reset(); }
+
+    LuaVar Lock() const;  // returns nil if the value has been collected or this was never set
+    bool IsAlive() const;
+    bool IsEmpty() const { return m_slot == LUA_REFNIL; }  // true if this was never set, which is different from dead
+    void Reset();
+    LuaState* GetLuaState() const { return m_pState; }
+
+private:
+    void SetFromStack(LuaState* pState);
+    bool PushValue() const;
+};
+
+}  // end namespace BleachLua
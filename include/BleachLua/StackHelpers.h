@@ -102,6 +102,13 @@ luastl::enable_if_t<IsLuaUserData<Type>::value, Type> GetDefault()
     return nullptr;
 }
 
+// custom types (see LuaTraits in LuaTypeTraits.h)
+template <class Type>
+luastl::enable_if_t<HasLuaTraits<Type>::value, Type> GetDefault()
+{
+    return LuaTraits<Type>::GetDefault();
+}
+
 // Note: The LuaVar version of GetDefault() is in LuaVar.h
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -168,6 +175,14 @@ luastl::enable_if_t<IsLuaUserData<Type>::value> Push(LuaState* pState, Type val)
     lua_pushlightuserdata(pState->GetState(), val);
 }
 
+// custom types (see LuaTraits in LuaTypeTraits.h)
+template <class Type>
+luastl::enable_if_t<HasLuaTraits<Type>::value> Push(LuaState* pState, const Type& val)
+{
+    LUA_ASSERT(pState);
+    LuaTraits<Type>::Push(pState, val);
+}
+
 // Note: The LuaVar version of Push() is in LuaVar.h
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -282,6 +297,14 @@ luastl::enable_if_t<IsLuaUserData<Type>::value, bool> Is(LuaState* pState, int s
     return (lua_islightuserdata(pState->GetState(), stackIndex) || lua_isuserdata(pState->GetState(), stackIndex));
 }
 
+// custom types (see LuaTraits in LuaTypeTraits.h)
+template <class Type>
+luastl::enable_if_t<HasLuaTraits<Type>::value, bool> Is(LuaState* pState, int stackIndex = -1)
+{
+    LUA_ASSERT(pState);
+    return LuaTraits<Type>::Is(pState, stackIndex);
+}
+
 // Note: The LuaVar version of Is() is in LuaVar.h
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -405,6 +428,14 @@ luastl::enable_if_t<IsLuaUserData<Type>::value, Type> Get(LuaState* pState, int
     return lua_touserdata(pState->GetState(), stackIndex);
 }
 
+// custom types (see LuaTraits in LuaTypeTraits.h)
+template <class Type>
+luastl::enable_if_t<HasLuaTraits<Type>::value, Type> Get(LuaState* pState, int stackIndex = -1)
+{
+    LUA_ASSERT(pState);
+    return LuaTraits<Type>::Get(pState, stackIndex);
+}
+
 // Note: The LuaVar version of Get() is in LuaVar.h
 
 //---------------------------------------------------------------------------------------------------------------------
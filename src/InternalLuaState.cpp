@@ -56,6 +56,31 @@ static int OnLuaException(lua_State* pState)
     return 1;                                                   //  [error+stacktrace]  <-- returned
 }
 
+LuaState::LuaState(LuaState&& right) noexcept
+    : m_pState(right.m_pState)
+    , m_globalsGeneration(right.m_globalsGeneration)
+    , m_refCounts(std::move(right.m_refCounts))
+    , m_deferredUnrefs(std::move(right.m_deferredUnrefs))
+    , m_isDeferringUnrefs(right.m_isDeferringUnrefs)
+{
+    right.m_pState = nullptr;
+    right.m_refCounts.clear();
+    right.m_deferredUnrefs.clear();
+}
+
+LuaState& LuaState::operator=(LuaState&& right) noexcept
+{
+    m_pState = right.m_pState;
+    m_globalsGeneration = right.m_globalsGeneration;
+    m_refCounts = std::move(right.m_refCounts);
+    m_deferredUnrefs = std::move(right.m_deferredUnrefs);
+    m_isDeferringUnrefs = right.m_isDeferringUnrefs;
+    right.m_pState = nullptr;
+    right.m_refCounts.clear();
+    right.m_deferredUnrefs.clear();
+    return (*this);
+}
+
 LuaState::~LuaState()
 {
     if (m_pState)
@@ -91,28 +116,81 @@ bool LuaState::Init(bool loadAllLibs /*= true*/)
 
 LuaVar LuaState::LoadString(const char* str)
 {
-    int result = luaL_loadbuffer(m_pState, str, strlen(str), str);
+    return LoadString(str, LuaVar());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Loads a chunk without running it.
+//      -str:       The Lua code.
+//      -env:       The table the chunk will use for its globals, usually from CreateEnvironment().  If this is nil, 
+//                  the chunk uses the real globals.
+//      -return:    The loaded chunk, or nil if there was a syntax error.
+//---------------------------------------------------------------------------------------------------------------------
+LuaVar LuaState::LoadString(const char* str, const LuaVar& env)
+{
+    int result = luaL_loadbuffer(m_pState, str, strlen(str), str);     //  [chunk|error]
     if (result != LUA_OK)
     {
         const char* errorStr = lua_tostring(m_pState, -1);
         LUA_ERROR(errorStr);
+        lua_pop(m_pState, 1);                                           //  []
         return LuaVar();
     }
 
-    return LuaVar::CreateFromStack(this);
+    if (!env.IsNil())
+    {
+        env.PushValueToStack();                                         //  [chunk, env]
+        Compat::SetChunkEnvironment(m_pState, lua_gettop(m_pState) - 1);   //  [chunk]
+    }
+
+    return LuaVar::CreateFromStack(this);                               //  []
 }
 
 bool LuaState::DoString(const char* str) const
+{
+    return DoString(str, LuaVar());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Loads and runs a chunk.  Any values it returns are left on the stack, like luaL_dostring().
+//      -str:       The Lua code.
+//      -env:       The table the chunk uses for its globals, usually from CreateEnvironment().  If this is nil, the 
+//                  chunk uses the real globals.
+//      -return:    true if the chunk ran without errors.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaState::DoString(const char* str, const LuaVar& env) const
 {
     LUA_ASSERT(m_pState);
 
-    int error = luaL_dostring(m_pState, str);
+    int error = luaL_loadstring(m_pState, str);                         //  [chunk|error]
+    if (error == LUA_OK)
+    {
+        if (!env.IsNil())
+        {
+            env.PushValueToStack();                                     //  [chunk, env]
+            Compat::SetChunkEnvironment(m_pState, lua_gettop(m_pState) - 1);   //  [chunk]
+        }
+        error = Debug::ProtectedCall(m_pState, 0, LUA_MULTRET, 0);      //  [results...|error]
+        BumpGlobalsGeneration();  // the chunk may have assigned globals even if it failed partway through
+    }
     CHECK_FOR_LUA_ERROR(m_pState, error);
 
     return true;
 }
 
 bool LuaState::DoFile(const char* path)
+{
+    return DoFile(path, LuaVar());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Loads and runs a file.
+//      -path:      The path to the file.
+//      -env:       The table the file uses for its globals, usually from CreateEnvironment().  If this is nil, the 
+//                  file uses the real globals.
+//      -return:    true if the file ran without errors.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaState::DoFile(const char* path, const LuaVar& env)
 {
     LUA_ASSERT(m_pState);
 
@@ -123,7 +201,14 @@ bool LuaState::DoFile(const char* path)
     int result = luaL_loadfile(m_pState, path);         //  [exHandler, chunk|error]
     CHECK_FOR_PCALL_EXCEPTION(m_pState, result);
 
-    result = lua_pcall(m_pState, 0, 0, -2);             //  [exHandler, error?]
+    if (!env.IsNil())
+    {
+        env.PushValueToStack();                         //  [exHandler, chunk, env]
+        Compat::SetChunkEnvironment(m_pState, lua_gettop(m_pState) - 1);   //  [exHandler, chunk]
+    }
+
+    result = Debug::ProtectedCall(m_pState, 0, 0, -2);  //  [exHandler, error?]
+    BumpGlobalsGeneration();  // the file may have assigned globals even if it failed partway through
     if (result != LUA_OK)
         return false;                                   //  []  <-- from StackResetter
 
@@ -135,14 +220,366 @@ void LuaState::ClearStack() const
     lua_settop(m_pState, 0);
 }
 
+//---------------------------------------------------------------------------------------------------------------------
+// Sandboxed environments.  An environment is an empty table whose metatable __indexes a parent, so creating one is a 
+// single small allocation and it only grows by the globals the script writes.  The default parent is a shared base: 
+// a snapshot of the globals taken the first time it's needed, which scripts can't reach or modify (the metatable is 
+// hidden with __metatable).  Every table reachable from the snapshot, including library tables like string and math, 
+// is copied once and handed out as a deep frozen view of the copy (see LuaVar::Freeze()), so scripts get real tables 
+// that read at table speed, and one sandbox can't poison the others with something like string.format = f.  The 
+// base's rawset() refuses frozen tables, and the string metatable, which every sandbox shares with the main state, 
+// gets a frozen __index and a frozen __metatable the first time a base is built.  The debug library, if it's loaded, 
+// can get around all of this.  Each environment's _G points back to itself.
+// 
+//      LuaVar env = pState->CreateEnvironment();
+//      pState->DoFile("mods/foo/init.lua", env);
+//---------------------------------------------------------------------------------------------------------------------
+static char s_sharedEnvironmentMetatableKey;  // the address is the registry key
+
+// rawset(t, key, value) -> t, for the shared base, with the frozen table guard as upvalue 1
+static int SandboxRawSet(lua_State* pState)
+{
+    luaL_checktype(pState, 1, LUA_TTABLE);
+    luaL_checkany(pState, 2);
+    luaL_checkany(pState, 3);
+    lua_settop(pState, 3);                                              //  [t, key, value]
+    if (lua_getmetatable(pState, 1))                                    //  [t, key, value, mt]
+    {
+        lua_pushstring(pState, "__newindex");                           //  [t, key, value, mt, "__newindex"]
+        lua_rawget(pState, -2);                                         //  [t, key, value, mt, __newindex]
+        if (lua_tocfunction(pState, -1) == lua_tocfunction(pState, lua_upvalueindex(1)))
+            return luaL_error(pState, "attempt to modify a frozen table");
+        lua_pop(pState, 2);                                             //  [t, key, value]
+    }
+    lua_rawset(pState, 1);                                              //  [t]
+    return 1;
+}
+
+// Pushes the copy of the table at the top of the stack, creating it and queueing the table if it's new.
+static void PushTableCopy(lua_State* pState, int copiesIndex, int pendingIndex)
+{
+    const int tableIndex = lua_gettop(pState);
+    lua_pushvalue(pState, tableIndex);                                  //  [t, t]
+    lua_rawget(pState, copiesIndex);                                    //  [t, copy|nil]
+    if (!lua_isnil(pState, -1))
+        return;
+    lua_pop(pState, 1);                                                 //  [t]
+
+    lua_newtable(pState);                                               //  [t, copy]
+    if (lua_getmetatable(pState, tableIndex))                           //  [t, copy, mt]
+        lua_setmetatable(pState, -2);                                   //  [t, copy]
+    lua_pushvalue(pState, tableIndex);                                  //  [t, copy, t]
+    lua_pushvalue(pState, -2);                                          //  [t, copy, t, copy]
+    lua_rawset(pState, copiesIndex);                                    //  [t, copy]
+    lua_pushvalue(pState, tableIndex);                                  //  [t, copy, t]
+    lua_rawseti(pState, pendingIndex, static_cast<int>(Compat::RawLen(pState, pendingIndex)) + 1);  //  [t, copy]
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Pushes a snapshot of the globals: a copy of _G in which every reachable table is replaced by a shallow copy of 
+// itself, with the same metatable.  Tables that are reached more than once, like string and package.loaded.string, 
+// share one copy.  Table keys aren't copied.
+//---------------------------------------------------------------------------------------------------------------------
+static void PushGlobalSnapshot(lua_State* pState)
+{
+    lua_checkstack(pState, 10);
+    lua_newtable(pState);                                               //  [copies]
+    const int copiesIndex = lua_gettop(pState);
+    lua_newtable(pState);                                               //  [copies, pending]
+    const int pendingIndex = copiesIndex + 1;
+    Compat::PushGlobalTable(pState);                                    //  [copies, pending, _G]
+    PushTableCopy(pState, copiesIndex, pendingIndex);                   //  [copies, pending, _G, snapshot]
+
+    for (size_t count = Compat::RawLen(pState, pendingIndex); count > 0; count = Compat::RawLen(pState, pendingIndex))
+    {
+        lua_rawgeti(pState, pendingIndex, static_cast<int>(count));     //  [..., original]
+        lua_pushnil(pState);                                            //  [..., original, nil]
+        lua_rawseti(pState, pendingIndex, static_cast<int>(count));     //  [..., original]
+        const int originalIndex = lua_gettop(pState);
+        lua_pushvalue(pState, originalIndex);                           //  [..., original, original]
+        lua_rawget(pState, copiesIndex);                                //  [..., original, copy]
+        const int copyIndex = originalIndex + 1;
+
+        lua_pushnil(pState);                                            //  [..., original, copy, nil]
+        while (lua_next(pState, originalIndex))                         //  [..., original, copy, key, value]
+        {
+            if (lua_istable(pState, -1))
+            {
+                PushTableCopy(pState, copiesIndex, pendingIndex);       //  [..., original, copy, key, value, valueCopy]
+                lua_replace(pState, -2);                                //  [..., original, copy, key, valueCopy]
+            }
+            lua_pushvalue(pState, -2);                                  //  [..., original, copy, key, value, key]
+            lua_insert(pState, -2);                                     //  [..., original, copy, key, key, value]
+            lua_rawset(pState, copyIndex);                              //  [..., original, copy, key]
+        }
+        lua_settop(pState, originalIndex - 1);                          //  [copies, pending, _G, snapshot]
+    }
+
+    lua_replace(pState, copiesIndex);                                   //  [snapshot, pending, _G]
+    lua_settop(pState, copiesIndex);                                    //  [snapshot]
+}
+
+// Gives the string metatable a read-only __index and __metatable, since every environment shares it.
+static void ProtectStringMetatable(LuaState* pCppState)
+{
+    lua_State* pState = pCppState->GetState();
+    lua_pushliteral(pState, "");                                        //  [""]
+    if (!lua_getmetatable(pState, -1))                                  //  ["", mt?]
+    {
+        lua_pop(pState, 1);                                             //  []
+        return;
+    }
+    lua_remove(pState, -2);                                             //  [mt]
+    lua_pushstring(pState, "__metatable");                              //  [mt, "__metatable"]
+    lua_rawget(pState, -2);                                             //  [mt, __metatable|nil]
+    const bool isProtected = !lua_isnil(pState, -1);
+    lua_pop(pState, 1);                                                 //  [mt]
+    if (isProtected)
+    {
+        lua_pop(pState, 1);                                             //  []
+        return;
+    }
+
+    // the view of the string table stays live, so the main state can still add string functions
+    lua_getfield(pState, -1, "__index");                                //  [mt, __index]
+    LuaVar index = LuaVar::CreateFromStack(pCppState);                  //  [mt]
+    if (index.Freeze())
+    {
+        index.PushValueToStack();                                       //  [mt, view]
+        lua_setfield(pState, -2, "__index");                            //  [mt]
+    }
+
+    lua_pushvalue(pState, -1);                                          //  [mt, mt]
+    LuaVar metatable = LuaVar::CreateFromStack(pCppState);              //  [mt]
+    metatable.Freeze();
+    metatable.PushValueToStack();                                       //  [mt, view]
+    lua_setfield(pState, -2, "__metatable");                            //  [mt]
+    lua_pop(pState, 1);                                                 //  []
+}
+
+static void PushSharedEnvironmentMetatable(LuaState* pCppState)
+{
+    lua_State* pState = pCppState->GetState();
+    lua_pushlightuserdata(pState, &s_sharedEnvironmentMetatableKey);    //  [key]
+    lua_rawget(pState, LUA_REGISTRYINDEX);                              //  [metatable|nil]
+    if (!lua_isnil(pState, -1))
+        return;
+    lua_pop(pState, 1);                                                 //  []
+
+    ProtectStringMetatable(pCppState);
+    PushGlobalSnapshot(pState);                                         //  [snapshot]
+    lua_pushnil(pState);                                                //  [snapshot, nil]
+    lua_setfield(pState, -2, "_G");                                     //  [snapshot]
+
+    // Freeze the snapshot as a whole and copy the values back out through the view.  Every table reachable from the 
+    // base then goes through the same set of views, so string and package.loaded.string are still the same object.
+    lua_pushvalue(pState, -1);                                          //  [snapshot, snapshot]
+    LuaVar frozenSnapshot = LuaVar::CreateFromStack(pCppState);         //  [snapshot]
+    frozenSnapshot.Freeze(true);
+
+    lua_newtable(pState);                                               //  [snapshot, base]
+    lua_pushnil(pState);                                                //  [snapshot, base, nil]
+    while (lua_next(pState, -3))                                        //  [snapshot, base, key, value]
+    {
+        lua_pop(pState, 1);                                             //  [snapshot, base, key]
+        lua_pushvalue(pState, -1);                                      //  [snapshot, base, key, key]
+        frozenSnapshot.PushValueToStack();                              //  [snapshot, base, key, key, view]
+        lua_insert(pState, -2);                                         //  [snapshot, base, key, view, key]
+        lua_gettable(pState, -2);                                       //  [snapshot, base, key, view, value]
+        lua_remove(pState, -2);                                         //  [snapshot, base, key, value]
+        lua_pushvalue(pState, -2);                                      //  [snapshot, base, key, value, key]
+        lua_insert(pState, -2);                                         //  [snapshot, base, key, key, value]
+        lua_rawset(pState, -4);                                         //  [snapshot, base, key]
+    }
+    lua_remove(pState, -2);                                             //  [base]
+
+    // the view's guard function identifies frozen tables for rawset()
+    frozenSnapshot.PushValueToStack();                                  //  [base, view]
+    lua_getmetatable(pState, -1);                                       //  [base, view, viewMetatable]
+    lua_getfield(pState, -1, "__newindex");                             //  [base, view, viewMetatable, guard]
+    lua_pushcclosure(pState, &SandboxRawSet, 1);                        //  [base, view, viewMetatable, rawset]
+    lua_setfield(pState, -4, "rawset");                                 //  [base, view, viewMetatable]
+    lua_pop(pState, 2);                                                 //  [base]
+
+    lua_createtable(pState, 0, 2);                                      //  [base, metatable]
+    lua_insert(pState, -2);                                             //  [metatable, base]
+    lua_setfield(pState, -2, "__index");                                //  [metatable]
+    lua_pushboolean(pState, 0);                                         //  [metatable, false]
+    lua_setfield(pState, -2, "__metatable");                            //  [metatable]
+
+    lua_pushlightuserdata(pState, &s_sharedEnvironmentMetatableKey);    //  [metatable, key]
+    lua_pushvalue(pState, -2);                                          //  [metatable, key, metatable]
+    lua_rawset(pState, LUA_REGISTRYINDEX);                              //  [metatable]
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Creates an environment over the shared base.
+//      -return:    The new environment table.
+//---------------------------------------------------------------------------------------------------------------------
+LuaVar LuaState::CreateEnvironment()
+{
+    LUA_ASSERT(m_pState);
+
+    lua_createtable(m_pState, 0, 1);                                    //  [env]
+    PushSharedEnvironmentMetatable(this);                               //  [env, metatable]
+    lua_setmetatable(m_pState, -2);                                     //  [env]
+    lua_pushvalue(m_pState, -1);                                        //  [env, env]
+    lua_setfield(m_pState, -2, "_G");                                   //  [env]
+
+    return LuaVar::CreateFromStack(this);                               //  []
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Creates an environment over a parent table, which can be another environment.  Unlike the shared base, this needs 
+// its own metatable.
+//      -parent:    The table that reads fall back to.
+//      -return:    The new environment table, or nil if parent isn't a table.
+//---------------------------------------------------------------------------------------------------------------------
+LuaVar LuaState::CreateEnvironment(const LuaVar& parent)
+{
+    LUA_ASSERT(m_pState);
+
+    if (!parent.IsTable())
+    {
+        LUA_ERROR("The parent of an environment must be a table.  Type is " + parent.GetTypeNameStr());
+        return LuaVar();
+    }
+
+    lua_createtable(m_pState, 0, 1);                                    //  [env]
+    lua_createtable(m_pState, 0, 2);                                    //  [env, metatable]
+    parent.PushValueToStack();                                          //  [env, metatable, parent]
+    lua_setfield(m_pState, -2, "__index");                              //  [env, metatable]
+    lua_pushboolean(m_pState, 0);                                       //  [env, metatable, false]
+    lua_setfield(m_pState, -2, "__metatable");                          //  [env, metatable]
+    lua_setmetatable(m_pState, -2);                                     //  [env]
+    lua_pushvalue(m_pState, -1);                                        //  [env, env]
+    lua_setfield(m_pState, -2, "_G");                                   //  [env]
+
+    return LuaVar::CreateFromStack(this);                               //  []
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Drops the shared base, so the next call to CreateEnvironment() takes a new snapshot of the globals.  Existing 
+// environments keep the old one.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaState::ResetSharedEnvironmentBase()
+{
+    LUA_ASSERT(m_pState);
+
+    lua_pushlightuserdata(m_pState, &s_sharedEnvironmentMetatableKey);  //  [key]
+    lua_pushnil(m_pState);                                              //  [key, nil]
+    lua_rawset(m_pState, LUA_REGISTRYINDEX);                            //  []
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Garbage collector controls.  These are thin wrappers around lua_gc(); see the Lua reference manual for the details 
+// of each option.
+//---------------------------------------------------------------------------------------------------------------------
 void LuaState::CollectGarbage() const
 {
+    FlushDeferredUnrefs();
     lua_gc(m_pState, LUA_GCCOLLECT, 0);
 }
 
+bool LuaState::StepGarbageCollector(int stepSizeKb /*= 0*/) const
+{
+    FlushDeferredUnrefs();
+    return lua_gc(m_pState, LUA_GCSTEP, stepSizeKb) != 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Turns deferred unrefs on or off.  See the comment in InternalLuaState.h.
+//      -defer:     true to defer, false to unref immediately.  Turning it off flushes any refs still waiting.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaState::SetDeferUnrefs(bool defer)
+{
+    m_isDeferringUnrefs = defer;
+    if (!defer)
+        FlushDeferredUnrefs();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Releases every deferred ref.  This must not be called while something is iterating the registry.
+//      -return:    The number of refs released.
+//---------------------------------------------------------------------------------------------------------------------
+size_t LuaState::FlushDeferredUnrefs() const
+{
+    const size_t count = m_deferredUnrefs.size();
+    for (int ref : m_deferredUnrefs)
+        luaL_unref(m_pState, LUA_REGISTRYINDEX, ref);
+    m_deferredUnrefs.clear();
+    return count;
+}
+
+void LuaState::StopGarbageCollector() const
+{
+    lua_gc(m_pState, LUA_GCSTOP, 0);
+}
+
+void LuaState::RestartGarbageCollector() const
+{
+    lua_gc(m_pState, LUA_GCRESTART, 0);
+}
+
+size_t LuaState::GetMemoryUsage() const
+{
+    const size_t kb = static_cast<size_t>(lua_gc(m_pState, LUA_GCCOUNT, 0));
+    const size_t remainder = static_cast<size_t>(lua_gc(m_pState, LUA_GCCOUNTB, 0));
+    return (kb * 1024) + remainder;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Switches the collector to generational mode.  This is generally much cheaper than incremental mode when most 
+// allocations are short-lived temporaries.  Lua 5.3 has no generational mode.  Lua 5.2 has an experimental one that 
+// takes no parameters, so the multipliers are ignored there.  LuaJIT only has the incremental collector.
+//      -minorMultiplier:   How much memory can grow between minor collections, as a percentage.  0 keeps the current 
+//                          value.
+//      -majorMultiplier:   How much memory can grow before a major collection, as a percentage.  0 keeps the current 
+//                          value.
+//      -return:            true if the mode was set, false if this version of Lua doesn't support it.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaState::SetGenerationalGc([[maybe_unused]] int minorMultiplier /*= 0*/, [[maybe_unused]] int majorMultiplier /*= 0*/) const
+{
+#if BLEACHLUA_CORE_VERSION >= 54
+    lua_gc(m_pState, LUA_GCGEN, minorMultiplier, majorMultiplier);
+    return true;
+#elif BLEACHLUA_CORE_VERSION == 52
+    lua_gc(m_pState, LUA_GCGEN, 0);
+    return true;
+#else
+    LUA_ERROR("Generational garbage collection isn't supported in this version of Lua.");
+    return false;
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Switches the collector to incremental mode, which is the default in every version of Lua.  A value of 0 for any 
+// parameter keeps its current value.
+//      -pause:             How long the collector waits before starting a new cycle, as a percentage.
+//      -stepMultiplier:    The speed of the collector relative to memory allocation, as a percentage.
+//      -stepSizeLog2:      The size of each incremental step, as log2 of the number of bytes.  Only Lua 5.4 
+//                          supports this.
+//      -return:            true.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaState::SetIncrementalGc(int pause /*= 0*/, int stepMultiplier /*= 0*/, [[maybe_unused]] int stepSizeLog2 /*= 0*/) const
+{
+#if BLEACHLUA_CORE_VERSION >= 54
+    lua_gc(m_pState, LUA_GCINC, pause, stepMultiplier, stepSizeLog2);
+#else
+    #if BLEACHLUA_CORE_VERSION == 52
+    lua_gc(m_pState, LUA_GCINC, 0);
+    #endif
+    if (pause > 0)
+        lua_gc(m_pState, LUA_GCSETPAUSE, pause);
+    if (stepMultiplier > 0)
+        lua_gc(m_pState, LUA_GCSETSTEPMUL, stepMultiplier);
+#endif
+    return true;
+}
+
 LuaVar LuaState::GetGlobals()
 {
-    lua_pushglobaltable(m_pState);
+    Compat::PushGlobalTable(m_pState);
     return LuaVar::CreateFromStack(this);
 }
 
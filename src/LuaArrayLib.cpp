@@ -0,0 +1,455 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaArrayLib.h>
+#include <BleachLua/LuaState.h>
+#include <algorithm>
+
+namespace BleachLua {
+
+//---------------------------------------------------------------------------------------------------------------------
+// Helpers
+//---------------------------------------------------------------------------------------------------------------------
+// Reads the optional [first, last] range arguments starting at argIndex, clamped to the table's raw length.  Returns 
+// false if the range is empty.
+static bool CheckRange(lua_State* pState, int tableIndex, int argIndex, int& outFirst, int& outLast)
+{
+    const lua_Integer length = static_cast<lua_Integer>(Compat::RawLen(pState, tableIndex));
+    const lua_Integer first = luaL_optinteger(pState, argIndex, 1);
+    const lua_Integer last = luaL_optinteger(pState, argIndex + 1, length);
+    luaL_argcheck(pState, first >= 1, argIndex, "index out of range");
+    luaL_argcheck(pState, last <= length, argIndex + 1, "index out of range");
+
+    outFirst = static_cast<int>(first);
+    outLast = static_cast<int>(last);
+    return first <= last;
+}
+
+// Pops the value at the top of the stack, which must be a number.  index is only for the error message.
+static lua_Number PopNumber(lua_State* pState, int index)
+{
+    if (lua_type(pState, -1) != LUA_TNUMBER)
+        luaL_error(pState, "number expected at index %d, got %s", index, luaL_typename(pState, -1));
+
+    const lua_Number value = lua_tonumber(pState, -1);
+    lua_pop(pState, 1);
+    return value;
+}
+
+#if BLEACHLUA_CORE_VERSION >= 53
+// Integer arithmetic that wraps around the way Lua's does, without signed overflow.
+static lua_Integer WrappingAdd(lua_Integer left, lua_Integer right)
+{
+    return static_cast<lua_Integer>(static_cast<lua_Unsigned>(left) + static_cast<lua_Unsigned>(right));
+}
+
+static lua_Integer WrappingMultiply(lua_Integer left, lua_Integer right)
+{
+    return static_cast<lua_Integer>(static_cast<lua_Unsigned>(left) * static_cast<lua_Unsigned>(right));
+}
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+// Library functions
+//---------------------------------------------------------------------------------------------------------------------
+// bleach.array.sum(t [, first [, last]]) -> number; on Lua 5.3+, the sum stays an integer until a float is added
+static int ArraySum(lua_State* pState)
+{
+    luaL_checktype(pState, 1, LUA_TTABLE);
+    int first, last;
+    lua_Number sum = 0;
+#if BLEACHLUA_CORE_VERSION >= 53
+    lua_Integer integerSum = 0;
+    bool isInteger = true;
+#endif
+    if (CheckRange(pState, 1, 2, first, last))
+    {
+        for (int i = first; i <= last; ++i)
+        {
+            lua_rawgeti(pState, 1, i);                                      //  [..., value]
+#if BLEACHLUA_CORE_VERSION >= 53
+            if (isInteger)
+            {
+                if (lua_isinteger(pState, -1))
+                {
+                    integerSum = WrappingAdd(integerSum, lua_tointeger(pState, -1));
+                    lua_pop(pState, 1);                                     //  [...]
+                    continue;
+                }
+                isInteger = false;
+                sum = static_cast<lua_Number>(integerSum);
+            }
+#endif
+            sum += PopNumber(pState, i);                                    //  [...]
+        }
+    }
+#if BLEACHLUA_CORE_VERSION >= 53
+    if (isInteger)
+    {
+        lua_pushinteger(pState, integerSum);
+        return 1;
+    }
+#endif
+    lua_pushnumber(pState, sum);
+    return 1;
+}
+
+// bleach.array.minmax(t [, first [, last]]) -> min, max (or nil if the range is empty); on Lua 5.3+, these are 
+// integers unless the range holds a float
+static int ArrayMinMax(lua_State* pState)
+{
+    luaL_checktype(pState, 1, LUA_TTABLE);
+    int first, last;
+    if (!CheckRange(pState, 1, 2, first, last))
+    {
+        lua_pushnil(pState);
+        return 1;
+    }
+
+    int i = first;
+#if BLEACHLUA_CORE_VERSION >= 53
+    lua_Integer integerMin = 0;
+    lua_Integer integerMax = 0;
+    for (; i <= last; ++i)
+    {
+        lua_rawgeti(pState, 1, i);                                          //  [..., value]
+        if (!lua_isinteger(pState, -1))
+            break;
+        const lua_Integer value = lua_tointeger(pState, -1);
+        lua_pop(pState, 1);                                                 //  [...]
+        integerMin = (i == first || value < integerMin) ? value : integerMin;
+        integerMax = (i == first || value > integerMax) ? value : integerMax;
+    }
+    if (i > last)
+    {
+        lua_pushinteger(pState, integerMin);
+        lua_pushinteger(pState, integerMax);
+        return 2;
+    }
+    lua_pop(pState, 1);                                                     //  [...]
+#endif
+
+    lua_rawgeti(pState, 1, i);
+    lua_Number minVal = PopNumber(pState, i);
+    lua_Number maxVal = minVal;
+#if BLEACHLUA_CORE_VERSION >= 53
+    if (i > first)
+    {
+        minVal = std::min(minVal, static_cast<lua_Number>(integerMin));
+        maxVal = std::max(maxVal, static_cast<lua_Number>(integerMax));
+    }
+#endif
+    for (++i; i <= last; ++i)
+    {
+        lua_rawgeti(pState, 1, i);
+        const lua_Number value = PopNumber(pState, i);
+        minVal = (value < minVal) ? value : minVal;
+        maxVal = (value > maxVal) ? value : maxVal;
+    }
+    lua_pushnumber(pState, minVal);
+    lua_pushnumber(pState, maxVal);
+    return 2;
+}
+
+// bleach.array.scale(t, scale [, first [, last]]) -> t; scales the elements in place.  Each element becomes 
+// t[i] * scale, so on Lua 5.3+, integer elements stay integers when the scale is an integer.
+static int ArrayScale(lua_State* pState)
+{
+    luaL_checktype(pState, 1, LUA_TTABLE);
+    const lua_Number scale = luaL_checknumber(pState, 2);
+#if BLEACHLUA_CORE_VERSION >= 53
+    const bool isIntegerScale = lua_isinteger(pState, 2);
+    const lua_Integer integerScale = isIntegerScale ? lua_tointeger(pState, 2) : 0;
+#endif
+    int first, last;
+    if (CheckRange(pState, 1, 3, first, last))
+    {
+        for (int i = first; i <= last; ++i)
+        {
+            lua_rawgeti(pState, 1, i);                                      //  [..., value]
+#if BLEACHLUA_CORE_VERSION >= 53
+            if (isIntegerScale && lua_isinteger(pState, -1))
+            {
+                const lua_Integer value = lua_tointeger(pState, -1);
+                lua_pop(pState, 1);                                         //  [...]
+                lua_pushinteger(pState, WrappingMultiply(value, integerScale));  //  [..., scaled]
+                lua_rawseti(pState, 1, i);                                  //  [...]
+                continue;
+            }
+#endif
+            lua_pushnumber(pState, PopNumber(pState, i) * scale);           //  [..., scaled]
+            lua_rawseti(pState, 1, i);                                      //  [...]
+        }
+    }
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// bleach.array.lerp(a, b, alpha [, out]) -> out; out[i] = a[i] + (b[i] - a[i]) * alpha.  out may be a or b.
+static int ArrayLerp(lua_State* pState)
+{
+    luaL_checktype(pState, 1, LUA_TTABLE);
+    luaL_checktype(pState, 2, LUA_TTABLE);
+    const lua_Number alpha = luaL_checknumber(pState, 3);
+    const size_t length = Compat::RawLen(pState, 1);
+    luaL_argcheck(pState, Compat::RawLen(pState, 2) == length, 2, "array lengths don't match");
+
+    if (lua_isnoneornil(pState, 4))
+    {
+        lua_settop(pState, 3);
+        lua_createtable(pState, static_cast<int>(length), 0);               //  [a, b, alpha, out]
+    }
+    else
+    {
+        luaL_checktype(pState, 4, LUA_TTABLE);
+        lua_settop(pState, 4);                                              //  [a, b, alpha, out]
+    }
+
+    for (int i = 1; i <= static_cast<int>(length); ++i)
+    {
+        lua_rawgeti(pState, 1, i);                                          //  [a, b, alpha, out, a[i]]
+        const lua_Number from = PopNumber(pState, i);                       //  [a, b, alpha, out]
+        lua_rawgeti(pState, 2, i);                                          //  [a, b, alpha, out, b[i]]
+        const lua_Number to = PopNumber(pState, i);                         //  [a, b, alpha, out]
+        lua_pushnumber(pState, from + ((to - from) * alpha));               //  [a, b, alpha, out, result]
+        lua_rawseti(pState, 4, i);                                          //  [a, b, alpha, out]
+    }
+    return 1;
+}
+
+// bleach.array.find(t, value [, init]) -> index of the first element that's raw-equal to value, or nil
+static int ArrayFind(lua_State* pState)
+{
+    luaL_checktype(pState, 1, LUA_TTABLE);
+    luaL_checkany(pState, 2);
+    const int length = static_cast<int>(Compat::RawLen(pState, 1));
+    const lua_Integer init = luaL_optinteger(pState, 3, 1);
+    luaL_argcheck(pState, init >= 1, 3, "index out of range");
+
+    lua_settop(pState, 2);                                                  //  [t, value]
+    for (lua_Integer i = init; i <= length; ++i)
+    {
+        lua_rawgeti(pState, 1, static_cast<int>(i));                        //  [t, value, t[i]]
+        const bool found = lua_rawequal(pState, -1, 2) != 0;
+        lua_pop(pState, 1);                                                 //  [t, value]
+        if (found)
+        {
+            lua_pushinteger(pState, i);
+            return 1;
+        }
+    }
+    lua_pushnil(pState);
+    return 1;
+}
+
+// bleach.array.count_if_gt(t, threshold [, first [, last]]) -> number of elements greater than threshold
+static int ArrayCountIfGreater(lua_State* pState)
+{
+    luaL_checktype(pState, 1, LUA_TTABLE);
+    const lua_Number threshold = luaL_checknumber(pState, 2);
+    int first, last;
+    lua_Integer count = 0;
+    if (CheckRange(pState, 1, 3, first, last))
+    {
+        for (int i = first; i <= last; ++i)
+        {
+            lua_rawgeti(pState, 1, i);                                      //  [..., value]
+            count += (PopNumber(pState, i) > threshold) ? 1 : 0;            //  [...]
+        }
+    }
+    lua_pushinteger(pState, count);
+    return 1;
+}
+
+// bleach.sort_by(t, key [, "asc" | "desc"]) -> t
+static int ArraySortBy(lua_State* pState)
+{
+    static const char* const kOrders[] = { "asc", "desc", nullptr };
+
+    luaL_checktype(pState, 1, LUA_TTABLE);
+    luaL_checkany(pState, 2);
+    const LuaSortOrder order = (luaL_checkoption(pState, 3, "asc", kOrders) == 0) ? LuaSortOrder::kAscending : LuaSortOrder::kDescending;
+
+    const char* pError = nullptr;
+    if (!SortArrayBy(pState, 1, 2, order, &pError))
+        return luaL_error(pState, "sort_by: %s", pError);
+    lua_settop(pState, 1);
+    return 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Sorting
+//---------------------------------------------------------------------------------------------------------------------
+struct ArraySortKey
+{
+    lua_Number m_number;
+    const char* m_pString;  // owned by the element, which stays alive in the array for the whole sort
+    size_t m_length;
+    int m_index;  // the element's original (0-based) index; ties are broken by this, which makes the sort stable
+};
+
+static bool FailSort(const char* pError, const char** ppOutError)
+{
+    if (ppOutError)
+        *ppOutError = pError;
+    return false;
+}
+
+bool SortArrayBy(lua_State* pState, int tableIndex, int keyIndex, LuaSortOrder order, const char** ppOutError)
+{
+    LUA_ASSERT(pState);
+    LUA_ASSERT(tableIndex > 0 && keyIndex > 0);
+
+    // extract the keys
+    const int length = static_cast<int>(Compat::RawLen(pState, tableIndex));
+    luastl::vector<ArraySortKey> keys(static_cast<size_t>(length));
+    int keyType = LUA_TNONE;
+    for (int i = 0; i < length; ++i)
+    {
+        lua_rawgeti(pState, tableIndex, i + 1);                             //  [element]
+        if (!lua_istable(pState, -1))
+        {
+            lua_pop(pState, 1);                                             //  []
+            return FailSort("array element is not a table", ppOutError);
+        }
+
+        lua_pushvalue(pState, keyIndex);                                    //  [element, key]
+        lua_rawget(pState, -2);                                             //  [element, value]
+        const int type = lua_type(pState, -1);
+        keyType = (i == 0) ? type : keyType;
+        if (type != keyType || (type != LUA_TNUMBER && type != LUA_TSTRING))
+        {
+            lua_pop(pState, 2);                                             //  []
+            return FailSort("sort keys must be all numbers or all strings", ppOutError);
+        }
+
+        ArraySortKey& key = keys[i];
+        key.m_index = i;
+        if (type == LUA_TNUMBER)
+        {
+            key.m_number = lua_tonumber(pState, -1);
+            key.m_pString = nullptr;
+            key.m_length = 0;
+            if (key.m_number != key.m_number)
+            {
+                lua_pop(pState, 2);                                         //  []
+                return FailSort("sort key is NaN", ppOutError);
+            }
+        }
+        else
+        {
+            key.m_number = 0;
+            key.m_pString = lua_tolstring(pState, -1, &key.m_length);
+        }
+        lua_pop(pState, 2);                                                 //  []
+    }
+
+    // sort the keys
+    const bool descending = (order == LuaSortOrder::kDescending);
+    if (keyType == LUA_TNUMBER)
+    {
+        std::sort(keys.begin(), keys.end(), [descending](const ArraySortKey& left, const ArraySortKey& right)
+        {
+            if (left.m_number != right.m_number)
+                return descending ? (left.m_number > right.m_number) : (left.m_number < right.m_number);
+            return left.m_index < right.m_index;
+        });
+    }
+    else
+    {
+        std::sort(keys.begin(), keys.end(), [descending](const ArraySortKey& left, const ArraySortKey& right)
+        {
+            int result = memcmp(left.m_pString, right.m_pString, std::min(left.m_length, right.m_length));
+            if (result == 0)
+                result = (left.m_length < right.m_length) ? -1 : ((left.m_length > right.m_length) ? 1 : 0);
+            if (result != 0)
+                return descending ? (result > 0) : (result < 0);
+            return left.m_index < right.m_index;
+        });
+    }
+
+    // Move the elements into place by following each cycle of the permutation.  keys[dest].m_index is the element 
+    // that belongs at dest.  Only one element per cycle is ever off the table, so this needs no temporary table.
+    for (int start = 0; start < length; ++start)
+    {
+        if (keys[start].m_index < 0 || keys[start].m_index == start)
+            continue;
+
+        lua_rawgeti(pState, tableIndex, start + 1);                         //  [saved]
+        int dest = start;
+        for (;;)
+        {
+            const int source = keys[dest].m_index;
+            keys[dest].m_index = -1;
+            if (source == start)
+            {
+                lua_rawseti(pState, tableIndex, dest + 1);                  //  []
+                break;
+            }
+
+            lua_rawgeti(pState, tableIndex, source + 1);                    //  [saved, t[source]]
+            lua_rawseti(pState, tableIndex, dest + 1);                      //  [saved]
+            dest = source;
+        }
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Adds the bleach.array table and bleach.sort_by() to the BleachLua library table.
+//      -pState:    The Lua state.
+//---------------------------------------------------------------------------------------------------------------------
+void OpenArrayLib(LuaState* pState)
+{
+    static const luaL_Reg kFunctions[] =
+    {
+        { "sum", &ArraySum },
+        { "minmax", &ArrayMinMax },
+        { "scale", &ArrayScale },
+        { "lerp", &ArrayLerp },
+        { "find", &ArrayFind },
+        { "count_if_gt", &ArrayCountIfGreater },
+        { nullptr, nullptr }
+    };
+
+    LUA_ASSERT(pState);
+    LuaVar lib = pState->GetGlobals().GetOrCreateNewTable(BLEACHLUA_LIB_TABLE_NAME);
+    LuaVar arrayLib = lib.GetOrCreateNewTable("array");
+
+    lua_State* pLuaState = pState->GetState();
+    arrayLib.PushValueToStack();                                            //  [array]
+    for (const luaL_Reg* pFunc = kFunctions; pFunc->name; ++pFunc)
+    {
+        lua_pushcfunction(pLuaState, pFunc->func);                          //  [array, func]
+        lua_setfield(pLuaState, -2, pFunc->name);                           //  [array]
+    }
+    lua_pop(pLuaState, 1);                                                  //  []
+
+    lib.PushValueToStack();                                                 //  [lib]
+    lua_pushcfunction(pLuaState, &ArraySortBy);                             //  [lib, sort_by]
+    lua_setfield(pLuaState, -2, "sort_by");                                 //  [lib]
+    lua_pop(pLuaState, 1);                                                  //  []
+}
+
+}  // end namespace BleachLua
@@ -0,0 +1,376 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaConfigCache.h>
+#include <BleachLua/LuaState.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace BleachLua {
+
+static constexpr size_t kMinSlots = 64;
+
+// 0 marks an empty slot, so a path that happens to hash to 0 is moved to 1
+static LuaConfigCache::PathHash FixHash(LuaConfigCache::PathHash hash)
+{
+    return (hash != 0) ? hash : 1;
+}
+
+LuaConfigCache::LuaConfigCache(LuaState* pState)
+    : m_pState(pState)
+    , m_numPresent(0)
+    , m_buildId(0)
+    , m_version(0)
+{
+    LUA_ASSERT(pState);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Flattens a config tree into the cache, replacing whatever was built before.
+//      -root:      The root table.  Paths are relative to it, so its own name isn't part of them.
+//      -return:    The number of entries that were added, changed, or removed.
+//---------------------------------------------------------------------------------------------------------------------
+size_t LuaConfigCache::Build(const LuaVar& root)
+{
+    if (!root.IsTable())
+    {
+        LUA_ERROR("LuaConfigCache::Build() needs a table.  Type is " + root.GetTypeNameStr());
+        return 0;
+    }
+
+    ++m_buildId;
+    size_t numChanged = 0;
+
+    lua_State* pState = m_pState->GetState();
+    root.PushValueToStack();                                                //  [root]
+    luastl::string path;
+    FlattenTable(pState, lua_gettop(pState), path, kOffsetBasis, numChanged);
+    lua_pop(pState, 1);                                                     //  []
+
+    numChanged += RemoveStaleEntries("");
+    if (numChanged > 0)
+        ++m_version;
+    return numChanged;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Rebuilds one subtree, leaving the rest of the cache alone.  Use this when a reload only replaced part of the config.
+//      -path:      The path of the subtree, like "Enemies.Grunt".
+//      -subtree:   The new value at that path.  If it's nil, the subtree is removed.
+//      -return:    The number of entries that were added, changed, or removed.
+//---------------------------------------------------------------------------------------------------------------------
+size_t LuaConfigCache::RebuildSubtree(const char* path, const LuaVar& subtree)
+{
+    LUA_ASSERT(path && path[0]);
+
+    ++m_buildId;
+    size_t numChanged = 0;
+
+    if (!subtree.IsNil())
+    {
+        lua_State* pState = m_pState->GetState();
+        luastl::string pathStr(path);
+        const PathHash hash = HashPath(path);
+
+        subtree.PushValueToStack();                                         //  [subtree]
+        if (SetValueFromStack(pState, FindOrAddIndex(hash, pathStr)))
+            ++numChanged;
+        if (lua_istable(pState, -1))
+            FlattenTable(pState, lua_gettop(pState), pathStr, hash, numChanged);
+        lua_pop(pState, 1);                                                 //  []
+    }
+
+    numChanged += RemoveStaleEntries(path);
+    if (numChanged > 0)
+        ++m_version;
+    return numChanged;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Marks every entry as missing.  Handles stay valid and pick their values back up on the next build.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaConfigCache::Clear()
+{
+    for (Value& value : m_values)
+    {
+        value.m_type = ValueType::kMissing;
+        value.m_string.clear();
+        value.m_var.ClearRef();
+        value.m_pPointer = nullptr;
+    }
+    m_numPresent = 0;
+    ++m_version;
+}
+
+bool LuaConfigCache::Has(const char* path) const
+{
+    return GetType(path) != ValueType::kMissing;
+}
+
+LuaConfigCache::ValueType LuaConfigCache::GetType(const char* path) const
+{
+    const Value* pValue = FindValue(HashPath(path));
+    return pValue ? pValue->m_type : ValueType::kMissing;
+}
+
+const LuaConfigCache::Value* LuaConfigCache::FindValue(PathHash hash) const
+{
+    if (m_slots.empty())
+        return nullptr;
+
+    hash = FixHash(hash);
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = static_cast<size_t>(hash) & mask; m_slots[i].m_hash != 0; i = (i + 1) & mask)
+    {
+        if (m_slots[i].m_hash == hash)
+            return &m_values[m_slots[i].m_index];
+    }
+    return nullptr;
+}
+
+uint32_t LuaConfigCache::FindOrAddIndex(PathHash hash, const luastl::string& path)
+{
+    if ((m_values.size() + 1) * 4 > m_slots.size() * 3)
+        Grow();
+
+    hash = FixHash(hash);
+    const size_t mask = m_slots.size() - 1;
+    size_t i = static_cast<size_t>(hash) & mask;
+    for (; m_slots[i].m_hash != 0; i = (i + 1) & mask)
+    {
+        if (m_slots[i].m_hash == hash)
+        {
+            LUA_ASSERT_MSG(m_values[m_slots[i].m_index].m_path == path, "Config path hash collision between " + m_values[m_slots[i].m_index].m_path + " and " + path);
+            return m_slots[i].m_index;
+        }
+    }
+
+    const uint32_t index = static_cast<uint32_t>(m_values.size());
+    m_values.emplace_back();
+    m_values.back().m_path = path;
+    m_values.back().m_hash = hash;
+    m_slots[i].m_hash = hash;
+    m_slots[i].m_index = index;
+    return index;
+}
+
+void LuaConfigCache::Grow()
+{
+    const size_t newSize = std::max(kMinSlots, m_slots.size() * 2);
+    m_slots.assign(newSize, Slot{ 0, 0 });
+
+    const size_t mask = newSize - 1;
+    for (uint32_t index = 0; index < static_cast<uint32_t>(m_values.size()); ++index)
+    {
+        size_t i = static_cast<size_t>(m_values[index].m_hash) & mask;
+        while (m_slots[i].m_hash != 0)
+            i = (i + 1) & mask;
+        m_slots[i].m_hash = m_values[index].m_hash;
+        m_slots[i].m_index = index;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Adds an entry for every string and integer key of a table, and recurses into nested tables.  path and pathHash are 
+// the path of the table itself, and path is restored before this returns.  A table that contains one of its 
+// ancestors isn't followed back up.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaConfigCache::FlattenTable(lua_State* pState, int tableIndex, luastl::string& path, PathHash pathHash, size_t& numChanged)
+{
+    m_ancestors.push_back(lua_topointer(pState, tableIndex));
+    lua_checkstack(pState, 4);
+
+    lua_pushnil(pState);                                                    //  [nil]
+    while (lua_next(pState, tableIndex))                                    //  [key, value]
+    {
+        // format the key without lua_tostring() on numbers, which would confuse lua_next()
+        char numberKey[32];
+        const char* pKey = nullptr;
+        if (lua_type(pState, -2) == LUA_TSTRING)
+        {
+            pKey = lua_tostring(pState, -2);
+        }
+        else if (lua_type(pState, -2) == LUA_TNUMBER)
+        {
+            // converting a number outside of long long's range (like math.huge, or NaN) is undefined, so those 
+            // fail the range check and get no path; both bounds are exact powers of two
+            const lua_Number number = lua_tonumber(pState, -2);
+            constexpr lua_Number kLongLongLimit = 9223372036854775808.0;  // 2^63
+            const bool isInRange = (number >= -kLongLongLimit && number < kLongLongLimit);
+            const long long integer = isInRange ? static_cast<long long>(number) : 0;
+            if (isInRange && static_cast<lua_Number>(integer) == number)
+            {
+                snprintf(numberKey, sizeof(numberKey), "%lld", integer);
+                pKey = numberKey;
+            }
+        }
+
+        if (!pKey)  // other keys have no path
+        {
+            lua_pop(pState, 1);                                             //  [key]
+            continue;
+        }
+
+        const size_t parentLength = path.size();
+        PathHash childHash = pathHash;
+        if (parentLength > 0)
+        {
+            path += '.';
+            childHash = HashPath(".", childHash);
+        }
+        path += pKey;
+        childHash = HashPath(pKey, childHash);
+
+        if (SetValueFromStack(pState, FindOrAddIndex(childHash, path)))
+            ++numChanged;
+
+        if (lua_istable(pState, -1))
+        {
+            const void* pTable = lua_topointer(pState, -1);
+            if (std::find(m_ancestors.begin(), m_ancestors.end(), pTable) == m_ancestors.end())
+                FlattenTable(pState, lua_gettop(pState), path, childHash, numChanged);
+        }
+
+        path.resize(parentLength);
+        lua_pop(pState, 1);                                                 //  [key]
+    }
+
+    m_ancestors.pop_back();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Copies the value at the top of the stack into an entry and marks it as seen by this build.
+//      -return:    true if the value changed.  Nested tables only count as a change when they first appear, since a 
+//                  reload always creates new tables; their contents are diffed instead.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaConfigCache::SetValueFromStack(lua_State* pState, uint32_t index)
+{
+    Value& value = m_values[index];
+    value.m_buildId = m_buildId;
+
+    const ValueType oldType = value.m_type;
+    bool changed = false;
+    switch (lua_type(pState, -1))
+    {
+        case LUA_TNUMBER:
+        {
+            const lua_Number number = lua_tonumber(pState, -1);
+            int64_t integer = 0;
+#if BLEACHLUA_CORE_VERSION >= 53
+            if (lua_isinteger(pState, -1))
+                integer = static_cast<int64_t>(lua_tointeger(pState, -1));
+            else
+#endif
+            if (number > -9.2e18 && number < 9.2e18)
+                integer = static_cast<int64_t>(number);
+
+            changed = (oldType != ValueType::kNumber || value.m_number != number || value.m_integer != integer);
+            value.m_type = ValueType::kNumber;
+            value.m_number = number;
+            value.m_integer = integer;
+            break;
+        }
+
+        case LUA_TBOOLEAN:
+        {
+            const bool boolean = lua_toboolean(pState, -1) != 0;
+            changed = (oldType != ValueType::kBool || value.m_bool != boolean);
+            value.m_type = ValueType::kBool;
+            value.m_bool = boolean;
+            break;
+        }
+
+        case LUA_TSTRING:
+        {
+            size_t length = 0;
+            const char* str = lua_tolstring(pState, -1, &length);
+            changed = (oldType != ValueType::kString || value.m_string.size() != length || memcmp(value.m_string.data(), str, length) != 0);
+            value.m_type = ValueType::kString;
+            if (changed)
+                value.m_string.assign(str, length);
+            break;
+        }
+
+        default:
+        {
+            const void* pPointer = lua_topointer(pState, -1);
+            changed = lua_istable(pState, -1) ? (oldType != ValueType::kOther) : (oldType != ValueType::kOther || value.m_pPointer != pPointer);
+            if (value.m_pPointer != pPointer || oldType != ValueType::kOther)
+            {
+                lua_pushvalue(pState, -1);                                  //  [value, value]
+                value.m_var = LuaVar::CreateFromStack(m_pState);            //  [value]
+                value.m_pPointer = pPointer;
+            }
+            value.m_type = ValueType::kOther;
+            break;
+        }
+    }
+
+    // release what the old type was holding onto
+    if (oldType == ValueType::kString && value.m_type != ValueType::kString)
+        value.m_string.clear();
+    if (oldType == ValueType::kOther && value.m_type != ValueType::kOther)
+    {
+        value.m_var.ClearRef();
+        value.m_pPointer = nullptr;
+    }
+
+    if (oldType == ValueType::kMissing)
+        ++m_numPresent;
+    return changed;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Marks the entries under a prefix that the current build didn't see as missing.
+//      -prefix:    The path of the subtree that was rebuilt, or an empty string for everything.
+//      -return:    The number of entries that were removed.
+//---------------------------------------------------------------------------------------------------------------------
+size_t LuaConfigCache::RemoveStaleEntries(const char* prefix)
+{
+    const size_t prefixLength = strlen(prefix);
+    size_t numRemoved = 0;
+    for (Value& value : m_values)
+    {
+        if (value.m_type == ValueType::kMissing || value.m_buildId == m_buildId)
+            continue;
+
+        if (prefixLength > 0)
+        {
+            const bool inSubtree = value.m_path.compare(0, prefixLength, prefix) == 0 &&
+                (value.m_path.size() == prefixLength || value.m_path[prefixLength] == '.');
+            if (!inSubtree)
+                continue;
+        }
+
+        value.m_type = ValueType::kMissing;
+        value.m_string.clear();
+        value.m_var.ClearRef();
+        value.m_pPointer = nullptr;
+        --m_numPresent;
+        ++numRemoved;
+    }
+    return numRemoved;
+}
+
+}  // end namespace BleachLua
@@ -0,0 +1,1097 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaContainers.h>
+#include <BleachLua/LuaState.h>
+#include <BleachLua/LuaNoThrow.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <new>
+
+namespace BleachLua {
+
+static constexpr const char* kDequeMetatable = "BleachLua.Deque";
+static constexpr const char* kHeapMetatable = "BleachLua.Heap";
+static constexpr const char* kSortedMapMetatable = "BleachLua.SortedMap";
+static constexpr const char* kBitsetMetatable = "BleachLua.Bitset";
+
+// The deque's ring buffer is a Lua array, which is indexed with ints.  Capacities are powers of two, so this is the 
+// largest one that still fits.
+static constexpr size_t kMaxDequeCapacity = static_cast<size_t>(INT_MAX / 2) + 1;
+
+// Makes sure vec can take one more element without allocating, growing it geometrically.  Callers do this before 
+// touching any Lua state, so a failed allocation leaves the container exactly as it was.
+template <class Vector>
+static void ReserveOneMore(lua_State* pState, Vector& vec, const char* what)
+{
+    if (vec.size() < vec.capacity())
+        return;
+    CallNoThrow(pState, what, [&vec]() { vec.reserve((vec.capacity() < 8) ? 8 : vec.capacity() * 2); });
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Value storage
+// 
+// Every container except the bitset is created with an empty table as its user value.  The deque uses that table 
+// directly as its ring buffer.  The heap and sorted map store each value in a numbered slot and keep only the slot 
+// number in C++; released slots are reused so the table's array part never fills up with holes.
+//---------------------------------------------------------------------------------------------------------------------
+class ValueSlots
+{
+    luastl::vector<int> m_freeSlots;
+    int m_nextSlot = 1;
+
+public:
+    // Stores the value at the top of the stack in the user value of the container at containerIndex, pops it, and 
+    // returns its slot.
+    int Store(lua_State* pState, int containerIndex)
+    {
+        int slot;
+        if (!m_freeSlots.empty())
+        {
+            slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        }
+        else
+        {
+            // Keep room in the free list for every slot handed out, so Release() never allocates.
+            if (m_freeSlots.capacity() < static_cast<size_t>(m_nextSlot))
+                CallNoThrow(pState, "store", [this]() { m_freeSlots.reserve(static_cast<size_t>(m_nextSlot) * 2); });
+            slot = m_nextSlot++;
+        }
+                                                                            //  [value]
+        Compat::GetUserValue(pState, containerIndex);                       //  [value, values]
+        lua_insert(pState, -2);                                             //  [values, value]
+        lua_rawseti(pState, -2, slot);                                      //  [values]
+        lua_pop(pState, 1);                                                 //  []
+        return slot;
+    }
+
+    // Pushes the value in a slot.
+    static void Push(lua_State* pState, int containerIndex, int slot)
+    {
+        Compat::GetUserValue(pState, containerIndex);                       //  [values]
+        lua_rawgeti(pState, -1, slot);                                      //  [values, value]
+        lua_remove(pState, -2);                                             //  [value]
+    }
+
+    // Replaces the value in a slot with the value at the top of the stack and pops it.
+    static void Replace(lua_State* pState, int containerIndex, int slot)
+    {
+                                                                            //  [value]
+        Compat::GetUserValue(pState, containerIndex);                       //  [value, values]
+        lua_insert(pState, -2);                                             //  [values, value]
+        lua_rawseti(pState, -2, slot);                                      //  [values]
+        lua_pop(pState, 1);                                                 //  []
+    }
+
+    // Clears a slot so the value can be collected and makes the slot available again.
+    void Release(lua_State* pState, int containerIndex, int slot)
+    {
+        lua_pushnil(pState);                                                //  [nil]
+        Replace(pState, containerIndex, slot);                              //  []
+        m_freeSlots.push_back(slot);
+    }
+
+    // Releases every slot at once by replacing the storage table.
+    void Clear(lua_State* pState, int containerIndex)
+    {
+        lua_newtable(pState);                                               //  [values]
+        Compat::SetUserValue(pState, containerIndex);                       //  []
+        m_freeSlots.clear();
+        m_nextSlot = 1;
+    }
+};
+
+// The userdata's memory for a container.  __gc destroys the C++ object but the block can outlive it (a finalizer can 
+// resurrect the userdata), so the block remembers whether the container is still alive.
+template <class Type>
+struct ContainerBlock
+{
+    alignas(Type) unsigned char m_storage[sizeof(Type)];
+    bool m_isAlive;
+
+    Type* Get() { return reinterpret_cast<Type*>(m_storage); }
+};
+
+// Pushes a new container of the given type, constructed with args, with an empty value table presized to arraySize.
+template <class Type, class... Args>
+static Type* PushNewContainer(lua_State* pState, const char* pMetatable, int arraySize, Args&&... args)
+{
+    auto* pBlock = static_cast<ContainerBlock<Type>*>(Compat::NewUserData(pState, sizeof(ContainerBlock<Type>), 1));  //  [container]
+    Type* pContainer = new (pBlock->m_storage) Type(std::forward<Args>(args)...);
+    pBlock->m_isAlive = true;
+    lua_createtable(pState, arraySize, 0);                                  //  [container, values]
+    Compat::SetUserValue(pState, -2);                                       //  [container]
+    luaL_getmetatable(pState, pMetatable);                                  //  [container, mt]
+    lua_setmetatable(pState, -2);                                           //  [container]
+    return pContainer;
+}
+
+// Returns the container at stackIndex, raising an error if it's the wrong type or has been destroyed.
+template <class Type>
+static Type* CheckContainer(lua_State* pState, int stackIndex, const char* pMetatable)
+{
+    auto* pBlock = static_cast<ContainerBlock<Type>*>(luaL_checkudata(pState, stackIndex, pMetatable));
+    if (!pBlock->m_isAlive)
+        luaL_error(pState, "attempt to use a destroyed container");
+    return pBlock->Get();
+}
+
+// __gc for containers that own C++ memory.  Calling it again does nothing.
+template <class Type>
+static int DestroyContainer(lua_State* pState, const char* pMetatable)
+{
+    auto* pBlock = static_cast<ContainerBlock<Type>*>(luaL_checkudata(pState, 1, pMetatable));
+    if (pBlock->m_isAlive)
+    {
+        pBlock->m_isAlive = false;
+        pBlock->Get()->~Type();
+    }
+    return 0;
+}
+
+static void CheckNotNil(lua_State* pState, int stackIndex)
+{
+    luaL_checkany(pState, stackIndex);
+    luaL_argcheck(pState, !lua_isnil(pState, stackIndex), stackIndex, "containers can't store nil");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Deque
+// 
+// A ring buffer over the value table.  The capacity is always a power of two, so wrapping is a mask.
+//---------------------------------------------------------------------------------------------------------------------
+struct DequeData
+{
+    size_t m_head = 0;
+    size_t m_count = 0;
+    size_t m_capacity;
+
+    explicit DequeData(size_t capacity) : m_capacity(capacity) { }
+
+    // returns the 1-based slot in the value table for the element at the 0-based position
+    int GetSlot(size_t position) const { return static_cast<int>(((m_head + position) & (m_capacity - 1)) + 1); }
+};
+
+static DequeData* CheckDeque(lua_State* pState)
+{
+    return CheckContainer<DequeData>(pState, 1, kDequeMetatable);
+}
+
+// Makes room for one more element by moving the elements, in order, to the front of a table twice the size.
+static void GrowDequeIfFull(lua_State* pState, DequeData* pDeque)
+{
+    if (pDeque->m_count < pDeque->m_capacity)
+        return;
+    if (pDeque->m_capacity >= kMaxDequeCapacity)
+        luaL_error(pState, "deque is full");
+
+    const size_t newCapacity = pDeque->m_capacity * 2;
+    Compat::GetUserValue(pState, 1);                                        //  [old]
+    lua_createtable(pState, static_cast<int>(newCapacity), 0);              //  [old, new]
+    for (size_t i = 0; i < pDeque->m_count; ++i)
+    {
+        lua_rawgeti(pState, -2, pDeque->GetSlot(i));                        //  [old, new, value]
+        lua_rawseti(pState, -2, static_cast<int>(i + 1));                   //  [old, new]
+    }
+    Compat::SetUserValue(pState, 1);                                        //  [old]
+    lua_pop(pState, 1);                                                     //  []
+
+    pDeque->m_head = 0;
+    pDeque->m_capacity = newCapacity;
+}
+
+// Pushes the element at position and optionally clears its slot.
+static void PushDequeElement(lua_State* pState, const DequeData* pDeque, size_t position, bool remove)
+{
+    Compat::GetUserValue(pState, 1);                                        //  [values]
+    lua_rawgeti(pState, -1, pDeque->GetSlot(position));                     //  [values, value]
+    if (remove)
+    {
+        lua_pushnil(pState);                                                //  [values, value, nil]
+        lua_rawseti(pState, -3, pDeque->GetSlot(position));                 //  [values, value]
+    }
+    lua_remove(pState, -2);                                                 //  [value]
+}
+
+// deque:push_back(value)
+static int DequePushBack(lua_State* pState)
+{
+    DequeData* pDeque = CheckDeque(pState);
+    CheckNotNil(pState, 2);
+    GrowDequeIfFull(pState, pDeque);
+
+    Compat::GetUserValue(pState, 1);                                        //  [deque, value, values]
+    lua_pushvalue(pState, 2);                                               //  [deque, value, values, value]
+    lua_rawseti(pState, -2, pDeque->GetSlot(pDeque->m_count));              //  [deque, value, values]
+    ++pDeque->m_count;
+    return 0;
+}
+
+// deque:push_front(value)
+static int DequePushFront(lua_State* pState)
+{
+    DequeData* pDeque = CheckDeque(pState);
+    CheckNotNil(pState, 2);
+    GrowDequeIfFull(pState, pDeque);
+
+    pDeque->m_head = (pDeque->m_head + pDeque->m_capacity - 1) & (pDeque->m_capacity - 1);
+    ++pDeque->m_count;
+    Compat::GetUserValue(pState, 1);                                        //  [deque, value, values]
+    lua_pushvalue(pState, 2);                                               //  [deque, value, values, value]
+    lua_rawseti(pState, -2, pDeque->GetSlot(0));                            //  [deque, value, values]
+    return 0;
+}
+
+// deque:pop_back() -> value, or nil if empty
+static int DequePopBack(lua_State* pState)
+{
+    DequeData* pDeque = CheckDeque(pState);
+    if (pDeque->m_count == 0)
+        return 0;
+
+    PushDequeElement(pState, pDeque, pDeque->m_count - 1, true);
+    --pDeque->m_count;
+    return 1;
+}
+
+// deque:pop_front() -> value, or nil if empty
+static int DequePopFront(lua_State* pState)
+{
+    DequeData* pDeque = CheckDeque(pState);
+    if (pDeque->m_count == 0)
+        return 0;
+
+    PushDequeElement(pState, pDeque, 0, true);
+    pDeque->m_head = (pDeque->m_head + 1) & (pDeque->m_capacity - 1);
+    --pDeque->m_count;
+    return 1;
+}
+
+// deque:front() -> value, or nil if empty
+static int DequeFront(lua_State* pState)
+{
+    const DequeData* pDeque = CheckDeque(pState);
+    if (pDeque->m_count == 0)
+        return 0;
+
+    PushDequeElement(pState, pDeque, 0, false);
+    return 1;
+}
+
+// deque:back() -> value, or nil if empty
+static int DequeBack(lua_State* pState)
+{
+    const DequeData* pDeque = CheckDeque(pState);
+    if (pDeque->m_count == 0)
+        return 0;
+
+    PushDequeElement(pState, pDeque, pDeque->m_count - 1, false);
+    return 1;
+}
+
+// deque:get(index) -> value, or nil if out of range; 1 is the front
+static int DequeGet(lua_State* pState)
+{
+    const DequeData* pDeque = CheckDeque(pState);
+    const lua_Integer index = luaL_checkinteger(pState, 2);
+    if (index < 1 || static_cast<size_t>(index) > pDeque->m_count)
+        return 0;
+
+    PushDequeElement(pState, pDeque, static_cast<size_t>(index - 1), false);
+    return 1;
+}
+
+// deque:clear()
+static int DequeClear(lua_State* pState)
+{
+    DequeData* pDeque = CheckDeque(pState);
+    lua_createtable(pState, static_cast<int>(pDeque->m_capacity), 0);      //  [deque, values]
+    Compat::SetUserValue(pState, 1);                                        //  [deque]
+    pDeque->m_head = 0;
+    pDeque->m_count = 0;
+    return 0;
+}
+
+// __len(deque)
+static int DequeLen(lua_State* pState)
+{
+    lua_pushinteger(pState, static_cast<lua_Integer>(CheckDeque(pState)->m_count));
+    return 1;
+}
+
+// bleach.Deque([capacity])
+static int DequeNew(lua_State* pState)
+{
+    const lua_Integer requested = luaL_optinteger(pState, 1, 16);
+    luaL_argcheck(pState, requested >= 0, 1, "capacity must not be negative");
+    luaL_argcheck(pState, requested <= static_cast<lua_Integer>(kMaxDequeCapacity), 1, "capacity is too large");
+
+    size_t capacity = 4;
+    while (capacity < static_cast<size_t>(requested))
+        capacity *= 2;
+
+    PushNewContainer<DequeData>(pState, kDequeMetatable, static_cast<int>(capacity), capacity);
+    return 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Heap
+// 
+// A binary heap of (priority, slot) entries.  Ties are broken by insertion order, so equal priorities come out 
+// first-in, first-out.
+//---------------------------------------------------------------------------------------------------------------------
+class HeapData
+{
+public:
+    struct Entry
+    {
+        lua_Number m_priority;
+        uint64_t m_order;
+        int m_slot;
+    };
+
+    luastl::vector<Entry> m_entries;
+    ValueSlots m_slots;
+    uint64_t m_nextOrder = 0;
+    bool m_isMaxHeap;
+
+    explicit HeapData(bool isMaxHeap) : m_isMaxHeap(isMaxHeap) { }
+
+    // The std heap functions keep the "largest" element on top, so this returns true if right should pop first.
+    auto GetComparator() const
+    {
+        return [isMaxHeap = m_isMaxHeap](const Entry& left, const Entry& right)
+        {
+            if (left.m_priority != right.m_priority)
+                return isMaxHeap ? (left.m_priority < right.m_priority) : (left.m_priority > right.m_priority);
+            return left.m_order > right.m_order;
+        };
+    }
+};
+
+static HeapData* CheckHeap(lua_State* pState)
+{
+    return CheckContainer<HeapData>(pState, 1, kHeapMetatable);
+}
+
+// __gc(heap)
+static int HeapGc(lua_State* pState)
+{
+    return DestroyContainer<HeapData>(pState, kHeapMetatable);
+}
+
+// heap:push(value, priority)
+static int HeapPush(lua_State* pState)
+{
+    HeapData* pHeap = CheckHeap(pState);
+    CheckNotNil(pState, 2);
+    const lua_Number priority = luaL_checknumber(pState, 3);
+    luaL_argcheck(pState, priority == priority, 3, "priority is NaN");
+
+    ReserveOneMore(pState, pHeap->m_entries, "push");
+    lua_settop(pState, 2);                                                  //  [heap, value]
+    const int slot = pHeap->m_slots.Store(pState, 1);                       //  [heap]
+    pHeap->m_entries.push_back(HeapData::Entry{ priority, pHeap->m_nextOrder++, slot });
+    std::push_heap(pHeap->m_entries.begin(), pHeap->m_entries.end(), pHeap->GetComparator());
+    return 0;
+}
+
+// heap:pop() -> value, priority (or nil if empty)
+static int HeapPop(lua_State* pState)
+{
+    HeapData* pHeap = CheckHeap(pState);
+    if (pHeap->m_entries.empty())
+        return 0;
+
+    std::pop_heap(pHeap->m_entries.begin(), pHeap->m_entries.end(), pHeap->GetComparator());
+    const HeapData::Entry top = pHeap->m_entries.back();
+    pHeap->m_entries.pop_back();
+
+    ValueSlots::Push(pState, 1, top.m_slot);                                //  [heap, value]
+    pHeap->m_slots.Release(pState, 1, top.m_slot);
+    lua_pushnumber(pState, top.m_priority);                                 //  [heap, value, priority]
+    return 2;
+}
+
+// heap:peek() -> value, priority (or nil if empty)
+static int HeapPeek(lua_State* pState)
+{
+    const HeapData* pHeap = CheckHeap(pState);
+    if (pHeap->m_entries.empty())
+        return 0;
+
+    const HeapData::Entry& top = pHeap->m_entries.front();
+    ValueSlots::Push(pState, 1, top.m_slot);                                //  [heap, value]
+    lua_pushnumber(pState, top.m_priority);                                 //  [heap, value, priority]
+    return 2;
+}
+
+// heap:clear()
+static int HeapClear(lua_State* pState)
+{
+    HeapData* pHeap = CheckHeap(pState);
+    pHeap->m_entries.clear();
+    pHeap->m_slots.Clear(pState, 1);
+    return 0;
+}
+
+// __len(heap)
+static int HeapLen(lua_State* pState)
+{
+    lua_pushinteger(pState, static_cast<lua_Integer>(CheckHeap(pState)->m_entries.size()));
+    return 1;
+}
+
+// bleach.Heap(["min" | "max"])
+static int HeapNew(lua_State* pState)
+{
+    static const char* const kKinds[] = { "min", "max", nullptr };
+    const bool isMaxHeap = (luaL_checkoption(pState, 1, "min", kKinds) == 1);
+    PushNewContainer<HeapData>(pState, kHeapMetatable, 0, isMaxHeap);
+    return 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Sorted map
+// 
+// A flat map: the entries live in one sorted vector, so lookups are a binary search over contiguous memory and 
+// in-order iteration is a linear walk.  Inserting and removing shift the entries after the position, which is cheap 
+// for the few thousand entries scripts typically keep.  Numbers sort before strings; strings compare byte-wise.  On 
+// Lua 5.3+, integer keys are kept as integers so they stay exact past 2^53, and a float with an integer value is the 
+// same key as that integer, just like in a table.
+//---------------------------------------------------------------------------------------------------------------------
+struct MapKeyView
+{
+    const char* m_pString;  // nullptr for numbers
+    size_t m_length;
+    lua_Number m_number;  // for numbers that aren't integers
+    lua_Integer m_integer;
+    bool m_isInteger;
+};
+
+// -lua_Integer's minimum, which is a power of two, so it's exact as a float
+static const lua_Number kIntegerLimit = -static_cast<lua_Number>(std::numeric_limits<lua_Integer>::min());
+
+// Compares an integer with a float that has no integer value (or is out of range) without rounding either of them.
+static int CompareIntegerToNumber(lua_Integer integer, lua_Number number)
+{
+    if (number >= kIntegerLimit)
+        return -1;
+    if (number < -kIntegerLimit)
+        return 1;
+
+    const lua_Number floored = std::floor(number);
+    const lua_Integer flooredInteger = static_cast<lua_Integer>(floored);
+    if (integer != flooredInteger)
+        return (integer < flooredInteger) ? -1 : 1;
+    return (number > floored) ? -1 : 0;
+}
+
+static int CompareMapKeys(const MapKeyView& left, const MapKeyView& right)
+{
+    if (!left.m_pString || !right.m_pString)
+    {
+        if (left.m_pString || right.m_pString)
+            return left.m_pString ? 1 : -1;
+        if (left.m_isInteger && right.m_isInteger)
+            return (left.m_integer < right.m_integer) ? -1 : ((left.m_integer > right.m_integer) ? 1 : 0);
+        if (left.m_isInteger)
+            return CompareIntegerToNumber(left.m_integer, right.m_number);
+        if (right.m_isInteger)
+            return -CompareIntegerToNumber(right.m_integer, left.m_number);
+        return (left.m_number < right.m_number) ? -1 : ((left.m_number > right.m_number) ? 1 : 0);
+    }
+
+    const int result = memcmp(left.m_pString, right.m_pString, std::min(left.m_length, right.m_length));
+    if (result != 0)
+        return result;
+    return (left.m_length < right.m_length) ? -1 : ((left.m_length > right.m_length) ? 1 : 0);
+}
+
+class SortedMapData
+{
+public:
+    struct Entry
+    {
+        luastl::string m_string;
+        lua_Number m_number;
+        lua_Integer m_integer;
+        bool m_isString;
+        bool m_isInteger;  // only on Lua 5.3+
+        int m_slot;
+
+        MapKeyView GetView() const { return MapKeyView{ m_isString ? m_string.c_str() : nullptr, m_string.size(), m_number, m_integer, m_isInteger }; }
+    };
+
+    luastl::vector<Entry> m_entries;
+    ValueSlots m_slots;
+
+    // Returns the position of the first entry that isn't less than key.
+    size_t LowerBound(const MapKeyView& key) const
+    {
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), key, [](const Entry& entry, const MapKeyView& key)
+        {
+            return CompareMapKeys(entry.GetView(), key) < 0;
+        });
+        return static_cast<size_t>(it - m_entries.begin());
+    }
+
+    bool IsMatch(size_t position, const MapKeyView& key) const
+    {
+        return position < m_entries.size() && CompareMapKeys(m_entries[position].GetView(), key) == 0;
+    }
+};
+
+static SortedMapData* CheckSortedMap(lua_State* pState)
+{
+    return CheckContainer<SortedMapData>(pState, 1, kSortedMapMetatable);
+}
+
+// __gc(map)
+static int SortedMapGc(lua_State* pState)
+{
+    return DestroyContainer<SortedMapData>(pState, kSortedMapMetatable);
+}
+
+static MapKeyView CheckMapKey(lua_State* pState, int stackIndex)
+{
+    MapKeyView key = { nullptr, 0, 0, 0, false };
+    switch (lua_type(pState, stackIndex))
+    {
+        case LUA_TNUMBER:
+        {
+#if BLEACHLUA_CORE_VERSION >= 53
+            if (lua_isinteger(pState, stackIndex))
+            {
+                key.m_integer = lua_tointeger(pState, stackIndex);
+                key.m_isInteger = true;
+                break;
+            }
+#endif
+            key.m_number = lua_tonumber(pState, stackIndex);
+            luaL_argcheck(pState, key.m_number == key.m_number, stackIndex, "key is NaN");
+#if BLEACHLUA_CORE_VERSION >= 53
+            if (key.m_number >= -kIntegerLimit && key.m_number < kIntegerLimit && std::floor(key.m_number) == key.m_number)
+            {
+                key.m_integer = static_cast<lua_Integer>(key.m_number);
+                key.m_isInteger = true;
+            }
+#endif
+            break;
+        }
+
+        case LUA_TSTRING:
+            key.m_pString = lua_tolstring(pState, stackIndex, &key.m_length);
+            break;
+
+        default:
+            luaL_argerror(pState, stackIndex, "number or string key expected");
+    }
+    return key;
+}
+
+static void PushMapKey(lua_State* pState, const SortedMapData::Entry& entry)
+{
+    if (entry.m_isString)
+        lua_pushlstring(pState, entry.m_string.data(), entry.m_string.size());
+    else if (entry.m_isInteger)
+        lua_pushinteger(pState, entry.m_integer);
+    else
+        lua_pushnumber(pState, entry.m_number);
+}
+
+// Pushes the value for an entry and removes the entry.
+static void RemoveMapEntry(lua_State* pState, SortedMapData* pMap, size_t position)
+{
+    const int slot = pMap->m_entries[position].m_slot;
+    ValueSlots::Push(pState, 1, slot);                                      //  [value]
+    pMap->m_slots.Release(pState, 1, slot);
+    pMap->m_entries.erase(pMap->m_entries.begin() + position);
+}
+
+// map:remove(key) -> removed value, or nil
+static int SortedMapRemove(lua_State* pState)
+{
+    SortedMapData* pMap = CheckSortedMap(pState);
+    const MapKeyView key = CheckMapKey(pState, 2);
+    const size_t position = pMap->LowerBound(key);
+    if (!pMap->IsMatch(position, key))
+        return 0;
+
+    RemoveMapEntry(pState, pMap, position);
+    return 1;
+}
+
+// map:set(key, value); a nil value removes the key
+static int SortedMapSet(lua_State* pState)
+{
+    SortedMapData* pMap = CheckSortedMap(pState);
+    const MapKeyView key = CheckMapKey(pState, 2);
+    luaL_checkany(pState, 3);
+    lua_settop(pState, 3);                                                  //  [map, key, value]
+    const size_t position = pMap->LowerBound(key);
+    if (lua_isnil(pState, 3))
+    {
+        if (pMap->IsMatch(position, key))
+            RemoveMapEntry(pState, pMap, position);
+        return 0;
+    }
+
+    if (pMap->IsMatch(position, key))
+    {
+        ValueSlots::Replace(pState, 1, pMap->m_entries[position].m_slot);   //  [map, key]
+        return 0;
+    }
+
+    ReserveOneMore(pState, pMap->m_entries, "set");
+    SortedMapData::Entry entry;
+    entry.m_isString = (key.m_pString != nullptr);
+    if (entry.m_isString)
+        CallNoThrow(pState, "set", [&]() { entry.m_string.assign(key.m_pString, key.m_length); });
+    entry.m_number = key.m_number;
+    entry.m_integer = key.m_integer;
+    entry.m_isInteger = key.m_isInteger;
+    entry.m_slot = pMap->m_slots.Store(pState, 1);                          //  [map, key]
+    pMap->m_entries.insert(pMap->m_entries.begin() + position, std::move(entry));
+    return 0;
+}
+
+// map:get(key) -> value, or nil
+static int SortedMapGet(lua_State* pState)
+{
+    const SortedMapData* pMap = CheckSortedMap(pState);
+    const MapKeyView key = CheckMapKey(pState, 2);
+    const size_t position = pMap->LowerBound(key);
+    if (!pMap->IsMatch(position, key))
+        return 0;
+
+    ValueSlots::Push(pState, 1, pMap->m_entries[position].m_slot);
+    return 1;
+}
+
+// map:has(key) -> bool
+static int SortedMapHas(lua_State* pState)
+{
+    const SortedMapData* pMap = CheckSortedMap(pState);
+    const MapKeyView key = CheckMapKey(pState, 2);
+    lua_pushboolean(pState, pMap->IsMatch(pMap->LowerBound(key), key));
+    return 1;
+}
+
+// Pushes the key and value at position.
+static int PushMapEntry(lua_State* pState, const SortedMapData* pMap, size_t position)
+{
+    const SortedMapData::Entry& entry = pMap->m_entries[position];
+    PushMapKey(pState, entry);
+    ValueSlots::Push(pState, 1, entry.m_slot);
+    return 2;
+}
+
+// map:min() -> key, value (or nil if empty)
+static int SortedMapMin(lua_State* pState)
+{
+    const SortedMapData* pMap = CheckSortedMap(pState);
+    return pMap->m_entries.empty() ? 0 : PushMapEntry(pState, pMap, 0);
+}
+
+// map:max() -> key, value (or nil if empty)
+static int SortedMapMax(lua_State* pState)
+{
+    const SortedMapData* pMap = CheckSortedMap(pState);
+    return pMap->m_entries.empty() ? 0 : PushMapEntry(pState, pMap, pMap->m_entries.size() - 1);
+}
+
+// The iterator returned by map:pairs().  Upvalues: map, next position, last key (or nil).
+static int SortedMapIterate(lua_State* pState)
+{
+    lua_settop(pState, 0);
+    lua_pushvalue(pState, lua_upvalueindex(1));                             //  [map]
+    const SortedMapData* pMap = CheckSortedMap(pState);
+    const size_t position = static_cast<size_t>(lua_tointeger(pState, lua_upvalueindex(2)));
+    if (position >= pMap->m_entries.size())
+        return 0;
+
+    if (!lua_isnil(pState, lua_upvalueindex(3)) && CompareMapKeys(pMap->m_entries[position].GetView(), CheckMapKey(pState, lua_upvalueindex(3))) > 0)
+        return 0;
+
+    lua_pushinteger(pState, static_cast<lua_Integer>(position + 1));        //  [map, next]
+    lua_replace(pState, lua_upvalueindex(2));                               //  [map]
+    return PushMapEntry(pState, pMap, position);                            //  [map, key, value]
+}
+
+// map:pairs([first [, last]]) -> iterator over the keys in [first, last], in order.  Don't add or remove keys while 
+// iterating; setting existing keys is fine.
+static int SortedMapPairs(lua_State* pState)
+{
+    const SortedMapData* pMap = CheckSortedMap(pState);
+    const size_t start = lua_isnoneornil(pState, 2) ? 0 : pMap->LowerBound(CheckMapKey(pState, 2));
+    if (!lua_isnoneornil(pState, 3))
+        CheckMapKey(pState, 3);
+
+    lua_settop(pState, 3);                                                  //  [map, first, last]
+    lua_pushvalue(pState, 1);                                               //  [map, first, last, map]
+    lua_pushinteger(pState, static_cast<lua_Integer>(start));               //  [map, first, last, map, start]
+    lua_pushvalue(pState, 3);                                               //  [map, first, last, map, start, last]
+    lua_pushcclosure(pState, &SortedMapIterate, 3);                         //  [map, first, last, iterator]
+    return 1;
+}
+
+// map:clear()
+static int SortedMapClear(lua_State* pState)
+{
+    SortedMapData* pMap = CheckSortedMap(pState);
+    pMap->m_entries.clear();
+    pMap->m_slots.Clear(pState, 1);
+    return 0;
+}
+
+// __len(map)
+static int SortedMapLen(lua_State* pState)
+{
+    lua_pushinteger(pState, static_cast<lua_Integer>(CheckSortedMap(pState)->m_entries.size()));
+    return 1;
+}
+
+// bleach.SortedMap()
+static int SortedMapNew(lua_State* pState)
+{
+    PushNewContainer<SortedMapData>(pState, kSortedMapMetatable, 0);
+    return 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Bitset
+//---------------------------------------------------------------------------------------------------------------------
+static size_t CountBits(uint64_t word)
+{
+    word = word - ((word >> 1) & 0x5555555555555555ull);
+    word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+    word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return static_cast<size_t>((word * 0x0101010101010101ull) >> 56);
+}
+
+void LuaBitset::Set(size_t index, bool value)
+{
+    LUA_ASSERT(index < m_size);
+    const uint64_t mask = uint64_t(1) << (index % kBitsPerWord);
+    uint64_t& word = GetWords()[index / kBitsPerWord];
+    word = value ? (word | mask) : (word & ~mask);
+}
+
+void LuaBitset::SetAll(bool value)
+{
+    const size_t numWords = GetNumWords();
+    memset(GetWords(), value ? 0xff : 0, numWords * sizeof(uint64_t));
+
+    // keep the bits past the end cleared so Count() and FindNextSet() don't have to mask
+    const size_t usedBits = m_size % kBitsPerWord;
+    if (value && usedBits != 0)
+        GetWords()[numWords - 1] &= (uint64_t(1) << usedBits) - 1;
+}
+
+size_t LuaBitset::Count() const
+{
+    size_t count = 0;
+    const uint64_t* pWords = GetWords();
+    for (size_t i = 0; i < GetNumWords(); ++i)
+        count += CountBits(pWords[i]);
+    return count;
+}
+
+size_t LuaBitset::FindNextSet(size_t index) const
+{
+    if (index >= m_size)
+        return m_size;
+
+    const uint64_t* pWords = GetWords();
+    size_t wordIndex = index / kBitsPerWord;
+    uint64_t word = pWords[wordIndex] & (~uint64_t(0) << (index % kBitsPerWord));
+    while (word == 0)
+    {
+        if (++wordIndex >= GetNumWords())
+            return m_size;
+        word = pWords[wordIndex];
+    }
+
+    // the number of trailing zeroes is the number of bits below the lowest set bit
+    const uint64_t lowestBit = word & (~word + 1);
+    return (wordIndex * kBitsPerWord) + CountBits(lowestBit - 1);
+}
+
+LuaBitset* LuaBitset::PushNew(lua_State* pState, size_t size)
+{
+    const size_t numWords = (size + kBitsPerWord - 1) / kBitsPerWord;
+    void* pBlock = Compat::NewUserData(pState, kHeaderSize + (numWords * sizeof(uint64_t)));   //  [bitset]
+    LuaBitset* pBitset = new (pBlock) LuaBitset(size);
+    memset(pBitset->GetWords(), 0, numWords * sizeof(uint64_t));
+
+    luaL_getmetatable(pState, kBitsetMetatable);                                              //  [bitset, mt?]
+    LUA_ASSERT_MSG(lua_istable(pState, -1), "OpenContainerLib() must be called before creating bitsets.");
+    lua_setmetatable(pState, -2);                                                               //  [bitset]
+    return pBitset;
+}
+
+LuaVar LuaBitset::Create(LuaState* pState, size_t size)
+{
+    LUA_ASSERT(pState);
+    PushNew(pState->GetState(), size);
+    return LuaVar::CreateFromStack(pState);
+}
+
+LuaBitset* LuaBitset::FromStack(lua_State* pState, int stackIndex)
+{
+    return static_cast<LuaBitset*>(luaL_testudata(pState, stackIndex, kBitsetMetatable));
+}
+
+LuaBitset* LuaBitset::FromVar(const LuaVar& var)
+{
+    if (!var.PushValueToStack(false))                                       //  [var]
+        return nullptr;
+
+    lua_State* pState = var.GetLuaState()->GetState();
+    LuaBitset* pBitset = FromStack(pState, -1);
+    lua_pop(pState, 1);                                                     //  []
+    return pBitset;  // the memory is owned by the userdata, which var keeps alive
+}
+
+static LuaBitset* CheckBitset(lua_State* pState)
+{
+    return static_cast<LuaBitset*>(luaL_checkudata(pState, 1, kBitsetMetatable));
+}
+
+// Checks a 1-based bit index argument and returns it 0-based.
+static size_t CheckBitIndex(lua_State* pState, const LuaBitset* pBitset, int stackIndex)
+{
+    const lua_Integer index = luaL_checkinteger(pState, stackIndex);
+    luaL_argcheck(pState, index >= 1 && static_cast<size_t>(index) <= pBitset->GetSize(), stackIndex, "index out of range");
+    return static_cast<size_t>(index - 1);
+}
+
+// bitset:set(index [, value]); value defaults to true
+static int BitsetSet(lua_State* pState)
+{
+    LuaBitset* pBitset = CheckBitset(pState);
+    const size_t index = CheckBitIndex(pState, pBitset, 2);
+    pBitset->Set(index, lua_isnoneornil(pState, 3) || lua_toboolean(pState, 3));
+    return 0;
+}
+
+// bitset:reset(index)
+static int BitsetReset(lua_State* pState)
+{
+    LuaBitset* pBitset = CheckBitset(pState);
+    pBitset->Reset(CheckBitIndex(pState, pBitset, 2));
+    return 0;
+}
+
+// bitset:toggle(index)
+static int BitsetToggle(lua_State* pState)
+{
+    LuaBitset* pBitset = CheckBitset(pState);
+    pBitset->Toggle(CheckBitIndex(pState, pBitset, 2));
+    return 0;
+}
+
+// bitset:test(index) -> bool
+static int BitsetTest(lua_State* pState)
+{
+    const LuaBitset* pBitset = CheckBitset(pState);
+    lua_pushboolean(pState, pBitset->Test(CheckBitIndex(pState, pBitset, 2)));
+    return 1;
+}
+
+// bitset:set_all([value]); value defaults to true
+static int BitsetSetAll(lua_State* pState)
+{
+    CheckBitset(pState)->SetAll(lua_isnoneornil(pState, 2) || lua_toboolean(pState, 2));
+    return 0;
+}
+
+// bitset:clear()
+static int BitsetClear(lua_State* pState)
+{
+    CheckBitset(pState)->SetAll(false);
+    return 0;
+}
+
+// bitset:count() -> number of set bits
+static int BitsetCount(lua_State* pState)
+{
+    lua_pushinteger(pState, static_cast<lua_Integer>(CheckBitset(pState)->Count()));
+    return 1;
+}
+
+// bitset:next_set([index]) -> the first set bit at or after index (default 1), or nil
+static int BitsetNextSet(lua_State* pState)
+{
+    const LuaBitset* pBitset = CheckBitset(pState);
+    const lua_Integer start = luaL_optinteger(pState, 2, 1);
+    luaL_argcheck(pState, start >= 1, 2, "index out of range");
+
+    const size_t found = pBitset->FindNextSet(static_cast<size_t>(start - 1));
+    if (found >= pBitset->GetSize())
+        return 0;
+
+    lua_pushinteger(pState, static_cast<lua_Integer>(found + 1));
+    return 1;
+}
+
+// __len(bitset) -> the number of bits
+static int BitsetLen(lua_State* pState)
+{
+    lua_pushinteger(pState, static_cast<lua_Integer>(CheckBitset(pState)->GetSize()));
+    return 1;
+}
+
+// bleach.Bitset(size)
+static int BitsetNew(lua_State* pState)
+{
+    const lua_Integer size = luaL_checkinteger(pState, 1);
+    luaL_argcheck(pState, size >= 0, 1, "size must not be negative");
+    LuaBitset::PushNew(pState, static_cast<size_t>(size));
+    return 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Registers one container metatable, with the methods table as __index, and adds its constructor to the library 
+// table at the top of the stack.
+//---------------------------------------------------------------------------------------------------------------------
+static void RegisterContainer(lua_State* pState, const char* pMetatable, const luaL_Reg* pMethods, const luaL_Reg* pMetamethods, 
+    const char* pConstructorName, lua_CFunction constructor)
+{
+                                                                            //  [lib]
+    luaL_newmetatable(pState, pMetatable);                                  //  [lib, mt]
+    for (const luaL_Reg* pFunc = pMetamethods; pFunc->name; ++pFunc)
+    {
+        lua_pushcfunction(pState, pFunc->func);                             //  [lib, mt, func]
+        lua_setfield(pState, -2, pFunc->name);                              //  [lib, mt]
+    }
+    lua_pushboolean(pState, 0);                                             //  [lib, mt, false]
+    lua_setfield(pState, -2, "__metatable");                                //  [lib, mt]
+
+    lua_newtable(pState);                                                   //  [lib, mt, methods]
+    for (const luaL_Reg* pFunc = pMethods; pFunc->name; ++pFunc)
+    {
+        lua_pushcfunction(pState, pFunc->func);                             //  [lib, mt, methods, func]
+        lua_setfield(pState, -2, pFunc->name);                              //  [lib, mt, methods]
+    }
+    lua_setfield(pState, -2, "__index");                                    //  [lib, mt]
+    lua_pop(pState, 1);                                                     //  [lib]
+
+    lua_pushcfunction(pState, constructor);                                 //  [lib, ctor]
+    lua_setfield(pState, -2, pConstructorName);                             //  [lib]
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Registers the container metatables and adds their constructors to the BleachLua library table.
+//      -pState:    The Lua state.
+//---------------------------------------------------------------------------------------------------------------------
+void OpenContainerLib(LuaState* pState)
+{
+    static const luaL_Reg kDequeMethods[] =
+    {
+        { "push_back", &DequePushBack },
+        { "push_front", &DequePushFront },
+        { "pop_back", &DequePopBack },
+        { "pop_front", &DequePopFront },
+        { "front", &DequeFront },
+        { "back", &DequeBack },
+        { "get", &DequeGet },
+        { "clear", &DequeClear },
+        { nullptr, nullptr }
+    };
+    static const luaL_Reg kDequeMetamethods[] =
+    {
+        { "__len", &DequeLen },
+        { nullptr, nullptr }
+    };
+
+    static const luaL_Reg kHeapMethods[] =
+    {
+        { "push", &HeapPush },
+        { "pop", &HeapPop },
+        { "peek", &HeapPeek },
+        { "clear", &HeapClear },
+        { nullptr, nullptr }
+    };
+    static const luaL_Reg kHeapMetamethods[] =
+    {
+        { "__len", &HeapLen },
+        { "__gc", &HeapGc },
+        { nullptr, nullptr }
+    };
+
+    static const luaL_Reg kSortedMapMethods[] =
+    {
+        { "set", &SortedMapSet },
+        { "get", &SortedMapGet },
+        { "has", &SortedMapHas },
+        { "remove", &SortedMapRemove },
+        { "min", &SortedMapMin },
+        { "max", &SortedMapMax },
+        { "pairs", &SortedMapPairs },
+        { "clear", &SortedMapClear },
+        { nullptr, nullptr }
+    };
+    static const luaL_Reg kSortedMapMetamethods[] =
+    {
+        { "__len", &SortedMapLen },
+        { "__gc", &SortedMapGc },
+        { nullptr, nullptr }
+    };
+
+    static const luaL_Reg kBitsetMethods[] =
+    {
+        { "set", &BitsetSet },
+        { "reset", &BitsetReset },
+        { "toggle", &BitsetToggle },
+        { "test", &BitsetTest },
+        { "set_all", &BitsetSetAll },
+        { "clear", &BitsetClear },
+        { "count", &BitsetCount },
+        { "next_set", &BitsetNextSet },
+        { nullptr, nullptr }
+    };
+    static const luaL_Reg kBitsetMetamethods[] =
+    {
+        { "__len", &BitsetLen },
+        { nullptr, nullptr }
+    };
+
+    LUA_ASSERT(pState);
+    LuaVar lib = pState->GetGlobals().GetOrCreateNewTable(BLEACHLUA_LIB_TABLE_NAME);
+
+    lua_State* pLuaState = pState->GetState();
+    lib.PushValueToStack();                                                 //  [lib]
+    RegisterContainer(pLuaState, kDequeMetatable, kDequeMethods, kDequeMetamethods, "Deque", &DequeNew);
+    RegisterContainer(pLuaState, kHeapMetatable, kHeapMethods, kHeapMetamethods, "Heap", &HeapNew);
+    RegisterContainer(pLuaState, kSortedMapMetatable, kSortedMapMethods, kSortedMapMetamethods, "SortedMap", &SortedMapNew);
+    RegisterContainer(pLuaState, kBitsetMetatable, kBitsetMethods, kBitsetMetamethods, "Bitset", &BitsetNew);
+    lua_pop(pLuaState, 1);                                                  //  []
+}
+
+}  // end namespace BleachLua
@@ -29,9 +29,23 @@
 #include <BleachLua/LuaVar.h>
 #include <BleachLua/LuaState.h>
 #include <BleachLua/LuaFunction.h>
+#include <BleachLua/LuaStringUtils.h>
 
 namespace BleachLua::Debug {
 
+// The lua_State of the innermost bound call currently executing, or nullptr if we're not in one.
+static lua_State* s_pBoundCallState = nullptr;
+
+// Registry key for the table of coroutines that BoundCallScopes point at.  It maps thread -> number of scopes.
+static char s_anchoredThreadsKey = 0;
+
+#if BLEACHLUA_BOUND_CALL_HISTORY_SIZE > 0
+// Ring buffer of the most recent bound call sites.  This is meant to be looked at in the debugger after a crash, or 
+// dumped with DumpRecentBoundCalls().
+static BoundCallSite s_recentBoundCalls[BLEACHLUA_BOUND_CALL_HISTORY_SIZE] = {};
+static size_t s_numBoundCalls = 0;
+#endif
+
 luastl::string GetTraceback(BleachLua::LuaState* pState)
 {
     LUA_ASSERT(pState);
@@ -46,6 +60,146 @@ luastl::string GetTraceback(BleachLua::LuaState* pState)
     return {};
 }
 
+//---------------------------------------------------------------------------------------------------------------------
+// Adjusts the anchor count of the running coroutine.  A thread with a count above zero can't be collected, so 
+// s_pBoundCallState stays valid even if an error skips the scope that would have reset it.
+//      -pState:    The coroutine.  It must be the thread that's currently running.
+//      -delta:     +1 when a scope starts, -1 when it ends.
+//---------------------------------------------------------------------------------------------------------------------
+static void AdjustThreadAnchor(lua_State* pState, int delta)
+{
+    lua_pushlightuserdata(pState, &s_anchoredThreadsKey);               //  [key]
+    lua_rawget(pState, LUA_REGISTRYINDEX);                              //  [anchors|nil]
+    if (!lua_istable(pState, -1))
+    {
+        lua_pop(pState, 1);                                             //  []
+        if (delta < 0)
+            return;  // a barrier already released everything
+
+        lua_newtable(pState);                                           //  [anchors]
+        lua_pushlightuserdata(pState, &s_anchoredThreadsKey);           //  [anchors, key]
+        lua_pushvalue(pState, -2);                                      //  [anchors, key, anchors]
+        lua_rawset(pState, LUA_REGISTRYINDEX);                          //  [anchors]
+    }
+
+    lua_pushthread(pState);                                             //  [anchors, thread]
+    lua_pushvalue(pState, -1);                                          //  [anchors, thread, thread]
+    lua_rawget(pState, -3);                                             //  [anchors, thread, count|nil]
+    const lua_Integer count = lua_tointeger(pState, -1) + delta;
+    lua_pop(pState, 1);                                                 //  [anchors, thread]
+    if (count > 0)
+        lua_pushinteger(pState, count);                                 //  [anchors, thread, count]
+    else
+        lua_pushnil(pState);                                            //  [anchors, thread, nil]
+    lua_rawset(pState, -3);                                             //  [anchors]
+    lua_pop(pState, 1);                                                 //  []
+}
+
+BoundCallScope::BoundCallScope(lua_State* pState)
+    : m_pPrevState(s_pBoundCallState)
+    , m_pAnchoredThread(nullptr)
+{
+    s_pBoundCallState = pState;
+
+    // The main thread lives as long as the state does, so only coroutines need anchoring.  A scope nested directly 
+    // inside one on the same coroutine is covered by that scope's anchor, which is held until it ends or an outermost 
+    // barrier clears everything, and neither can happen while this scope is running.
+    const bool isMainThread = (lua_pushthread(pState) == 1);            //  [thread]
+    lua_pop(pState, 1);                                                 //  []
+    if (!isMainThread && m_pPrevState != pState)
+    {
+        AdjustThreadAnchor(pState, 1);
+        m_pAnchoredThread = pState;
+    }
+
+#if BLEACHLUA_BOUND_CALL_HISTORY_SIZE > 0
+    // level 1 is the Lua function that called into us
+    BoundCallSite& site = s_recentBoundCalls[s_numBoundCalls % BLEACHLUA_BOUND_CALL_HISTORY_SIZE];
+    ++s_numBoundCalls;
+
+    lua_Debug debugInfo;
+    if (lua_getstack(pState, 1, &debugInfo) && lua_getinfo(pState, "Sl", &debugInfo))
+    {
+        memcpy(site.m_source, debugInfo.short_src, sizeof(site.m_source));
+        site.m_line = debugInfo.currentline;
+    }
+    else
+    {
+        site.m_source[0] = '\0';
+        site.m_line = -1;
+    }
+#endif
+}
+
+BoundCallScope::~BoundCallScope()
+{
+    if (m_pAnchoredThread)
+        AdjustThreadAnchor(m_pAnchoredThread, -1);
+    s_pBoundCallState = m_pPrevState;
+}
+
+BoundCallBarrier::BoundCallBarrier(lua_State* pState)
+    : m_pState(pState)
+    , m_pSavedState(s_pBoundCallState)
+{
+    //
+}
+
+BoundCallBarrier::~BoundCallBarrier()
+{
+    s_pBoundCallState = m_pSavedState;
+
+    // With no bound call outside of us, every scope inside has ended one way or another.  Anything still anchored 
+    // was left behind by an error, so let it go.
+    if (!m_pSavedState)
+    {
+        lua_pushlightuserdata(m_pState, &s_anchoredThreadsKey);         //  [key]
+        lua_pushnil(m_pState);                                          //  [key, nil]
+        lua_rawset(m_pState, LUA_REGISTRYINDEX);                        //  []
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Builds the Lua traceback for the innermost bound call.  This is the expensive part, so it's only done on demand.
+//      -return:    The traceback, or an empty string if we're not currently inside a bound call.
+//---------------------------------------------------------------------------------------------------------------------
+luastl::string GetBoundCallTraceback()
+{
+    if (!s_pBoundCallState)
+        return {};
+
+    luaL_traceback(s_pBoundCallState, s_pBoundCallState, "\nBound call", 0);     //  [traceback]
+    luastl::string result = lua_tostring(s_pBoundCallState, -1);
+    lua_pop(s_pBoundCallState, 1);                                              //  []
+    return result;
+}
+
+luastl::string AppendBoundCallTraceback(luastl::string message)
+{
+    // luaL_traceback() always starts its output with this
+    if (message.find("stack traceback:") == luastl::string::npos)
+        message += GetBoundCallTraceback();
+    return message;
+}
+
+#if BLEACHLUA_BOUND_CALL_HISTORY_SIZE > 0
+void DumpRecentBoundCalls()
+{
+    constexpr size_t kHistorySize = BLEACHLUA_BOUND_CALL_HISTORY_SIZE;
+    const size_t first = (s_numBoundCalls > kHistorySize) ? s_numBoundCalls - kHistorySize : 0;
+
+    luastl::string buffer = "Recent bound calls (oldest first):\n";
+    for (size_t i = first; i < s_numBoundCalls; ++i)
+    {
+        const BoundCallSite& site = s_recentBoundCalls[i % kHistorySize];
+        buffer += "    ";
+        buffer += (site.m_source[0] != '\0') ? site.m_source : "?";
+        buffer += ":" + TO_STRING(site.m_line) + "\n";
+    }
+    LUA_INFO(buffer);
+}
+#endif
+
 }  // end namespace BleachLua::Debug
 
 #endif  // BLEACHLUA_DEBUG_MODE
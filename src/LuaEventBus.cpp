@@ -0,0 +1,337 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaEventBus.h>
+#include <BleachLua/LuaState.h>
+#include <algorithm>
+
+namespace BleachLua {
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaEventBus
+//---------------------------------------------------------------------------------------------------------------------
+LuaEventBus::LuaEventBus(LuaState* pState)
+    : m_pState(pState)
+    , m_queueTable(pState)
+    , m_spareQueueTable(pState)
+    , m_queueTableSize(0)
+    , m_nextListenerId(kInvalidListenerId + 1)
+    , m_isFlushing(false)
+    , m_isFlushRequested(false)
+{
+    LUA_ASSERT(pState);
+}
+
+LuaEventBus::~LuaEventBus()
+{
+    lua_State* pState = m_pState->GetState();
+    for (auto& eventPair : m_events)
+    {
+        for (const Listener& listener : eventPair.second.m_listeners)
+            luaL_unref(pState, LUA_REGISTRYINDEX, listener.m_ref);
+        for (const Listener& listener : eventPair.second.m_pendingAdds)
+            luaL_unref(pState, LUA_REGISTRYINDEX, listener.m_ref);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Adds a listener for an event.
+//      -eventId:   The event to listen for.
+//      -function:  The Lua function to call.  It's called with the event's payload as its arguments.
+//      -priority:  Listeners with higher priorities are called first.  Listeners with the same priority are called 
+//                  in the order they were added.
+//      -return:    The id of the listener, for RemoveListener(), or kInvalidListenerId if function isn't a function.
+//---------------------------------------------------------------------------------------------------------------------
+LuaEventBus::ListenerId LuaEventBus::AddListener(StringId eventId, const LuaVar& function, int priority)
+{
+    if (!function.IsFunction())
+    {
+        LUA_ERROR("Attempting to add an event listener that isn't a function.  Type is " + function.GetTypeNameStr());
+        return kInvalidListenerId;
+    }
+
+    lua_State* pState = m_pState->GetState();
+    function.PushValueToStack();                                            //  [func]
+    const Listener listener = { luaL_ref(pState, LUA_REGISTRYINDEX), priority, m_nextListenerId++ };   //  []
+
+    EventListeners& listeners = m_events[eventId.GetHash()];
+    if (listeners.m_dispatchDepth > 0)
+        listeners.m_pendingAdds.push_back(listener);
+    else
+        InsertListener(listeners.m_listeners, listener);
+    return listener.m_id;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Removes a listener.  This is safe to call from inside a listener, including the one being removed.
+//      -eventId:       The event the listener was added for.
+//      -listenerId:    The id returned by AddListener().
+//      -return:        true if the listener was found and removed.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaEventBus::RemoveListener(StringId eventId, ListenerId listenerId)
+{
+    EventListeners* pListeners = FindListeners(eventId);
+    if (!pListeners)
+        return false;
+
+    lua_State* pState = m_pState->GetState();
+    for (auto it = pListeners->m_pendingAdds.begin(); it != pListeners->m_pendingAdds.end(); ++it)
+    {
+        if (it->m_id == listenerId)
+        {
+            luaL_unref(pState, LUA_REGISTRYINDEX, it->m_ref);
+            pListeners->m_pendingAdds.erase(it);
+            return true;
+        }
+    }
+
+    for (Listener& listener : pListeners->m_listeners)
+    {
+        if (listener.m_id == listenerId && listener.m_ref != LUA_NOREF)
+        {
+            luaL_unref(pState, LUA_REGISTRYINDEX, listener.m_ref);
+            listener.m_ref = LUA_NOREF;
+            pListeners->m_needsCompaction = true;
+            if (pListeners->m_dispatchDepth == 0)
+                FinishDispatch(*pListeners);
+            return true;
+        }
+    }
+    return false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Removes every listener for an event.  This is safe to call from inside a listener.
+//      -eventId:   The event.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaEventBus::RemoveAllListeners(StringId eventId)
+{
+    EventListeners* pListeners = FindListeners(eventId);
+    if (!pListeners)
+        return;
+
+    lua_State* pState = m_pState->GetState();
+    for (Listener& listener : pListeners->m_listeners)
+    {
+        luaL_unref(pState, LUA_REGISTRYINDEX, listener.m_ref);
+        listener.m_ref = LUA_NOREF;
+    }
+    for (const Listener& listener : pListeners->m_pendingAdds)
+        luaL_unref(pState, LUA_REGISTRYINDEX, listener.m_ref);
+    pListeners->m_pendingAdds.clear();
+
+    pListeners->m_needsCompaction = true;
+    if (pListeners->m_dispatchDepth == 0)
+        FinishDispatch(*pListeners);
+}
+
+size_t LuaEventBus::GetNumListeners(StringId eventId) const
+{
+    auto findIt = m_events.find(eventId.GetHash());
+    if (findIt == m_events.end())
+        return 0;
+
+    const EventListeners& listeners = findIt->second;
+    const size_t numRemoved = std::count_if(listeners.m_listeners.begin(), listeners.m_listeners.end(), [](const Listener& listener)
+    {
+        return listener.m_ref == LUA_NOREF;
+    });
+    return listeners.m_listeners.size() - numRemoved + listeners.m_pendingAdds.size();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Dispatches every queued event, in the order they were queued.  Events queued by listeners during the flush are 
+// dispatched on the next flush.  If a listener calls FlushQueue() itself, the call is deferred to the flush that's 
+// already running, which makes another pass over whatever was queued once the current batch is done.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaEventBus::FlushQueue()
+{
+    if (m_isFlushing)
+    {
+        m_isFlushRequested = true;
+        return;
+    }
+
+    m_isFlushing = true;
+    do
+    {
+        m_isFlushRequested = false;
+        FlushQueuedEvents();
+    } while (m_isFlushRequested);
+    m_isFlushing = false;
+}
+
+void LuaEventBus::FlushQueuedEvents()
+{
+    if (m_queuedEvents.empty())
+        return;
+
+    // swap in the empty queue first so anything queued during the flush goes there
+    m_flushingEvents.swap(m_queuedEvents);
+    LuaVar flushingTable = std::move(m_queueTable);
+    m_queueTable = std::move(m_spareQueueTable);
+    const int flushingTableSize = m_queueTableSize;
+    m_queueTableSize = 0;
+
+    lua_State* pState = m_pState->GetState();
+    flushingTable.PushValueToStack();                                       //  [queue]
+    const int queueIndex = lua_gettop(pState);
+    for (const QueuedEvent& event : m_flushingEvents)
+    {
+        EventListeners* pListeners = FindListeners(event.m_eventId);
+        if (!pListeners || pListeners->m_listeners.empty())
+            continue;
+
+        // this isn't protected, so it has to fail without raising an error
+        if (!lua_checkstack(pState, event.m_numArgs))
+        {
+            LUA_ERROR("Not enough Lua stack space for the payload of a queued event.  The event was dropped.");
+            continue;
+        }
+        for (int i = 0; i < event.m_numArgs; ++i)
+            lua_rawgeti(pState, queueIndex, event.m_firstArg + i);          //  [queue, args...]
+        DispatchFromStack(*pListeners, event.m_numArgs);                    //  [queue]
+    }
+
+    // clear the payloads so they can be collected, and keep the table for the next flush
+    for (int i = 1; i <= flushingTableSize; ++i)
+    {
+        lua_pushnil(pState);                                                //  [queue, nil]
+        lua_rawseti(pState, queueIndex, i);                                 //  [queue]
+    }
+    lua_pop(pState, 1);                                                     //  []
+
+    m_flushingEvents.clear();
+    m_spareQueueTable = std::move(flushingTable);
+}
+
+LuaEventBus::EventListeners* LuaEventBus::FindListeners(StringId eventId)
+{
+    auto findIt = m_events.find(eventId.GetHash());
+    return (findIt != m_events.end()) ? &findIt->second : nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Calls the listeners with the payload at the top of the stack, then pops the payload.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaEventBus::DispatchFromStack(EventListeners& listeners, int numArgs)
+{
+    lua_State* pState = m_pState->GetState();
+    const int firstArg = lua_gettop(pState) - numArgs + 1;
+
+    // this isn't protected, so it has to fail without raising an error
+    if (!lua_checkstack(pState, numArgs + 2))
+    {
+        LUA_ERROR("Not enough Lua stack space to dispatch an event.  The event was dropped.");
+        lua_pop(pState, numArgs);                                           //  []
+        return;
+    }
+
+    DispatchContext context = { &listeners.m_listeners, 0 };
+
+    ++listeners.m_dispatchDepth;
+    while (context.m_next < listeners.m_listeners.size())
+    {
+        lua_pushcfunction(pState, &CallListeners);                          //  [args..., func]
+        lua_pushlightuserdata(pState, &context);                            //  [args..., func, context]
+        for (int i = 0; i < numArgs; ++i)
+            lua_pushvalue(pState, firstArg + i);                            //  [args..., func, context, args...]
+
+        if (Debug::ProtectedCall(pState, numArgs + 1, 0, 0) != LUA_OK)     //  [args...] or [args..., error]
+        {
+            LUA_ERROR(luastl::string("Event listener failed: ") + (lua_tostring(pState, -1) ? lua_tostring(pState, -1) : "(error object is not a string)"));
+            lua_pop(pState, 1);                                             //  [args...]
+        }
+    }
+    --listeners.m_dispatchDepth;
+
+    if (listeners.m_dispatchDepth == 0)
+        FinishDispatch(listeners);
+    lua_pop(pState, numArgs);                                               //  []
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The protected part of a dispatch.  This is called through lua_pcall() with the context and the payload as its 
+// arguments, and calls listeners until it runs out or one of them raises an error.  m_next is advanced before each 
+// call, so after an error the caller can resume with the listener after the one that failed.  Listeners added during 
+// the dispatch are held in m_pendingAdds, so the array isn't reallocated under this loop.
+//---------------------------------------------------------------------------------------------------------------------
+int LuaEventBus::CallListeners(lua_State* pState)
+{
+    DispatchContext* pContext = static_cast<DispatchContext*>(lua_touserdata(pState, 1));
+    const int numArgs = lua_gettop(pState) - 1;
+    luaL_checkstack(pState, numArgs + 1, nullptr);
+
+    const luastl::vector<Listener>& listeners = *pContext->m_pListeners;
+    while (pContext->m_next < listeners.size())
+    {
+        const int ref = listeners[pContext->m_next++].m_ref;
+        if (ref == LUA_NOREF)  // removed during this dispatch
+            continue;
+
+        lua_rawgeti(pState, LUA_REGISTRYINDEX, ref);                        //  [context, args..., listener]
+        for (int i = 0; i < numArgs; ++i)
+            lua_pushvalue(pState, i + 2);                                   //  [context, args..., listener, args...]
+        lua_call(pState, numArgs, 0);                                       //  [context, args...]
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Applies the changes that were deferred while the listeners were being dispatched.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaEventBus::FinishDispatch(EventListeners& listeners)
+{
+    if (listeners.m_needsCompaction)
+    {
+        auto newEnd = std::remove_if(listeners.m_listeners.begin(), listeners.m_listeners.end(), [](const Listener& listener)
+        {
+            return listener.m_ref == LUA_NOREF;
+        });
+        listeners.m_listeners.erase(newEnd, listeners.m_listeners.end());
+        listeners.m_needsCompaction = false;
+    }
+
+    for (const Listener& listener : listeners.m_pendingAdds)
+        InsertListener(listeners.m_listeners, listener);
+    listeners.m_pendingAdds.clear();
+}
+
+void LuaEventBus::InsertListener(luastl::vector<Listener>& listeners, const Listener& listener)
+{
+    // after every listener with the same or higher priority
+    auto it = std::upper_bound(listeners.begin(), listeners.end(), listener, [](const Listener& left, const Listener& right)
+    {
+        return left.m_priority > right.m_priority;
+    });
+    listeners.insert(it, listener);
+}
+
+void LuaEventBus::PushQueueTable()
+{
+    if (!m_queueTable.IsTable())
+        m_queueTable.CreateNewTable();
+    m_queueTable.PushValueToStack();
+}
+
+}  // end namespace BleachLua
@@ -65,7 +65,7 @@ void LuaFunction<void>::operator()() const
     m_functionVar.PushValueToStack();                               //  [exHandler, func]
 
     // call the function
-    const int result = lua_pcall(pState, 0, 0, -2);                 //  [exHandler, error?]
+    const int result = Debug::ProtectedCall(pState, 0, 0, -2);      //  [exHandler, error?]
     if (result != LUA_OK)
     {
         LUA_ERROR(lua_tostring(pState, -1));
@@ -0,0 +1,1111 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaMath.h>
+#include <BleachLua/LuaState.h>
+#include <cmath>
+#include <cstdio>
+
+#if BLEACHLUA_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace BleachLua {
+
+//---------------------------------------------------------------------------------------------------------------------
+// Every function in this library is a closure over the five metatables (upvalues 1-5), so checking a type or 
+// creating a new value compares against an upvalue instead of looking the metatable up in the registry by name.  
+// The __index closures get the methods table as upvalue 6.
+//---------------------------------------------------------------------------------------------------------------------
+static constexpr int kNumMetatableUpvalues = 5;
+static constexpr int kMethodsUpvalue = kNumMetatableUpvalues + 1;
+
+template <class Type> struct MathTypeInfo;
+template <> struct MathTypeInfo<LuaVec2> { static constexpr const char* kMetatable = "BleachLua.vec2"; static constexpr const char* kName = "vec2"; static constexpr int kUpvalue = 1; static constexpr int kCount = 2; };
+template <> struct MathTypeInfo<LuaVec3> { static constexpr const char* kMetatable = "BleachLua.vec3"; static constexpr const char* kName = "vec3"; static constexpr int kUpvalue = 2; static constexpr int kCount = 3; };
+template <> struct MathTypeInfo<LuaVec4> { static constexpr const char* kMetatable = "BleachLua.vec4"; static constexpr const char* kName = "vec4"; static constexpr int kUpvalue = 3; static constexpr int kCount = 4; };
+template <> struct MathTypeInfo<LuaQuat> { static constexpr const char* kMetatable = "BleachLua.quat"; static constexpr const char* kName = "quat"; static constexpr int kUpvalue = 4; static constexpr int kCount = 4; };
+template <> struct MathTypeInfo<LuaMat4> { static constexpr const char* kMetatable = "BleachLua.mat4"; static constexpr const char* kName = "mat4"; static constexpr int kUpvalue = 5; static constexpr int kCount = 16; };
+
+// All of the math types are plain arrays of floats.
+template <class Type> static float* Floats(Type& value) { return reinterpret_cast<float*>(&value); }
+template <class Type> static const float* Floats(const Type& value) { return reinterpret_cast<const float*>(&value); }
+
+static LuaQuat IdentityQuat() { return LuaQuat{ 0.f, 0.f, 0.f, 1.f }; }
+
+static LuaMat4 IdentityMat4()
+{
+    LuaMat4 result = {};
+    result.m[0] = result.m[5] = result.m[10] = result.m[15] = 1.f;
+    return result;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Kernels
+// 
+// pOut may always alias the inputs, which is what the _inplace methods rely on.
+//---------------------------------------------------------------------------------------------------------------------
+template <int kCount>
+static void AddKernel(float* pOut, const float* pLeft, const float* pRight)
+{
+    for (int i = 0; i < kCount; ++i)
+        pOut[i] = pLeft[i] + pRight[i];
+}
+
+template <int kCount>
+static void SubKernel(float* pOut, const float* pLeft, const float* pRight)
+{
+    for (int i = 0; i < kCount; ++i)
+        pOut[i] = pLeft[i] - pRight[i];
+}
+
+template <int kCount>
+static void MulKernel(float* pOut, const float* pLeft, const float* pRight)
+{
+    for (int i = 0; i < kCount; ++i)
+        pOut[i] = pLeft[i] * pRight[i];
+}
+
+template <int kCount>
+static void DivKernel(float* pOut, const float* pLeft, const float* pRight)
+{
+    for (int i = 0; i < kCount; ++i)
+        pOut[i] = pLeft[i] / pRight[i];
+}
+
+template <int kCount>
+static void ScaleKernel(float* pOut, const float* pIn, float scale)
+{
+    for (int i = 0; i < kCount; ++i)
+        pOut[i] = pIn[i] * scale;
+}
+
+// pOut = pLeft + (pRight * scale); this is both lerp and the usual "position += velocity * dt"
+template <int kCount>
+static void AddScaledKernel(float* pOut, const float* pLeft, const float* pRight, float scale)
+{
+    for (int i = 0; i < kCount; ++i)
+        pOut[i] = pLeft[i] + (pRight[i] * scale);
+}
+
+template <int kCount>
+static float DotKernel(const float* pLeft, const float* pRight)
+{
+    float result = 0.f;
+    for (int i = 0; i < kCount; ++i)
+        result += pLeft[i] * pRight[i];
+    return result;
+}
+
+#if BLEACHLUA_USE_SSE
+template <>
+void AddKernel<4>(float* pOut, const float* pLeft, const float* pRight)
+{
+    _mm_storeu_ps(pOut, _mm_add_ps(_mm_loadu_ps(pLeft), _mm_loadu_ps(pRight)));
+}
+
+template <>
+void SubKernel<4>(float* pOut, const float* pLeft, const float* pRight)
+{
+    _mm_storeu_ps(pOut, _mm_sub_ps(_mm_loadu_ps(pLeft), _mm_loadu_ps(pRight)));
+}
+
+template <>
+void MulKernel<4>(float* pOut, const float* pLeft, const float* pRight)
+{
+    _mm_storeu_ps(pOut, _mm_mul_ps(_mm_loadu_ps(pLeft), _mm_loadu_ps(pRight)));
+}
+
+template <>
+void DivKernel<4>(float* pOut, const float* pLeft, const float* pRight)
+{
+    _mm_storeu_ps(pOut, _mm_div_ps(_mm_loadu_ps(pLeft), _mm_loadu_ps(pRight)));
+}
+
+template <>
+void ScaleKernel<4>(float* pOut, const float* pIn, float scale)
+{
+    _mm_storeu_ps(pOut, _mm_mul_ps(_mm_loadu_ps(pIn), _mm_set1_ps(scale)));
+}
+
+template <>
+void AddScaledKernel<4>(float* pOut, const float* pLeft, const float* pRight, float scale)
+{
+    const __m128 scaled = _mm_mul_ps(_mm_loadu_ps(pRight), _mm_set1_ps(scale));
+    _mm_storeu_ps(pOut, _mm_add_ps(_mm_loadu_ps(pLeft), scaled));
+}
+
+template <>
+float DotKernel<4>(const float* pLeft, const float* pRight)
+{
+    __m128 product = _mm_mul_ps(_mm_loadu_ps(pLeft), _mm_loadu_ps(pRight));                 // x, y, z, w
+    product = _mm_add_ps(product, _mm_movehl_ps(product, product));                         // x+z, y+w, ...
+    product = _mm_add_ss(product, _mm_shuffle_ps(product, product, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(product);
+}
+#endif  // BLEACHLUA_USE_SSE
+
+static void MulMat4Kernel(LuaMat4& out, const LuaMat4& left, const LuaMat4& right)
+{
+    float result[16];
+#if BLEACHLUA_USE_SSE
+    const __m128 col0 = _mm_loadu_ps(left.m);
+    const __m128 col1 = _mm_loadu_ps(left.m + 4);
+    const __m128 col2 = _mm_loadu_ps(left.m + 8);
+    const __m128 col3 = _mm_loadu_ps(left.m + 12);
+    for (int col = 0; col < 4; ++col)
+    {
+        const float* pRightCol = right.m + (col * 4);
+        __m128 resultCol = _mm_mul_ps(col0, _mm_set1_ps(pRightCol[0]));
+        resultCol = _mm_add_ps(resultCol, _mm_mul_ps(col1, _mm_set1_ps(pRightCol[1])));
+        resultCol = _mm_add_ps(resultCol, _mm_mul_ps(col2, _mm_set1_ps(pRightCol[2])));
+        resultCol = _mm_add_ps(resultCol, _mm_mul_ps(col3, _mm_set1_ps(pRightCol[3])));
+        _mm_storeu_ps(result + (col * 4), resultCol);
+    }
+#else
+    for (int col = 0; col < 4; ++col)
+    {
+        for (int row = 0; row < 4; ++row)
+        {
+            float sum = 0.f;
+            for (int i = 0; i < 4; ++i)
+                sum += left.m[(i * 4) + row] * right.m[(col * 4) + i];
+            result[(col * 4) + row] = sum;
+        }
+    }
+#endif
+    memcpy(out.m, result, sizeof(result));
+}
+
+static LuaVec4 TransformKernel(const LuaMat4& mat, float x, float y, float z, float w)
+{
+    LuaVec4 result;
+#if BLEACHLUA_USE_SSE
+    __m128 sum = _mm_mul_ps(_mm_loadu_ps(mat.m), _mm_set1_ps(x));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(mat.m + 4), _mm_set1_ps(y)));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(mat.m + 8), _mm_set1_ps(z)));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(mat.m + 12), _mm_set1_ps(w)));
+    _mm_storeu_ps(Floats(result), sum);
+#else
+    float* pResult = Floats(result);
+    for (int row = 0; row < 4; ++row)
+        pResult[row] = (mat.m[row] * x) + (mat.m[4 + row] * y) + (mat.m[8 + row] * z) + (mat.m[12 + row] * w);
+#endif
+    return result;
+}
+
+static LuaVec3 Cross(const LuaVec3& left, const LuaVec3& right)
+{
+    return LuaVec3{ (left.y * right.z) - (left.z * right.y), (left.z * right.x) - (left.x * right.z), (left.x * right.y) - (left.y * right.x) };
+}
+
+static LuaQuat MulQuat(const LuaQuat& a, const LuaQuat& b)
+{
+    return LuaQuat
+    {
+        (a.w * b.x) + (a.x * b.w) + (a.y * b.z) - (a.z * b.y),
+        (a.w * b.y) - (a.x * b.z) + (a.y * b.w) + (a.z * b.x),
+        (a.w * b.z) + (a.x * b.y) - (a.y * b.x) + (a.z * b.w),
+        (a.w * b.w) - (a.x * b.x) - (a.y * b.y) - (a.z * b.z)
+    };
+}
+
+// Rotates v by a unit quaternion without building a matrix: v + w*t + cross(q.xyz, t), where t = 2 * cross(q.xyz, v)
+static LuaVec3 RotateVec3(const LuaQuat& q, const LuaVec3& v)
+{
+    const LuaVec3 axis = { q.x, q.y, q.z };
+    LuaVec3 t = Cross(axis, v);
+    ScaleKernel<3>(Floats(t), Floats(t), 2.f);
+    const LuaVec3 u = Cross(axis, t);
+    return LuaVec3{ v.x + (q.w * t.x) + u.x, v.y + (q.w * t.y) + u.y, v.z + (q.w * t.z) + u.z };
+}
+
+static LuaMat4 RotationMat4(const LuaQuat& q)
+{
+    const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    LuaMat4 result = IdentityMat4();
+    result.m[0] = 1.f - 2.f * (yy + zz);
+    result.m[1] = 2.f * (xy + wz);
+    result.m[2] = 2.f * (xz - wy);
+    result.m[4] = 2.f * (xy - wz);
+    result.m[5] = 1.f - 2.f * (xx + zz);
+    result.m[6] = 2.f * (yz + wx);
+    result.m[8] = 2.f * (xz + wy);
+    result.m[9] = 2.f * (yz - wx);
+    result.m[10] = 1.f - 2.f * (xx + yy);
+    return result;
+}
+
+static LuaQuat Slerp(const LuaQuat& from, LuaQuat to, float t)
+{
+    float cosTheta = DotKernel<4>(Floats(from), Floats(to));
+    if (cosTheta < 0.f)  // take the short way around
+    {
+        ScaleKernel<4>(Floats(to), Floats(to), -1.f);
+        cosTheta = -cosTheta;
+    }
+
+    LuaQuat result;
+    if (cosTheta > 0.9995f)  // nearly parallel; sin(theta) is too small to divide by, so lerp and normalize instead
+    {
+        SubKernel<4>(Floats(result), Floats(to), Floats(from));
+        AddScaledKernel<4>(Floats(result), Floats(from), Floats(result), t);
+        const float length = std::sqrt(DotKernel<4>(Floats(result), Floats(result)));
+        ScaleKernel<4>(Floats(result), Floats(result), 1.f / length);
+        return result;
+    }
+
+    const float theta = std::acos(cosTheta);
+    const float invSinTheta = 1.f / std::sin(theta);
+    ScaleKernel<4>(Floats(result), Floats(from), std::sin((1.f - t) * theta) * invSinTheta);
+    AddScaledKernel<4>(Floats(result), Floats(result), Floats(to), std::sin(t * theta) * invSinTheta);
+    return result;
+}
+
+template <int kCount>
+static void NormalizeKernel(float* pOut, const float* pIn)
+{
+    const float lengthSq = DotKernel<kCount>(pIn, pIn);
+    if (lengthSq > 0.f)
+        ScaleKernel<kCount>(pOut, pIn, 1.f / std::sqrt(lengthSq));
+    else if (pOut != pIn)
+        memcpy(pOut, pIn, kCount * sizeof(float));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Stack helpers
+//---------------------------------------------------------------------------------------------------------------------
+// Returns the value at stackIndex if it's the requested math type, or nullptr.
+template <class Type>
+static Type* ToMath(lua_State* pState, int stackIndex)
+{
+    void* pData = lua_touserdata(pState, stackIndex);
+    if (!pData || !lua_getmetatable(pState, stackIndex))                                    //  [mt]
+        return nullptr;
+
+    const bool isType = lua_rawequal(pState, -1, lua_upvalueindex(MathTypeInfo<Type>::kUpvalue)) != 0;
+    lua_pop(pState, 1);                                                                     //  []
+    return isType ? static_cast<Type*>(pData) : nullptr;
+}
+
+template <class Type>
+static Type* CheckMath(lua_State* pState, int stackIndex)
+{
+    Type* pValue = ToMath<Type>(pState, stackIndex);
+    if (!pValue)
+    {
+        const char* pMessage = lua_pushfstring(pState, "%s expected, got %s", MathTypeInfo<Type>::kName, luaL_typename(pState, stackIndex));
+        luaL_argerror(pState, stackIndex, pMessage);
+    }
+    return pValue;
+}
+
+static float CheckFloat(lua_State* pState, int stackIndex)
+{
+    return static_cast<float>(luaL_checknumber(pState, stackIndex));
+}
+
+// Pushes a new uninitialized value of the given type.
+template <class Type>
+static Type* PushMath(lua_State* pState)
+{
+    Type* pValue = static_cast<Type*>(Compat::NewUserData(pState, sizeof(Type)));          //  [value]
+    lua_pushvalue(pState, lua_upvalueindex(MathTypeInfo<Type>::kUpvalue));                  //  [value, mt]
+    lua_setmetatable(pState, -2);                                                           //  [value]
+    return pValue;
+}
+
+template <class Type>
+static int PushMath(lua_State* pState, const Type& value)
+{
+    *PushMath<Type>(pState) = value;
+    return 1;
+}
+
+// Returns the index of a single-letter component name (x, y, z, w), or -1.
+template <class Type>
+static int GetComponentIndex(lua_State* pState, int stackIndex)
+{
+    if (lua_type(pState, stackIndex) != LUA_TSTRING)
+        return -1;
+
+    size_t length = 0;
+    const char* pKey = lua_tolstring(pState, stackIndex, &length);
+    if (length != 1)
+        return -1;
+
+    int index = -1;
+    switch (pKey[0])
+    {
+        case 'x': index = 0; break;
+        case 'y': index = 1; break;
+        case 'z': index = 2; break;
+        case 'w': index = 3; break;
+    }
+    return index < MathTypeInfo<Type>::kCount ? index : -1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Shared metamethods for vec2, vec3, vec4, and quat
+//---------------------------------------------------------------------------------------------------------------------
+// __index(v, key): components first, then methods
+template <class Type>
+static int MathIndex(lua_State* pState)
+{
+    Type* pValue = CheckMath<Type>(pState, 1);
+    const int index = GetComponentIndex<Type>(pState, 2);
+    if (index >= 0)
+    {
+        lua_pushnumber(pState, Floats(*pValue)[index]);
+        return 1;
+    }
+
+    lua_pushvalue(pState, 2);
+    lua_rawget(pState, lua_upvalueindex(kMethodsUpvalue));
+    return 1;
+}
+
+// __newindex(v, key, number)
+template <class Type>
+static int MathNewIndex(lua_State* pState)
+{
+    Type* pValue = CheckMath<Type>(pState, 1);
+    const int index = GetComponentIndex<Type>(pState, 2);
+    if (index < 0)
+        return luaL_argerror(pState, 2, lua_pushfstring(pState, "not a %s component", MathTypeInfo<Type>::kName));
+    Floats(*pValue)[index] = CheckFloat(pState, 3);
+    return 0;
+}
+
+// __eq(a, b)
+template <class Type>
+static int MathEq(lua_State* pState)
+{
+    const Type* pLeft = ToMath<Type>(pState, 1);
+    const Type* pRight = ToMath<Type>(pState, 2);
+    bool isEqual = pLeft && pRight;
+    for (int i = 0; isEqual && i < MathTypeInfo<Type>::kCount; ++i)
+        isEqual = Floats(*pLeft)[i] == Floats(*pRight)[i];
+    lua_pushboolean(pState, isEqual);
+    return 1;
+}
+
+// __tostring(v) -> "vec3(1, 2, 3)"
+template <class Type>
+static int MathToString(lua_State* pState)
+{
+    const float* pFloats = Floats(*CheckMath<Type>(pState, 1));
+    char buffer[512];
+    int length = snprintf(buffer, sizeof(buffer), "%s(", MathTypeInfo<Type>::kName);
+    for (int i = 0; i < MathTypeInfo<Type>::kCount; ++i)
+        length += snprintf(buffer + length, sizeof(buffer) - length, (i == 0) ? "%g" : ", %g", static_cast<double>(pFloats[i]));
+    length += snprintf(buffer + length, sizeof(buffer) - length, ")");
+    lua_pushlstring(pState, buffer, static_cast<size_t>(length));
+    return 1;
+}
+
+// v:clone() -> copy
+template <class Type>
+static int MathClone(lua_State* pState)
+{
+    return PushMath(pState, *CheckMath<Type>(pState, 1));
+}
+
+// v:set(other) or v:set(x, y, ...) -> v
+template <class Type>
+static int MathSet(lua_State* pState)
+{
+    Type* pValue = CheckMath<Type>(pState, 1);
+    if (const Type* pOther = ToMath<Type>(pState, 2))
+    {
+        *pValue = *pOther;
+    }
+    else
+    {
+        for (int i = 0; i < MathTypeInfo<Type>::kCount; ++i)
+            Floats(*pValue)[i] = CheckFloat(pState, i + 2);
+    }
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// v:unpack() -> x, y, ...
+template <class Type>
+static int MathUnpack(lua_State* pState)
+{
+    constexpr int kCount = MathTypeInfo<Type>::kCount;
+    const Type* pValue = CheckMath<Type>(pState, 1);
+    luaL_checkstack(pState, kCount, nullptr);
+    for (int i = 0; i < kCount; ++i)
+        lua_pushnumber(pState, Floats(*pValue)[i]);
+    return kCount;
+}
+
+// a:dot(b) -> number
+template <class Type>
+static int MathDot(lua_State* pState)
+{
+    const Type* pLeft = CheckMath<Type>(pState, 1);
+    const Type* pRight = CheckMath<Type>(pState, 2);
+    lua_pushnumber(pState, DotKernel<MathTypeInfo<Type>::kCount>(Floats(*pLeft), Floats(*pRight)));
+    return 1;
+}
+
+// v:normalized() -> new unit-length value (zero stays zero)
+template <class Type>
+static int MathNormalized(lua_State* pState)
+{
+    const Type* pValue = CheckMath<Type>(pState, 1);
+    Type* pResult = PushMath<Type>(pState);
+    NormalizeKernel<MathTypeInfo<Type>::kCount>(Floats(*pResult), Floats(*pValue));
+    return 1;
+}
+
+// v:normalize_inplace() -> v
+template <class Type>
+static int MathNormalizeInPlace(lua_State* pState)
+{
+    Type* pValue = CheckMath<Type>(pState, 1);
+    NormalizeKernel<MathTypeInfo<Type>::kCount>(Floats(*pValue), Floats(*pValue));
+    lua_settop(pState, 1);
+    return 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// vec2, vec3, and vec4
+//---------------------------------------------------------------------------------------------------------------------
+// __add(a, b)
+template <class Type>
+static int VecAdd(lua_State* pState)
+{
+    const Type* pLeft = CheckMath<Type>(pState, 1);
+    const Type* pRight = CheckMath<Type>(pState, 2);
+    AddKernel<MathTypeInfo<Type>::kCount>(Floats(*PushMath<Type>(pState)), Floats(*pLeft), Floats(*pRight));
+    return 1;
+}
+
+// __sub(a, b)
+template <class Type>
+static int VecSub(lua_State* pState)
+{
+    const Type* pLeft = CheckMath<Type>(pState, 1);
+    const Type* pRight = CheckMath<Type>(pState, 2);
+    SubKernel<MathTypeInfo<Type>::kCount>(Floats(*PushMath<Type>(pState)), Floats(*pLeft), Floats(*pRight));
+    return 1;
+}
+
+// __mul(v, number), __mul(number, v), or __mul(a, b) for a component-wise product
+template <class Type>
+static int VecMul(lua_State* pState)
+{
+    constexpr int kCount = MathTypeInfo<Type>::kCount;
+    if (lua_type(pState, 1) == LUA_TNUMBER)
+    {
+        const float scale = CheckFloat(pState, 1);
+        const Type* pValue = CheckMath<Type>(pState, 2);
+        ScaleKernel<kCount>(Floats(*PushMath<Type>(pState)), Floats(*pValue), scale);
+        return 1;
+    }
+
+    const Type* pLeft = CheckMath<Type>(pState, 1);
+    if (lua_type(pState, 2) == LUA_TNUMBER)
+    {
+        ScaleKernel<kCount>(Floats(*PushMath<Type>(pState)), Floats(*pLeft), CheckFloat(pState, 2));
+        return 1;
+    }
+
+    const Type* pRight = CheckMath<Type>(pState, 2);
+    MulKernel<kCount>(Floats(*PushMath<Type>(pState)), Floats(*pLeft), Floats(*pRight));
+    return 1;
+}
+
+// __div(v, number) or __div(a, b) for a component-wise quotient
+template <class Type>
+static int VecDiv(lua_State* pState)
+{
+    constexpr int kCount = MathTypeInfo<Type>::kCount;
+    const Type* pLeft = CheckMath<Type>(pState, 1);
+    if (lua_type(pState, 2) == LUA_TNUMBER)
+    {
+        ScaleKernel<kCount>(Floats(*PushMath<Type>(pState)), Floats(*pLeft), 1.f / CheckFloat(pState, 2));
+        return 1;
+    }
+
+    const Type* pRight = CheckMath<Type>(pState, 2);
+    DivKernel<kCount>(Floats(*PushMath<Type>(pState)), Floats(*pLeft), Floats(*pRight));
+    return 1;
+}
+
+// __unm(v)
+template <class Type>
+static int VecUnm(lua_State* pState)
+{
+    const Type* pValue = CheckMath<Type>(pState, 1);
+    ScaleKernel<MathTypeInfo<Type>::kCount>(Floats(*PushMath<Type>(pState)), Floats(*pValue), -1.f);
+    return 1;
+}
+
+// __len(v) -> length; this is the magnitude, not the component count
+template <class Type>
+static int VecLength(lua_State* pState)
+{
+    const Type* pValue = CheckMath<Type>(pState, 1);
+    lua_pushnumber(pState, std::sqrt(DotKernel<MathTypeInfo<Type>::kCount>(Floats(*pValue), Floats(*pValue))));
+    return 1;
+}
+
+// v:length_sq() -> squared length
+template <class Type>
+static int VecLengthSq(lua_State* pState)
+{
+    const Type* pValue = CheckMath<Type>(pState, 1);
+    lua_pushnumber(pState, DotKernel<MathTypeInfo<Type>::kCount>(Floats(*pValue), Floats(*pValue)));
+    return 1;
+}
+
+// a:distance(b) -> number
+template <class Type>
+static int VecDistance(lua_State* pState)
+{
+    constexpr int kCount = MathTypeInfo<Type>::kCount;
+    const Type* pLeft = CheckMath<Type>(pState, 1);
+    const Type* pRight = CheckMath<Type>(pState, 2);
+    Type delta;
+    SubKernel<kCount>(Floats(delta), Floats(*pLeft), Floats(*pRight));
+    lua_pushnumber(pState, std::sqrt(DotKernel<kCount>(Floats(delta), Floats(delta))));
+    return 1;
+}
+
+// a:lerp(b, t) -> new value
+template <class Type>
+static int VecLerp(lua_State* pState)
+{
+    constexpr int kCount = MathTypeInfo<Type>::kCount;
+    const Type* pLeft = CheckMath<Type>(pState, 1);
+    const Type* pRight = CheckMath<Type>(pState, 2);
+    const float t = CheckFloat(pState, 3);
+    Type delta;
+    SubKernel<kCount>(Floats(delta), Floats(*pRight), Floats(*pLeft));
+    AddScaledKernel<kCount>(Floats(*PushMath<Type>(pState)), Floats(*pLeft), Floats(delta), t);
+    return 1;
+}
+
+// a:add_inplace(b) -> a
+template <class Type>
+static int VecAddInPlace(lua_State* pState)
+{
+    Type* pLeft = CheckMath<Type>(pState, 1);
+    const Type* pRight = CheckMath<Type>(pState, 2);
+    AddKernel<MathTypeInfo<Type>::kCount>(Floats(*pLeft), Floats(*pLeft), Floats(*pRight));
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// a:sub_inplace(b) -> a
+template <class Type>
+static int VecSubInPlace(lua_State* pState)
+{
+    Type* pLeft = CheckMath<Type>(pState, 1);
+    const Type* pRight = CheckMath<Type>(pState, 2);
+    SubKernel<MathTypeInfo<Type>::kCount>(Floats(*pLeft), Floats(*pLeft), Floats(*pRight));
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// a:mul_inplace(b | number) -> a
+template <class Type>
+static int VecMulInPlace(lua_State* pState)
+{
+    constexpr int kCount = MathTypeInfo<Type>::kCount;
+    Type* pLeft = CheckMath<Type>(pState, 1);
+    if (lua_type(pState, 2) == LUA_TNUMBER)
+        ScaleKernel<kCount>(Floats(*pLeft), Floats(*pLeft), CheckFloat(pState, 2));
+    else
+        MulKernel<kCount>(Floats(*pLeft), Floats(*pLeft), Floats(*CheckMath<Type>(pState, 2)));
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// a:add_scaled_inplace(b, scale) -> a; a = a + (b * scale)
+template <class Type>
+static int VecAddScaledInPlace(lua_State* pState)
+{
+    Type* pLeft = CheckMath<Type>(pState, 1);
+    const Type* pRight = CheckMath<Type>(pState, 2);
+    AddScaledKernel<MathTypeInfo<Type>::kCount>(Floats(*pLeft), Floats(*pLeft), Floats(*pRight), CheckFloat(pState, 3));
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// a:cross(b) -> new vec3
+static int Vec3Cross(lua_State* pState)
+{
+    const LuaVec3* pLeft = CheckMath<LuaVec3>(pState, 1);
+    const LuaVec3* pRight = CheckMath<LuaVec3>(pState, 2);
+    return PushMath(pState, Cross(*pLeft, *pRight));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// quat
+//---------------------------------------------------------------------------------------------------------------------
+// __mul(q, q) -> quat, or __mul(q, v3) -> rotated vec3
+static int QuatMul(lua_State* pState)
+{
+    const LuaQuat* pLeft = CheckMath<LuaQuat>(pState, 1);
+    if (const LuaVec3* pVec = ToMath<LuaVec3>(pState, 2))
+        return PushMath(pState, RotateVec3(*pLeft, *pVec));
+    return PushMath(pState, MulQuat(*pLeft, *CheckMath<LuaQuat>(pState, 2)));
+}
+
+// a:mul_inplace(b) -> a
+static int QuatMulInPlace(lua_State* pState)
+{
+    LuaQuat* pLeft = CheckMath<LuaQuat>(pState, 1);
+    *pLeft = MulQuat(*pLeft, *CheckMath<LuaQuat>(pState, 2));
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// q:conjugate() -> new quat; this is the inverse of a unit quaternion
+static int QuatConjugate(lua_State* pState)
+{
+    const LuaQuat* pValue = CheckMath<LuaQuat>(pState, 1);
+    return PushMath(pState, LuaQuat{ -pValue->x, -pValue->y, -pValue->z, pValue->w });
+}
+
+// q:rotate(v3) -> new vec3
+static int QuatRotate(lua_State* pState)
+{
+    const LuaQuat* pValue = CheckMath<LuaQuat>(pState, 1);
+    return PushMath(pState, RotateVec3(*pValue, *CheckMath<LuaVec3>(pState, 2)));
+}
+
+// a:slerp(b, t) -> new quat
+static int QuatSlerp(lua_State* pState)
+{
+    const LuaQuat* pLeft = CheckMath<LuaQuat>(pState, 1);
+    const LuaQuat* pRight = CheckMath<LuaQuat>(pState, 2);
+    return PushMath(pState, Slerp(*pLeft, *pRight, CheckFloat(pState, 3)));
+}
+
+// q:to_mat4() -> new mat4
+static int QuatToMat4(lua_State* pState)
+{
+    return PushMath(pState, RotationMat4(*CheckMath<LuaQuat>(pState, 1)));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// mat4
+//---------------------------------------------------------------------------------------------------------------------
+// __index(m, key): 1-16 for the elements in column-major order, then methods
+static int Mat4Index(lua_State* pState)
+{
+    const LuaMat4* pValue = CheckMath<LuaMat4>(pState, 1);
+    if (lua_type(pState, 2) == LUA_TNUMBER)
+    {
+        const lua_Integer index = luaL_checkinteger(pState, 2);
+        if (index >= 1 && index <= 16)
+            lua_pushnumber(pState, pValue->m[index - 1]);
+        else
+            lua_pushnil(pState);
+        return 1;
+    }
+
+    lua_pushvalue(pState, 2);
+    lua_rawget(pState, lua_upvalueindex(kMethodsUpvalue));
+    return 1;
+}
+
+// __newindex(m, index, number)
+static int Mat4NewIndex(lua_State* pState)
+{
+    LuaMat4* pValue = CheckMath<LuaMat4>(pState, 1);
+    const lua_Integer index = luaL_checkinteger(pState, 2);
+    luaL_argcheck(pState, index >= 1 && index <= 16, 2, "index out of range");
+    pValue->m[index - 1] = CheckFloat(pState, 3);
+    return 0;
+}
+
+// __mul(m, m) -> mat4, __mul(m, v4) -> vec4, or __mul(m, v3) -> vec3 transformed as a point
+static int Mat4Mul(lua_State* pState)
+{
+    const LuaMat4* pLeft = CheckMath<LuaMat4>(pState, 1);
+    if (const LuaVec3* pVec = ToMath<LuaVec3>(pState, 2))
+    {
+        const LuaVec4 result = TransformKernel(*pLeft, pVec->x, pVec->y, pVec->z, 1.f);
+        return PushMath(pState, LuaVec3{ result.x, result.y, result.z });
+    }
+    if (const LuaVec4* pVec = ToMath<LuaVec4>(pState, 2))
+        return PushMath(pState, TransformKernel(*pLeft, pVec->x, pVec->y, pVec->z, pVec->w));
+
+    const LuaMat4* pRight = CheckMath<LuaMat4>(pState, 2);
+    MulMat4Kernel(*PushMath<LuaMat4>(pState), *pLeft, *pRight);
+    return 1;
+}
+
+// a:mul_inplace(b) -> a
+static int Mat4MulInPlace(lua_State* pState)
+{
+    LuaMat4* pLeft = CheckMath<LuaMat4>(pState, 1);
+    MulMat4Kernel(*pLeft, *pLeft, *CheckMath<LuaMat4>(pState, 2));
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// m:set_identity() -> m
+static int Mat4SetIdentity(lua_State* pState)
+{
+    *CheckMath<LuaMat4>(pState, 1) = IdentityMat4();
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// m:transposed() -> new mat4
+static int Mat4Transposed(lua_State* pState)
+{
+    const LuaMat4* pValue = CheckMath<LuaMat4>(pState, 1);
+    LuaMat4* pResult = PushMath<LuaMat4>(pState);
+    for (int col = 0; col < 4; ++col)
+    {
+        for (int row = 0; row < 4; ++row)
+            pResult->m[(row * 4) + col] = pValue->m[(col * 4) + row];
+    }
+    return 1;
+}
+
+// m:transform_point(v3) -> new vec3 (w = 1, so translation applies)
+static int Mat4TransformPoint(lua_State* pState)
+{
+    const LuaMat4* pMat = CheckMath<LuaMat4>(pState, 1);
+    const LuaVec3* pVec = CheckMath<LuaVec3>(pState, 2);
+    const LuaVec4 result = TransformKernel(*pMat, pVec->x, pVec->y, pVec->z, 1.f);
+    return PushMath(pState, LuaVec3{ result.x, result.y, result.z });
+}
+
+// m:transform_vector(v3) -> new vec3 (w = 0, so translation doesn't apply)
+static int Mat4TransformVector(lua_State* pState)
+{
+    const LuaMat4* pMat = CheckMath<LuaMat4>(pState, 1);
+    const LuaVec3* pVec = CheckMath<LuaVec3>(pState, 2);
+    const LuaVec4 result = TransformKernel(*pMat, pVec->x, pVec->y, pVec->z, 0.f);
+    return PushMath(pState, LuaVec3{ result.x, result.y, result.z });
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Constructors
+//---------------------------------------------------------------------------------------------------------------------
+// bleach.vec2(x, y), bleach.vec3(x, y, z), bleach.vec4(x, y, z, w); missing components are 0
+template <class Type>
+static int VecNew(lua_State* pState)
+{
+    Type* pValue = PushMath<Type>(pState);
+    for (int i = 0; i < MathTypeInfo<Type>::kCount; ++i)
+        Floats(*pValue)[i] = static_cast<float>(luaL_optnumber(pState, i + 1, 0));
+    return 1;
+}
+
+// bleach.quat() for identity, or bleach.quat(x, y, z, w)
+static int QuatNew(lua_State* pState)
+{
+    if (lua_gettop(pState) == 0)
+        return PushMath(pState, IdentityQuat());
+    return PushMath(pState, LuaQuat{ CheckFloat(pState, 1), CheckFloat(pState, 2), CheckFloat(pState, 3), CheckFloat(pState, 4) });
+}
+
+// bleach.quat_axis_angle(axis, radians); the axis doesn't need to be normalized
+static int QuatAxisAngle(lua_State* pState)
+{
+    LuaVec3 axis = *CheckMath<LuaVec3>(pState, 1);
+    const float halfAngle = CheckFloat(pState, 2) * 0.5f;
+    NormalizeKernel<3>(Floats(axis), Floats(axis));
+    const float sinHalfAngle = std::sin(halfAngle);
+    return PushMath(pState, LuaQuat{ axis.x * sinHalfAngle, axis.y * sinHalfAngle, axis.z * sinHalfAngle, std::cos(halfAngle) });
+}
+
+// bleach.mat4() for identity
+static int Mat4New(lua_State* pState)
+{
+    return PushMath(pState, IdentityMat4());
+}
+
+// bleach.mat4_translation(v3)
+static int Mat4Translation(lua_State* pState)
+{
+    const LuaVec3* pOffset = CheckMath<LuaVec3>(pState, 1);
+    LuaMat4* pResult = PushMath<LuaMat4>(pState);
+    *pResult = IdentityMat4();
+    memcpy(pResult->m + 12, Floats(*pOffset), 3 * sizeof(float));
+    return 1;
+}
+
+// bleach.mat4_scale(v3)
+static int Mat4Scale(lua_State* pState)
+{
+    const LuaVec3* pScale = CheckMath<LuaVec3>(pState, 1);
+    LuaMat4* pResult = PushMath<LuaMat4>(pState);
+    *pResult = IdentityMat4();
+    pResult->m[0] = pScale->x;
+    pResult->m[5] = pScale->y;
+    pResult->m[10] = pScale->z;
+    return 1;
+}
+
+// bleach.mat4_rotation(q)
+static int Mat4Rotation(lua_State* pState)
+{
+    return PushMath(pState, RotationMat4(*CheckMath<LuaQuat>(pState, 1)));
+}
+
+// bleach.mat4_trs(translation, rotation, scale) -> translation * rotation * scale, built directly
+static int Mat4Trs(lua_State* pState)
+{
+    const LuaVec3* pTranslation = CheckMath<LuaVec3>(pState, 1);
+    const LuaQuat* pRotation = CheckMath<LuaQuat>(pState, 2);
+    const LuaVec3* pScale = CheckMath<LuaVec3>(pState, 3);
+
+    LuaMat4* pResult = PushMath<LuaMat4>(pState);
+    *pResult = RotationMat4(*pRotation);
+    for (int col = 0; col < 3; ++col)
+        ScaleKernel<3>(pResult->m + (col * 4), pResult->m + (col * 4), Floats(*pScale)[col]);
+    memcpy(pResult->m + 12, Floats(*pTranslation), 3 * sizeof(float));
+    return 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Registration
+//---------------------------------------------------------------------------------------------------------------------
+// Sets each function into the table at the top of the stack as a closure over the metatables, which must be at 
+// firstMetatable through firstMetatable + 4.
+static void SetMathFunctions(lua_State* pState, int firstMetatable, const luaL_Reg* pFuncs)
+{
+    for (; pFuncs->name; ++pFuncs)
+    {
+        for (int i = 0; i < kNumMetatableUpvalues; ++i)
+            lua_pushvalue(pState, firstMetatable + i);                      //  [t, mt...]
+        lua_pushcclosure(pState, pFuncs->func, kNumMetatableUpvalues);      //  [t, func]
+        lua_setfield(pState, -2, pFuncs->name);                             //  [t]
+    }
+}
+
+// Fills in one metatable; indexFunc gets the methods table as its last upvalue.
+template <class Type>
+static void RegisterMathType(lua_State* pState, int firstMetatable, lua_CFunction indexFunc, const luaL_Reg* pMethods, 
+    const luaL_Reg* pMetamethods, const luaL_Reg* pExtraMethods = nullptr)
+{
+    lua_pushvalue(pState, firstMetatable + MathTypeInfo<Type>::kUpvalue - 1);  //  [mt]
+    SetMathFunctions(pState, firstMetatable, pMetamethods);
+
+    lua_newtable(pState);                                                   //  [mt, methods]
+    SetMathFunctions(pState, firstMetatable, pMethods);
+    if (pExtraMethods)
+        SetMathFunctions(pState, firstMetatable, pExtraMethods);
+    for (int i = 0; i < kNumMetatableUpvalues; ++i)
+        lua_pushvalue(pState, firstMetatable + i);                          //  [mt, methods, mt...]
+    lua_pushvalue(pState, -(kNumMetatableUpvalues + 1));                   //  [mt, methods, mt..., methods]
+    lua_pushcclosure(pState, indexFunc, kMethodsUpvalue);                   //  [mt, methods, __index]
+    lua_setfield(pState, -3, "__index");                                    //  [mt, methods]
+    lua_pop(pState, 2);                                                     //  []
+}
+
+template <class Type>
+static void RegisterVecType(lua_State* pState, int firstMetatable, const luaL_Reg* pExtraMethods)
+{
+    static const luaL_Reg kMetamethods[] =
+    {
+        { "__newindex", &MathNewIndex<Type> },
+        { "__add", &VecAdd<Type> },
+        { "__sub", &VecSub<Type> },
+        { "__mul", &VecMul<Type> },
+        { "__div", &VecDiv<Type> },
+        { "__unm", &VecUnm<Type> },
+        { "__len", &VecLength<Type> },
+        { "__eq", &MathEq<Type> },
+        { "__tostring", &MathToString<Type> },
+        { nullptr, nullptr }
+    };
+
+    static const luaL_Reg kMethods[] =
+    {
+        { "clone", &MathClone<Type> },
+        { "set", &MathSet<Type> },
+        { "unpack", &MathUnpack<Type> },
+        { "dot", &MathDot<Type> },
+        { "length", &VecLength<Type> },
+        { "length_sq", &VecLengthSq<Type> },
+        { "distance", &VecDistance<Type> },
+        { "normalized", &MathNormalized<Type> },
+        { "lerp", &VecLerp<Type> },
+        { "add_inplace", &VecAddInPlace<Type> },
+        { "sub_inplace", &VecSubInPlace<Type> },
+        { "mul_inplace", &VecMulInPlace<Type> },
+        { "add_scaled_inplace", &VecAddScaledInPlace<Type> },
+        { "normalize_inplace", &MathNormalizeInPlace<Type> },
+        { nullptr, nullptr }
+    };
+
+    RegisterMathType<Type>(pState, firstMetatable, &MathIndex<Type>, kMethods, kMetamethods, pExtraMethods);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaMathTraits
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+void LuaMathTraits<Type>::Push(LuaState* pState, const Type& value)
+{
+    LUA_ASSERT(pState);
+    lua_State* pLuaState = pState->GetState();
+    *static_cast<Type*>(Compat::NewUserData(pLuaState, sizeof(Type))) = value;   //  [value]
+    luaL_getmetatable(pLuaState, MathTypeInfo<Type>::kMetatable);                //  [value, mt?]
+    LUA_ASSERT_MSG(lua_istable(pLuaState, -1), "OpenMathLib() must be called before pushing math values.");
+    lua_setmetatable(pLuaState, -2);                                            //  [value]
+}
+
+template <class Type>
+Type LuaMathTraits<Type>::Get(LuaState* pState, int stackIndex)
+{
+    LUA_ASSERT(pState);
+    const Type* pValue = static_cast<const Type*>(luaL_testudata(pState->GetState(), stackIndex, MathTypeInfo<Type>::kMetatable));
+    return pValue ? *pValue : GetDefault();
+}
+
+template <class Type>
+bool LuaMathTraits<Type>::Is(LuaState* pState, int stackIndex)
+{
+    LUA_ASSERT(pState);
+    return luaL_testudata(pState->GetState(), stackIndex, MathTypeInfo<Type>::kMetatable) != nullptr;
+}
+
+template <class Type>
+Type LuaMathTraits<Type>::GetDefault()
+{
+    if constexpr (luastl::is_same<Type, LuaQuat>::value)
+        return IdentityQuat();
+    else if constexpr (luastl::is_same<Type, LuaMat4>::value)
+        return IdentityMat4();
+    else
+        return Type{};
+}
+
+template struct LuaMathTraits<LuaVec2>;
+template struct LuaMathTraits<LuaVec3>;
+template struct LuaMathTraits<LuaVec4>;
+template struct LuaMathTraits<LuaQuat>;
+template struct LuaMathTraits<LuaMat4>;
+
+//---------------------------------------------------------------------------------------------------------------------
+// Registers the math metatables and adds the constructors to the BleachLua library table.
+//      -pState:    The Lua state.
+//---------------------------------------------------------------------------------------------------------------------
+void OpenMathLib(LuaState* pState)
+{
+    LUA_ASSERT(pState);
+    LuaVar lib = pState->GetGlobals().GetOrCreateNewTable(BLEACHLUA_LIB_TABLE_NAME);
+
+    lua_State* pLuaState = pState->GetState();
+    lib.PushValueToStack();                                                 //  [lib]
+    const int firstMetatable = lua_gettop(pLuaState) + 1;
+    luaL_newmetatable(pLuaState, MathTypeInfo<LuaVec2>::kMetatable);        //  [lib, vec2]
+    luaL_newmetatable(pLuaState, MathTypeInfo<LuaVec3>::kMetatable);        //  [lib, vec2, vec3]
+    luaL_newmetatable(pLuaState, MathTypeInfo<LuaVec4>::kMetatable);        //  [lib, vec2, vec3, vec4]
+    luaL_newmetatable(pLuaState, MathTypeInfo<LuaQuat>::kMetatable);        //  [lib, vec2, vec3, vec4, quat]
+    luaL_newmetatable(pLuaState, MathTypeInfo<LuaMat4>::kMetatable);        //  [lib, vec2, vec3, vec4, quat, mat4]
+
+    static const luaL_Reg kVec3Methods[] =
+    {
+        { "cross", &Vec3Cross },
+        { nullptr, nullptr }
+    };
+    RegisterVecType<LuaVec2>(pLuaState, firstMetatable, nullptr);
+    RegisterVecType<LuaVec3>(pLuaState, firstMetatable, kVec3Methods);
+    RegisterVecType<LuaVec4>(pLuaState, firstMetatable, nullptr);
+
+    static const luaL_Reg kQuatMetamethods[] =
+    {
+        { "__newindex", &MathNewIndex<LuaQuat> },
+        { "__mul", &QuatMul },
+        { "__eq", &MathEq<LuaQuat> },
+        { "__tostring", &MathToString<LuaQuat> },
+        { nullptr, nullptr }
+    };
+    static const luaL_Reg kQuatMethods[] =
+    {
+        { "clone", &MathClone<LuaQuat> },
+        { "set", &MathSet<LuaQuat> },
+        { "unpack", &MathUnpack<LuaQuat> },
+        { "dot", &MathDot<LuaQuat> },
+        { "normalized", &MathNormalized<LuaQuat> },
+        { "normalize_inplace", &MathNormalizeInPlace<LuaQuat> },
+        { "mul_inplace", &QuatMulInPlace },
+        { "conjugate", &QuatConjugate },
+        { "rotate", &QuatRotate },
+        { "slerp", &QuatSlerp },
+        { "to_mat4", &QuatToMat4 },
+        { nullptr, nullptr }
+    };
+    RegisterMathType<LuaQuat>(pLuaState, firstMetatable, &MathIndex<LuaQuat>, kQuatMethods, kQuatMetamethods);
+
+    static const luaL_Reg kMat4Metamethods[] =
+    {
+        { "__newindex", &Mat4NewIndex },
+        { "__mul", &Mat4Mul },
+        { "__eq", &MathEq<LuaMat4> },
+        { "__tostring", &MathToString<LuaMat4> },
+        { nullptr, nullptr }
+    };
+    static const luaL_Reg kMat4Methods[] =
+    {
+        { "clone", &MathClone<LuaMat4> },
+        { "set", &MathSet<LuaMat4> },
+        { "unpack", &MathUnpack<LuaMat4> },
+        { "mul_inplace", &Mat4MulInPlace },
+        { "set_identity", &Mat4SetIdentity },
+        { "transposed", &Mat4Transposed },
+        { "transform_point", &Mat4TransformPoint },
+        { "transform_vector", &Mat4TransformVector },
+        { nullptr, nullptr }
+    };
+    RegisterMathType<LuaMat4>(pLuaState, firstMetatable, &Mat4Index, kMat4Methods, kMat4Metamethods);
+
+    static const luaL_Reg kConstructors[] =
+    {
+        { "vec2", &VecNew<LuaVec2> },
+        { "vec3", &VecNew<LuaVec3> },
+        { "vec4", &VecNew<LuaVec4> },
+        { "quat", &QuatNew },
+        { "quat_axis_angle", &QuatAxisAngle },
+        { "mat4", &Mat4New },
+        { "mat4_translation", &Mat4Translation },
+        { "mat4_scale", &Mat4Scale },
+        { "mat4_rotation", &Mat4Rotation },
+        { "mat4_trs", &Mat4Trs },
+        { nullptr, nullptr }
+    };
+    lua_pushvalue(pLuaState, firstMetatable - 1);                           //  [lib, mts..., lib]
+    SetMathFunctions(pLuaState, firstMetatable, kConstructors);
+    lua_pop(pLuaState, kNumMetatableUpvalues + 2);                          //  []
+}
+
+}  // end namespace BleachLua
@@ -0,0 +1,427 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaModuleReloader.h>
+#include <BleachLua/LuaState.h>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+namespace BleachLua {
+
+// Returns the modification time of a file, or 0 if it can't be read.
+static int64_t GetLastWriteTime(const luastl::string& path)
+{
+    std::error_code error;
+    const auto writeTime = std::filesystem::last_write_time(std::filesystem::path(path.c_str()), error);
+    return error ? 0 : static_cast<int64_t>(writeTime.time_since_epoch().count());
+}
+
+static int OnReloadError(lua_State* pState)
+{
+    const char* msg = lua_tostring(pState, -1);
+    luaL_traceback(pState, pState, msg ? msg : "(error object is not a string)", 1);
+    return 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Joins the upvalues of a new function with the same-named upvalues of the old function it replaces, so the new code 
+// sees the module's existing state.  Functions are left alone so local helpers are new code too.
+//      -pState:    The Lua state.
+//      -newIndex:  The absolute index of the new function.
+//      -oldIndex:  The absolute index of the old function.
+//---------------------------------------------------------------------------------------------------------------------
+static void JoinUpvalues(lua_State* pState, int newIndex, int oldIndex)
+{
+    if (lua_iscfunction(pState, newIndex) || lua_iscfunction(pState, oldIndex))
+        return;
+
+    for (int newUpvalue = 1; const char* newName = lua_getupvalue(pState, newIndex, newUpvalue); ++newUpvalue)   //  [value]
+    {
+        const bool isFunction = lua_isfunction(pState, -1);
+        lua_pop(pState, 1);                                                 //  []
+        if (isFunction)
+            continue;
+
+        for (int oldUpvalue = 1; const char* oldName = lua_getupvalue(pState, oldIndex, oldUpvalue); ++oldUpvalue)  //  [oldValue]
+        {
+            if (strcmp(newName, oldName) == 0)
+            {
+#if BLEACHLUA_CORE_VERSION >= 52
+                lua_pop(pState, 1);                                         //  []
+                lua_upvaluejoin(pState, newIndex, newUpvalue, oldIndex, oldUpvalue);
+#else
+                lua_setupvalue(pState, newIndex, newUpvalue);               //  []
+#endif
+                break;
+            }
+            lua_pop(pState, 1);                                             //  []
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Patches the contents of a freshly loaded module table into the old one.  Replaced functions are recorded in the 
+// replacements table (old -> new) so registry refs can be updated afterwards.
+//      -pState:            The Lua state.
+//      -oldIndex:          The absolute index of the old table.
+//      -newIndex:          The absolute index of the new table.
+//      -replacementsIndex: The absolute index of the old -> new function map.
+//      -visitedIndex:      The absolute index of the set of new tables that have already been patched.
+//---------------------------------------------------------------------------------------------------------------------
+static void PatchTable(lua_State* pState, int oldIndex, int newIndex, int replacementsIndex, int visitedIndex)
+{
+    lua_pushvalue(pState, newIndex);                                        //  [new]
+    lua_rawget(pState, visitedIndex);                                       //  [visited?]
+    const bool visited = !lua_isnil(pState, -1);
+    lua_pop(pState, 1);                                                     //  []
+    if (visited)
+        return;
+
+    lua_pushvalue(pState, newIndex);                                        //  [new]
+    lua_pushboolean(pState, 1);                                             //  [new, true]
+    lua_rawset(pState, visitedIndex);                                       //  []
+
+    lua_checkstack(pState, 6);
+    lua_pushnil(pState);                                                    //  [nil]
+    while (lua_next(pState, newIndex))                                      //  [key, value]
+    {
+        const int valueIndex = lua_gettop(pState);
+        lua_pushvalue(pState, -2);                                          //  [key, value, key]
+        lua_rawget(pState, oldIndex);                                       //  [key, value, oldValue]
+        const int oldValueIndex = valueIndex + 1;
+
+        if (lua_rawequal(pState, valueIndex, oldValueIndex))
+        {
+            // shared with the old module, like a table from another module
+        }
+        else if (lua_isfunction(pState, valueIndex) && lua_isfunction(pState, oldValueIndex))
+        {
+            JoinUpvalues(pState, valueIndex, oldValueIndex);
+
+            lua_pushvalue(pState, oldValueIndex);                           //  [key, value, oldValue, oldValue]
+            lua_pushvalue(pState, valueIndex);                              //  [key, value, oldValue, oldValue, value]
+            lua_rawset(pState, replacementsIndex);                          //  [key, value, oldValue]
+
+            lua_pushvalue(pState, valueIndex - 1);                          //  [key, value, oldValue, key]
+            lua_pushvalue(pState, valueIndex);                              //  [key, value, oldValue, key, value]
+            lua_rawset(pState, oldIndex);                                   //  [key, value, oldValue]
+        }
+        else if (lua_istable(pState, valueIndex) && lua_istable(pState, oldValueIndex))
+        {
+            PatchTable(pState, oldValueIndex, valueIndex, replacementsIndex, visitedIndex);
+        }
+        else if (lua_isnil(pState, oldValueIndex))
+        {
+            lua_pushvalue(pState, valueIndex - 1);                          //  [key, value, nil, key]
+            lua_pushvalue(pState, valueIndex);                              //  [key, value, nil, key, value]
+            lua_rawset(pState, oldIndex);                                   //  [key, value, nil]
+        }
+
+        lua_pop(pState, 2);                                                 //  [key]
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Replaces every registry value that's a key in the replacements table with its replacement, which retargets the 
+// refs held by LuaVars.
+//---------------------------------------------------------------------------------------------------------------------
+static void ReplaceRegistryValues(lua_State* pState, int replacementsIndex)
+{
+    lua_pushnil(pState);                                                    //  [nil]
+    while (lua_next(pState, LUA_REGISTRYINDEX))                             //  [key, value]
+    {
+        if (lua_isfunction(pState, -1))
+        {
+            lua_rawget(pState, replacementsIndex);                          //  [key, replacement?]
+            if (!lua_isnil(pState, -1))
+            {
+                lua_pushvalue(pState, -2);                                  //  [key, replacement, key]
+                lua_insert(pState, -2);                                     //  [key, key, replacement]
+                lua_rawset(pState, LUA_REGISTRYINDEX);                      //  [key]
+                continue;
+            }
+        }
+        lua_pop(pState, 1);                                                 //  [key]
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaModuleReloader
+//---------------------------------------------------------------------------------------------------------------------
+LuaModuleReloader::LuaModuleReloader(LuaState* pState)
+    : m_pState(pState)
+{
+    LUA_ASSERT(pState);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Starts tracking a module, finding its file the same way require() does.
+//      -moduleName:    The name passed to require().
+//      -return:        true if the file was found.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaModuleReloader::Track(const char* moduleName)
+{
+    const luastl::string path = FindModuleFile(moduleName);
+    if (path.empty())
+    {
+        LUA_ERROR("Couldn't find the file for module " + luastl::string(moduleName) + " in package.path.");
+        return false;
+    }
+    return Track(moduleName, path.c_str());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Starts tracking a module that was loaded from a known file.
+//      -moduleName:    The name passed to require(), which is its key in package.loaded.
+//      -path:          The file it was loaded from.
+//      -return:        true if the file exists.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaModuleReloader::Track(const char* moduleName, const char* path)
+{
+    const int64_t writeTime = GetLastWriteTime(path);
+    if (writeTime == 0)
+    {
+        LUA_ERROR("Couldn't read the modification time of " + luastl::string(path));
+        return false;
+    }
+
+    Module* pModule = FindModule(moduleName);
+    if (!pModule)
+    {
+        m_modules.emplace_back();
+        pModule = &m_modules.back();
+        pModule->m_name = moduleName;
+    }
+    pModule->m_path = path;
+    pModule->m_lastWriteTime = writeTime;
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Tracks every module in package.loaded whose file can be found through package.path.  Built-in libraries and 
+// modules from C loaders are skipped.
+//      -return:    The number of modules that are now tracked.
+//---------------------------------------------------------------------------------------------------------------------
+size_t LuaModuleReloader::TrackLoadedModules()
+{
+    lua_State* pState = m_pState->GetState();
+    StackHelpers::StackResetter resetter(pState, lua_gettop(pState));
+
+    luastl::vector<luastl::string> names;
+    lua_getglobal(pState, "package");                                       //  [package]
+    if (!lua_istable(pState, -1))
+        return 0;                                                           //  []  <-- from StackResetter
+    lua_getfield(pState, -1, "loaded");                                     //  [package, loaded]
+    if (!lua_istable(pState, -1))
+        return 0;                                                           //  []  <-- from StackResetter
+
+    lua_pushnil(pState);                                                    //  [package, loaded, nil]
+    while (lua_next(pState, -2))                                            //  [package, loaded, name, module]
+    {
+        if (lua_type(pState, -2) == LUA_TSTRING)
+            names.emplace_back(lua_tostring(pState, -2));
+        lua_pop(pState, 1);                                                 //  [package, loaded, name]
+    }
+
+    for (const luastl::string& name : names)
+    {
+        const luastl::string path = FindModuleFile(name.c_str());
+        if (!path.empty())
+            Track(name.c_str(), path.c_str());
+    }
+    return m_modules.size();
+}
+
+void LuaModuleReloader::Untrack(const char* moduleName)
+{
+    for (auto it = m_modules.begin(); it != m_modules.end(); ++it)
+    {
+        if (it->m_name == moduleName)
+        {
+            m_modules.erase(it);
+            return;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Checks the modification time of every tracked file and reloads the modules that changed.  This costs one file 
+// system query per module, so it's meant to be called periodically rather than every frame.
+//      -return:    The number of modules that were reloaded successfully.
+//---------------------------------------------------------------------------------------------------------------------
+size_t LuaModuleReloader::Poll()
+{
+    size_t numReloaded = 0;
+    for (Module& module : m_modules)
+    {
+        const int64_t writeTime = GetLastWriteTime(module.m_path);
+        if (writeTime == 0 || writeTime == module.m_lastWriteTime)
+            continue;
+
+        // a file that fails to load isn't retried until it changes again
+        module.m_lastWriteTime = writeTime;
+        if (ReloadModule(module))
+            ++numReloaded;
+    }
+    return numReloaded;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Reloads a tracked module now, whether or not its file changed.
+//      -moduleName:    The name of the module.
+//      -return:        true if the module was reloaded.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaModuleReloader::Reload(const char* moduleName)
+{
+    Module* pModule = FindModule(moduleName);
+    if (!pModule)
+    {
+        LUA_ERROR("Module " + luastl::string(moduleName) + " isn't being tracked.");
+        return false;
+    }
+
+    pModule->m_lastWriteTime = GetLastWriteTime(pModule->m_path);
+    return ReloadModule(*pModule);
+}
+
+LuaModuleReloader::Module* LuaModuleReloader::FindModule(const char* moduleName)
+{
+    for (Module& module : m_modules)
+    {
+        if (module.m_name == moduleName)
+            return &module;
+    }
+    return nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Finds the file for a module by trying each template in package.path, like require() does.
+//      -return:    The path of the file, or an empty string if it wasn't found.
+//---------------------------------------------------------------------------------------------------------------------
+luastl::string LuaModuleReloader::FindModuleFile(const char* moduleName) const
+{
+    lua_State* pState = m_pState->GetState();
+    luastl::string searchPath;
+    lua_getglobal(pState, "package");                                       //  [package]
+    if (lua_istable(pState, -1))
+    {
+        lua_getfield(pState, -1, "path");                                   //  [package, path]
+        if (lua_type(pState, -1) == LUA_TSTRING)
+            searchPath = lua_tostring(pState, -1);
+        lua_pop(pState, 1);                                                 //  [package]
+    }
+    lua_pop(pState, 1);                                                     //  []
+
+    // "a.b" is looked for as a/b
+    luastl::string fileName(moduleName);
+    for (char& c : fileName)
+    {
+        if (c == '.')
+            c = LUA_DIRSEP[0];
+    }
+
+    size_t start = 0;
+    while (start <= searchPath.size())
+    {
+        size_t end = searchPath.find(';', start);
+        if (end == luastl::string::npos)
+            end = searchPath.size();
+
+        luastl::string candidate = searchPath.substr(start, end - start);
+        for (size_t pos = candidate.find('?'); pos != luastl::string::npos; pos = candidate.find('?', pos + fileName.size()))
+            candidate.replace(pos, 1, fileName);
+
+        std::error_code error;
+        if (!candidate.empty() && std::filesystem::is_regular_file(std::filesystem::path(candidate.c_str()), error))
+            return candidate;
+
+        start = end + 1;
+    }
+    return luastl::string();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Runs the module's file again and patches the result into the loaded module.  See the comment in the header for the 
+// rules.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaModuleReloader::ReloadModule(const Module& module)
+{
+    lua_State* pState = m_pState->GetState();
+    StackHelpers::StackResetter resetter(pState, lua_gettop(pState));
+
+    lua_pushcfunction(pState, &OnReloadError);                              //  [handler]
+    const int handlerIndex = lua_gettop(pState);
+    int result = luaL_loadfile(pState, module.m_path.c_str());              //  [handler, chunk|error]
+    if (result == LUA_OK)
+    {
+        lua_pushstring(pState, module.m_name.c_str());                      //  [handler, chunk, name]
+        lua_pushstring(pState, module.m_path.c_str());                      //  [handler, chunk, name, path]
+        result = Debug::ProtectedCall(pState, 2, 1, handlerIndex);          //  [handler, newModule|error]
+    }
+    if (result != LUA_OK)
+    {
+        const char* msg = lua_tostring(pState, -1);
+        LUA_ERROR("Couldn't reload module " + module.m_name + ": " + (msg ? msg : "unknown error"));
+        return false;                                                       //  []  <-- from StackResetter
+    }
+    const int newIndex = lua_gettop(pState);
+
+    m_pState->BumpGlobalsGeneration();  // the file may have assigned globals, and functions are about to change
+
+    // a module that returns nothing is whatever it left in package.loaded, which it has already replaced
+    if (lua_isnil(pState, newIndex))
+        return true;                                                        //  []  <-- from StackResetter
+
+    lua_getglobal(pState, "package");                                       //  [handler, new, package]
+    lua_getfield(pState, -1, "loaded");                                     //  [handler, new, package, loaded]
+    const int loadedIndex = lua_gettop(pState);
+    lua_getfield(pState, loadedIndex, module.m_name.c_str());               //  [handler, new, package, loaded, old]
+    const int oldIndex = lua_gettop(pState);
+
+    lua_newtable(pState);                                                   //  [handler, new, package, loaded, old, replacements]
+    const int replacementsIndex = lua_gettop(pState);
+    if (lua_istable(pState, oldIndex) && lua_istable(pState, newIndex))
+    {
+        lua_newtable(pState);                                               //  [..., replacements, visited]
+        PatchTable(pState, oldIndex, newIndex, replacementsIndex, lua_gettop(pState));
+    }
+    else
+    {
+        // nothing to patch into, so the new value replaces the old one
+        if (lua_isfunction(pState, oldIndex) && lua_isfunction(pState, newIndex))
+        {
+            JoinUpvalues(pState, newIndex, oldIndex);
+            lua_pushvalue(pState, oldIndex);                                //  [..., replacements, old]
+            lua_pushvalue(pState, newIndex);                                //  [..., replacements, old, new]
+            lua_rawset(pState, replacementsIndex);                          //  [..., replacements]
+        }
+        lua_pushvalue(pState, newIndex);                                    //  [..., replacements, new]
+        lua_setfield(pState, loadedIndex, module.m_name.c_str());           //  [..., replacements]
+    }
+
+    ReplaceRegistryValues(pState, replacementsIndex);
+    return true;                                                            //  []  <-- from StackResetter
+}
+
+}  // end namespace BleachLua
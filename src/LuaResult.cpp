@@ -0,0 +1,68 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaResult.h>
+#include <BleachLua/LuaState.h>
+
+namespace BleachLua {
+
+//---------------------------------------------------------------------------------------------------------------------
+// Builds the human-readable error message.  This is the only place that allocates, so it should only be called when 
+// you actually intend to log or display the error.
+//      -return:    The error message.
+//---------------------------------------------------------------------------------------------------------------------
+luastl::string LuaErrorInfo::GetMessage() const
+{
+    switch (m_code)
+    {
+        case LuaErrorCode::kNone:
+            return {};
+
+        case LuaErrorCode::kInvalidFunction:
+            return "Attempting to call invalid Lua function.";
+
+        case LuaErrorCode::kTypeMismatch:
+        {
+            luastl::string message = "Failed to convert value to ";
+            message += (m_pExpectedType ? m_pExpectedType : "the requested type");
+            message += ".  Type is ";
+            message += (m_luaType == LUA_TNONE) ? "no value" : lua_typename(nullptr, m_luaType);
+            return message;
+        }
+
+        case LuaErrorCode::kRuntimeError:
+        case LuaErrorCode::kMemoryError:
+        {
+            luastl::string message = (m_code == LuaErrorCode::kMemoryError) ? "Lua Memory Error:\n" : "Lua Exception:\n";
+            if (m_errorObject.IsString())
+                message += m_errorObject.GetString();
+            else
+                message += "Error object is of type " + m_errorObject.GetTypeNameStr();
+            return message;
+        }
+    }
+
+    return "Unknown error.";
+}
+
+}  // end namespace BleachLua
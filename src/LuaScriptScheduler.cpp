@@ -0,0 +1,315 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaScriptScheduler.h>
+#include <BleachLua/LuaState.h>
+#include <algorithm>
+
+namespace BleachLua {
+
+static constexpr uint32_t kDefaultBudgetMicroseconds = 2000;
+static constexpr uint32_t kDefaultMaxDeferredFrames = 8;
+
+LuaScriptScheduler::LuaScriptScheduler(LuaState* pState)
+    : m_pState(pState)
+    , m_currentTime(0)
+    , m_freeHead(kNil)
+    , m_budgetMicroseconds(kDefaultBudgetMicroseconds)
+    , m_maxDeferredFrames(kDefaultMaxDeferredFrames)
+    , m_isUpdating(false)
+{
+    LUA_ASSERT(pState);
+    m_classStats.emplace_back();  // class 0 is for tasks without a class
+}
+
+LuaScriptScheduler::~LuaScriptScheduler()
+{
+    lua_State* pState = m_pState->GetState();
+    for (const Task& task : m_tasks)
+        luaL_unref(pState, LUA_REGISTRYINDEX, task.m_ref);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Adds a task.
+//      -function:          The Lua function to call.  It's called with the seconds since it last ran.
+//      -priority:          Higher priorities run first when the budget is tight.
+//      -intervalSeconds:   How often the task should run.  0 means every frame.
+//      -taskClass:         The class the task's stats are recorded under.
+//      -return:            The id of the task, or kInvalidTaskId if function isn't a function.
+//---------------------------------------------------------------------------------------------------------------------
+LuaScriptScheduler::TaskId LuaScriptScheduler::AddTask(const LuaVar& function, int priority, float intervalSeconds, StringId taskClass)
+{
+    if (!function.IsFunction())
+    {
+        LUA_ERROR("Attempting to schedule a task that isn't a function.  Type is " + function.GetTypeNameStr());
+        return kInvalidTaskId;
+    }
+
+    uint32_t index;
+    if (m_freeHead != kNil)
+    {
+        index = m_freeHead;
+        m_freeHead = m_tasks[index].m_nextFree;
+    }
+    else
+    {
+        LUA_ASSERT_MSG(m_tasks.size() < (1u << kIndexBits), "Too many scheduled tasks");
+        index = static_cast<uint32_t>(m_tasks.size());
+        m_tasks.emplace_back();
+        m_tasks.back().m_generation = 1;
+    }
+
+    lua_State* pState = m_pState->GetState();
+    Task& task = m_tasks[index];
+    function.PushValueToStack();                                            //  [func]
+    task.m_ref = luaL_ref(pState, LUA_REGISTRYINDEX);                       //  []
+    task.m_priority = priority;
+    task.m_interval = std::max(0.0, static_cast<double>(intervalSeconds));
+    task.m_lastRunTime = m_currentTime;
+    task.m_framesDeferred = 0;
+    task.m_classIndex = GetClassIndex(taskClass);
+    task.m_nextFree = kNil;
+
+    return (task.m_generation << kIndexBits) | index;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Removes a task.  This is safe to call from inside a task, including the one being removed.
+//      -id:        The id returned by AddTask().
+//      -return:    true if the task was removed, false if it didn't exist.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaScriptScheduler::RemoveTask(TaskId id)
+{
+    Task* pTask = FindTask(id);
+    if (!pTask)
+        return false;
+
+    luaL_unref(m_pState->GetState(), LUA_REGISTRYINDEX, pTask->m_ref);
+    pTask->m_ref = LUA_NOREF;
+    pTask->m_generation = (pTask->m_generation + 1) & ((1u << (32 - kIndexBits)) - 1);
+    if (pTask->m_generation == 0)  // keeps the id from ever being 0
+        pTask->m_generation = 1;
+
+    const uint32_t index = id & ((1u << kIndexBits) - 1);
+    pTask->m_nextFree = m_freeHead;
+    m_freeHead = index;
+    return true;
+}
+
+bool LuaScriptScheduler::SetTaskPriority(TaskId id, int priority)
+{
+    Task* pTask = FindTask(id);
+    if (!pTask)
+        return false;
+    pTask->m_priority = priority;
+    return true;
+}
+
+size_t LuaScriptScheduler::GetNumTasks() const
+{
+    return std::count_if(m_tasks.begin(), m_tasks.end(), [](const Task& task) { return task.m_ref != LUA_NOREF; });
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Runs the tasks that are due this frame, within the budget.
+//      -deltaSeconds:  The frame time.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaScriptScheduler::Update(double deltaSeconds)
+{
+    if (m_isUpdating)
+    {
+        LUA_ERROR("LuaScriptScheduler::Update() can't be called from inside a task.");
+        return;
+    }
+
+    const Clock::time_point frameStart = Clock::now();
+    m_currentTime += deltaSeconds;
+    m_lastFrameStats = FrameStats();
+
+    // gather the due tasks
+    m_dueTasks.clear();
+    for (uint32_t index = 0; index < static_cast<uint32_t>(m_tasks.size()); ++index)
+    {
+        const Task& task = m_tasks[index];
+        if (task.m_ref != LUA_NOREF && m_currentTime - task.m_lastRunTime >= task.m_interval)
+            m_dueTasks.push_back(DueTask{ index, task.m_generation });
+    }
+    if (m_dueTasks.empty())
+        return;
+
+    // Starving tasks go first, then by priority, then the tasks that have waited the most frames, which makes tasks 
+    // of equal priority take turns.
+    const uint32_t maxDeferredFrames = m_maxDeferredFrames;
+    std::sort(m_dueTasks.begin(), m_dueTasks.end(), [this, maxDeferredFrames](const DueTask& leftDue, const DueTask& rightDue)
+    {
+        const Task& left = m_tasks[leftDue.m_index];
+        const Task& right = m_tasks[rightDue.m_index];
+        const bool leftStarving = left.m_framesDeferred >= maxDeferredFrames;
+        const bool rightStarving = right.m_framesDeferred >= maxDeferredFrames;
+        if (leftStarving != rightStarving)
+            return leftStarving;
+        if (left.m_priority != right.m_priority)
+            return left.m_priority > right.m_priority;
+        if (left.m_framesDeferred != right.m_framesDeferred)
+            return left.m_framesDeferred > right.m_framesDeferred;
+        return leftDue.m_index < rightDue.m_index;
+    });
+
+    DispatchContext context;
+    context.m_pScheduler = this;
+    context.m_next = 0;
+    context.m_numStarving = std::count_if(m_dueTasks.begin(), m_dueTasks.end(), [this, maxDeferredFrames](const DueTask& due)
+    {
+        return m_tasks[due.m_index].m_framesDeferred >= maxDeferredFrames;
+    });
+    context.m_deadline = frameStart + std::chrono::microseconds(m_budgetMicroseconds);
+    m_lastFrameStats.m_numDue = static_cast<uint32_t>(m_dueTasks.size());
+
+    lua_State* pState = m_pState->GetState();
+    m_isUpdating = true;
+    while (context.m_next < m_dueTasks.size())
+    {
+        lua_pushcfunction(pState, &CallDueTasks);                           //  [func]
+        lua_pushlightuserdata(pState, &context);                            //  [func, context]
+        if (Debug::ProtectedCall(pState, 1, 0, 0) != LUA_OK)               //  [] or [error]
+        {
+            // the failed task still used up its time
+            RecordRun(context.m_taskClassIndex, context.m_taskStart, Clock::now());
+            LUA_ERROR(luastl::string("Scheduled task failed: ") + (lua_tostring(pState, -1) ? lua_tostring(pState, -1) : "(error object is not a string)"));
+            lua_pop(pState, 1);                                             //  []
+        }
+        else
+        {
+            break;  // either everything ran or the budget ran out
+        }
+    }
+    m_isUpdating = false;
+
+    // everything that didn't get a turn waits for a later frame
+    for (size_t i = context.m_next; i < m_dueTasks.size(); ++i)
+    {
+        Task& task = m_tasks[m_dueTasks[i].m_index];
+        if (task.m_ref == LUA_NOREF || task.m_generation != m_dueTasks[i].m_generation)
+            continue;
+        ++task.m_framesDeferred;
+        ++m_classStats[task.m_classIndex].m_numDeferred;
+        ++m_lastFrameStats.m_numDeferred;
+    }
+
+    m_lastFrameStats.m_microseconds = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - frameStart).count());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The protected part of Update().  This runs due tasks until the budget runs out, always running the starving ones and 
+// at least one task per frame so something makes progress.  m_next is advanced before each call, so after an error 
+// Update() resumes with the next task.
+//---------------------------------------------------------------------------------------------------------------------
+int LuaScriptScheduler::CallDueTasks(lua_State* pState)
+{
+    DispatchContext* pContext = static_cast<DispatchContext*>(lua_touserdata(pState, 1));
+    LuaScriptScheduler* pScheduler = pContext->m_pScheduler;
+
+    while (pContext->m_next < pScheduler->m_dueTasks.size())
+    {
+        const Clock::time_point now = Clock::now();
+        const bool mustRun = pContext->m_next < pContext->m_numStarving || pScheduler->m_lastFrameStats.m_numRun == 0;
+        if (!mustRun && now >= pContext->m_deadline)
+            break;
+
+        const DueTask due = pScheduler->m_dueTasks[pContext->m_next++];
+        Task& task = pScheduler->m_tasks[due.m_index];
+        if (task.m_ref == LUA_NOREF || task.m_generation != due.m_generation)  // removed by an earlier task this frame
+            continue;
+
+        if (now >= pContext->m_deadline)
+            ++pScheduler->m_lastFrameStats.m_numForced;
+        ++pScheduler->m_lastFrameStats.m_numRun;
+
+        const double elapsed = pScheduler->m_currentTime - task.m_lastRunTime;
+        task.m_lastRunTime = pScheduler->m_currentTime;
+        task.m_framesDeferred = 0;
+
+        lua_rawgeti(pState, LUA_REGISTRYINDEX, task.m_ref);                 //  [context, func]
+        lua_pushnumber(pState, static_cast<lua_Number>(elapsed));           //  [context, func, elapsed]
+        pContext->m_taskStart = now;
+        pContext->m_taskClassIndex = task.m_classIndex;  // the task may remove itself, so don't read it after the call
+        lua_call(pState, 1, 0);                                             //  [context]
+        pScheduler->RecordRun(pContext->m_taskClassIndex, now, Clock::now());
+    }
+    return 0;
+}
+
+void LuaScriptScheduler::RecordRun(uint32_t classIndex, Clock::time_point start, Clock::time_point end)
+{
+    const uint32_t microseconds = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    ClassStats& stats = m_classStats[classIndex];
+    ++stats.m_numRuns;
+    stats.m_totalMicroseconds += microseconds;
+    stats.m_maxMicroseconds = std::max(stats.m_maxMicroseconds, microseconds);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Returns the stats for a task class, accumulated since the scheduler was created or ResetStats() was called.
+//---------------------------------------------------------------------------------------------------------------------
+LuaScriptScheduler::ClassStats LuaScriptScheduler::GetClassStats(StringId taskClass) const
+{
+    auto findIt = m_classIndices.find(taskClass.GetHash());
+    if (findIt != m_classIndices.end())
+        return m_classStats[findIt->second];
+    return taskClass.IsValid() ? ClassStats() : m_classStats[0];
+}
+
+void LuaScriptScheduler::ResetStats()
+{
+    for (ClassStats& stats : m_classStats)
+        stats = ClassStats();
+    m_lastFrameStats = FrameStats();
+}
+
+LuaScriptScheduler::Task* LuaScriptScheduler::FindTask(TaskId id)
+{
+    const uint32_t index = id & ((1u << kIndexBits) - 1);
+    const uint32_t generation = id >> kIndexBits;
+    if (index >= m_tasks.size())
+        return nullptr;
+
+    Task& task = m_tasks[index];
+    return (task.m_generation == generation && task.m_ref != LUA_NOREF) ? &task : nullptr;
+}
+
+uint32_t LuaScriptScheduler::GetClassIndex(StringId taskClass)
+{
+    if (!taskClass.IsValid())
+        return 0;
+
+    auto findIt = m_classIndices.find(taskClass.GetHash());
+    if (findIt != m_classIndices.end())
+        return findIt->second;
+
+    const uint32_t index = static_cast<uint32_t>(m_classStats.size());
+    m_classStats.emplace_back();
+    m_classIndices[taskClass.GetHash()] = index;
+    return index;
+}
+
+}  // end namespace BleachLua
@@ -0,0 +1,284 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaStringBuilder.h>
+#include <BleachLua/LuaState.h>
+#include <BleachLua/LuaNoThrow.h>
+#include <stdio.h>
+#include <new>
+
+namespace BleachLua {
+
+static constexpr const char* kStringBuilderMetatable = "BleachLua.StringBuilder";
+
+// The userdata's memory.  __gc marks the builder as destroyed, since scripts can call it (or a finalizer can 
+// resurrect the userdata) and the block outlives the C++ object.
+struct StringBuilderBlock
+{
+    alignas(LuaStringBuilder) unsigned char m_storage[sizeof(LuaStringBuilder)];
+    bool m_isAlive;
+
+    LuaStringBuilder* GetBuilder() { return reinterpret_cast<LuaStringBuilder*>(m_storage); }
+};
+
+static StringBuilderBlock* CheckStringBuilderBlock(lua_State* pState, int stackIndex)
+{
+    return static_cast<StringBuilderBlock*>(luaL_checkudata(pState, stackIndex, kStringBuilderMetatable));
+}
+
+static LuaStringBuilder* CheckStringBuilder(lua_State* pState, int stackIndex)
+{
+    StringBuilderBlock* pBlock = CheckStringBuilderBlock(pState, stackIndex);
+    if (!pBlock->m_isAlive)
+        luaL_error(pState, "attempt to use a destroyed string builder");
+    return pBlock->GetBuilder();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Appends a number without creating a Lua string for it.
+//      -value:     The number to append.
+//      -precision: The number of digits after the decimal point, or -1 to use the same format Lua uses when it 
+//                  converts numbers to strings.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaStringBuilder::AppendNumber(lua_Number value, int precision /*= -1*/)
+{
+    char buffer[64];
+    int length;
+    if (precision >= 0)
+        length = snprintf(buffer, sizeof(buffer), "%.*f", precision, static_cast<double>(value));
+    else
+        length = snprintf(buffer, sizeof(buffer), LUA_NUMBER_FMT, static_cast<double>(value));
+
+    if (length <= 0)
+        return;
+    m_buffer.append(buffer, static_cast<size_t>(length) < sizeof(buffer) ? static_cast<size_t>(length) : sizeof(buffer) - 1);
+
+#if BLEACHLUA_CORE_VERSION >= 53
+    // Lua 5.3+ adds ".0" to floats that would otherwise look like integers, so we do the same.
+    if (precision < 0 && buffer[strspn(buffer, "-0123456789")] == '\0')
+        m_buffer.append(".0", 2);
+#endif
+}
+
+void LuaStringBuilder::AppendInteger(lua_Integer value)
+{
+    char buffer[32];
+    const int length = snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(value));
+    if (length > 0)
+        m_buffer.append(buffer, static_cast<size_t>(length));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Lua functions
+//---------------------------------------------------------------------------------------------------------------------
+// sb:append(...) -> sb; each argument must be a string or a number
+static int StringBuilderAppend(lua_State* pState)
+{
+    LuaStringBuilder* pBuilder = CheckStringBuilder(pState, 1);
+    const int top = lua_gettop(pState);
+    for (int i = 2; i <= top; ++i)
+    {
+        size_t length = 0;
+        const char* pStr = luaL_checklstring(pState, i, &length);
+        CallNoThrow(pState, "append", [=]() { pBuilder->Append(pStr, length); });
+    }
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// sb:appendf(format, ...) -> sb; upvalue 1 is string.format()
+static int StringBuilderAppendFormat(lua_State* pState)
+{
+    LuaStringBuilder* pBuilder = CheckStringBuilder(pState, 1);
+    luaL_checkstring(pState, 2);
+
+    const int numArgs = lua_gettop(pState) - 1;
+    lua_pushvalue(pState, lua_upvalueindex(1));     //  [sb, format, args..., string.format]
+    lua_insert(pState, 2);                          //  [sb, string.format, format, args...]
+    lua_call(pState, numArgs, 1);                   //  [sb, result]
+
+    size_t length = 0;
+    const char* pStr = lua_tolstring(pState, -1, &length);
+    CallNoThrow(pState, "appendf", [=]() { pBuilder->Append(pStr, length); });
+    lua_settop(pState, 1);                          //  [sb]
+    return 1;
+}
+
+// sb:append_number(number [, precision]) -> sb
+static int StringBuilderAppendNumber(lua_State* pState)
+{
+    LuaStringBuilder* pBuilder = CheckStringBuilder(pState, 1);
+    const lua_Number value = luaL_checknumber(pState, 2);
+    const int precision = static_cast<int>(luaL_optinteger(pState, 3, -1));
+
+#if BLEACHLUA_CORE_VERSION >= 53
+    if (precision < 0 && lua_isinteger(pState, 2))
+    {
+        const lua_Integer integer = lua_tointeger(pState, 2);
+        CallNoThrow(pState, "append_number", [=]() { pBuilder->AppendInteger(integer); });
+    }
+    else
+#endif
+    {
+        CallNoThrow(pState, "append_number", [=]() { pBuilder->AppendNumber(value, precision); });
+    }
+
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// sb:clear() -> sb
+static int StringBuilderClear(lua_State* pState)
+{
+    CheckStringBuilder(pState, 1)->Clear();
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// sb:tostring() -> string; also used for __tostring
+static int StringBuilderToString(lua_State* pState)
+{
+    const luastl::string_view view = CheckStringBuilder(pState, 1)->GetView();
+    lua_pushlstring(pState, view.data(), view.size());
+    return 1;
+}
+
+// #sb -> number of bytes
+static int StringBuilderLen(lua_State* pState)
+{
+    lua_pushinteger(pState, static_cast<lua_Integer>(CheckStringBuilder(pState, 1)->GetSize()));
+    return 1;
+}
+
+// bleach.StringBuilder([reserveSize]) -> sb
+static int StringBuilderNew(lua_State* pState)
+{
+    const lua_Integer reserveSize = luaL_optinteger(pState, 1, 0);
+    luaL_argcheck(pState, reserveSize >= 0, 1, "reserve size must not be negative");
+    luaL_argcheck(pState, static_cast<lua_Unsigned>(reserveSize) <= luastl::string().max_size(), 1, "reserve size is too large");
+    LuaStringBuilder::PushNew(pState, static_cast<size_t>(reserveSize));
+    return 1;
+}
+
+// __gc; the buffer is a C++ object, so its destructor has to be called explicitly, and only once
+static int StringBuilderGc(lua_State* pState)
+{
+    StringBuilderBlock* pBlock = CheckStringBuilderBlock(pState, 1);
+    if (pBlock->m_isAlive)
+    {
+        pBlock->m_isAlive = false;
+        pBlock->GetBuilder()->~LuaStringBuilder();
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaStringBuilder
+//---------------------------------------------------------------------------------------------------------------------
+LuaStringBuilder* LuaStringBuilder::PushNew(lua_State* pState, size_t reserveSize /*= 0*/)
+{
+    StringBuilderBlock* pBlock = static_cast<StringBuilderBlock*>(Compat::NewUserData(pState, sizeof(StringBuilderBlock)));  //  [sb]
+    pBlock->m_isAlive = false;
+    LuaStringBuilder* pBuilder = nullptr;
+    CallNoThrow(pState, "StringBuilder", [&]() { pBuilder = new (pBlock->m_storage) LuaStringBuilder(reserveSize); });
+    pBlock->m_isAlive = true;
+
+    luaL_getmetatable(pState, kStringBuilderMetatable);                             //  [sb, mt?]
+    LUA_ASSERT_MSG(lua_istable(pState, -1), "OpenStringBuilderLib() must be called before creating string builders.");
+    lua_setmetatable(pState, -2);                                                   //  [sb]
+    return pBuilder;
+}
+
+LuaVar LuaStringBuilder::Create(LuaState* pState, size_t reserveSize /*= 0*/)
+{
+    LUA_ASSERT(pState);
+    PushNew(pState->GetState(), reserveSize);
+    return LuaVar::CreateFromStack(pState);
+}
+
+LuaStringBuilder* LuaStringBuilder::FromStack(lua_State* pState, int stackIndex)
+{
+    StringBuilderBlock* pBlock = static_cast<StringBuilderBlock*>(luaL_testudata(pState, stackIndex, kStringBuilderMetatable));
+    return (pBlock && pBlock->m_isAlive) ? pBlock->GetBuilder() : nullptr;
+}
+
+LuaStringBuilder* LuaStringBuilder::FromVar(const LuaVar& var)
+{
+    if (!var.PushValueToStack(false))                                       //  [var]
+        return nullptr;
+
+    lua_State* pState = var.GetLuaState()->GetState();
+    LuaStringBuilder* pBuilder = FromStack(pState, -1);
+    lua_pop(pState, 1);                                                     //  []
+    return pBuilder;  // the memory is owned by the userdata, which var keeps alive
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Registers the string builder metatable and adds its constructor to the BleachLua library table.  The string 
+// library must already be open since appendf() uses string.format().
+//      -pState:    The Lua state.
+//---------------------------------------------------------------------------------------------------------------------
+void OpenStringBuilderLib(LuaState* pState)
+{
+    LUA_ASSERT(pState);
+    LuaVar lib = pState->GetGlobals().GetOrCreateNewTable(BLEACHLUA_LIB_TABLE_NAME);
+    lua_State* pLuaState = pState->GetState();
+
+    lib.PushValueToStack();                                                 //  [lib]
+    luaL_newmetatable(pLuaState, kStringBuilderMetatable);                  //  [lib, mt]
+
+    // methods
+    lua_createtable(pLuaState, 0, 6);                                       //  [lib, mt, methods]
+    lua_pushcfunction(pLuaState, &StringBuilderAppend);
+    lua_setfield(pLuaState, -2, "append");
+    lua_getglobal(pLuaState, "string");                                     //  [lib, mt, methods, string]
+    LUA_ASSERT_MSG(lua_istable(pLuaState, -1), "The string library must be open before calling OpenStringBuilderLib().");
+    lua_getfield(pLuaState, -1, "format");                                  //  [lib, mt, methods, string, format]
+    lua_remove(pLuaState, -2);                                              //  [lib, mt, methods, format]
+    lua_pushcclosure(pLuaState, &StringBuilderAppendFormat, 1);             //  [lib, mt, methods, appendf]
+    lua_setfield(pLuaState, -2, "appendf");                                 //  [lib, mt, methods]
+    lua_pushcfunction(pLuaState, &StringBuilderAppendNumber);
+    lua_setfield(pLuaState, -2, "append_number");
+    lua_pushcfunction(pLuaState, &StringBuilderClear);
+    lua_setfield(pLuaState, -2, "clear");
+    lua_pushcfunction(pLuaState, &StringBuilderToString);
+    lua_setfield(pLuaState, -2, "tostring");
+    lua_setfield(pLuaState, -2, "__index");                                 //  [lib, mt]
+
+    // metamethods
+    lua_pushcfunction(pLuaState, &StringBuilderToString);
+    lua_setfield(pLuaState, -2, "__tostring");
+    lua_pushcfunction(pLuaState, &StringBuilderLen);
+    lua_setfield(pLuaState, -2, "__len");
+    lua_pushcfunction(pLuaState, &StringBuilderGc);
+    lua_setfield(pLuaState, -2, "__gc");
+    lua_pushboolean(pLuaState, 0);                                          //  [lib, mt, false]
+    lua_setfield(pLuaState, -2, "__metatable");                             //  [lib, mt]
+    lua_pop(pLuaState, 1);                                                  //  [lib]
+
+    lua_pushcfunction(pLuaState, &StringBuilderNew);                        //  [lib, ctor]
+    lua_setfield(pLuaState, -2, "StringBuilder");                           //  [lib]
+    lua_pop(pLuaState, 1);                                                  //  []
+}
+
+}  // end namespace BleachLua
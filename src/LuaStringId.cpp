@@ -0,0 +1,170 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaStringId.h>
+#include <BleachLua/LuaState.h>
+
+namespace BleachLua {
+
+//---------------------------------------------------------------------------------------------------------------------
+// The global interning table.  The map is node-based, so the string pointers handed out by GetString() stay valid 
+// for the life of the program.
+//---------------------------------------------------------------------------------------------------------------------
+static luastl::unordered_map<StringId::HashType, luastl::string>& GetInternTable()
+{
+    static luastl::unordered_map<StringId::HashType, luastl::string> s_internTable;
+    return s_internTable;
+}
+
+static void AddToInternTable(StringId::HashType hash, luastl::string_view str)
+{
+    auto& internTable = GetInternTable();
+    auto findIt = internTable.find(hash);
+    if (findIt == internTable.end())
+    {
+        internTable.emplace(hash, luastl::string(str.data(), str.size()));
+        return;
+    }
+
+#if BLEACHLUA_DEBUG_CHECKS
+    if (luastl::string_view(findIt->second.data(), findIt->second.size()) != str)
+        LUA_ERROR("StringId collision: \"" + findIt->second + "\" and \"" + luastl::string(str.data(), str.size()) + "\" have the same hash.");
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// StringId
+//---------------------------------------------------------------------------------------------------------------------
+StringId::StringId(luastl::string_view str)
+    : m_hash(Hash(str))
+{
+#if BLEACHLUA_DEBUG_MODE
+    AddToInternTable(m_hash, str);
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Hashes a string and adds it to the global interning table so the id can be turned back into a string.
+//      -str:       The string to intern.
+//      -return:    The id.
+//---------------------------------------------------------------------------------------------------------------------
+StringId StringId::Intern(luastl::string_view str)
+{
+    const StringId id(Hash(str));
+    AddToInternTable(id.m_hash, str);
+    return id;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Looks up the string this id was made from.
+//      -return:    The string, or nullptr if it was never interned.
+//---------------------------------------------------------------------------------------------------------------------
+const char* StringId::GetString() const
+{
+    const auto& internTable = GetInternTable();
+    auto findIt = internTable.find(m_hash);
+    return (findIt != internTable.end()) ? findIt->second.c_str() : nullptr;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaTraits<StringId>
+//---------------------------------------------------------------------------------------------------------------------
+static void PushStringId(lua_State* pState, StringId id)
+{
+    // 64-bit hashes are reinterpreted as signed so every bit survives the round trip
+    lua_pushinteger(pState, static_cast<lua_Integer>(id.GetHash()));
+}
+
+static StringId ToStringId(lua_State* pState, int stackIndex)
+{
+    if (lua_type(pState, stackIndex) == LUA_TSTRING)
+    {
+        size_t length = 0;
+        const char* str = lua_tolstring(pState, stackIndex, &length);
+        return StringId(luastl::string_view(str, length));
+    }
+    return StringId(static_cast<StringId::HashType>(lua_tointeger(pState, stackIndex)));
+}
+
+void LuaTraits<StringId>::Push(LuaState* pState, const StringId& value)
+{
+    LUA_ASSERT(pState);
+    PushStringId(pState->GetState(), value);
+}
+
+StringId LuaTraits<StringId>::Get(LuaState* pState, int stackIndex)
+{
+    LUA_ASSERT(pState);
+    return ToStringId(pState->GetState(), stackIndex);
+}
+
+bool LuaTraits<StringId>::Is(LuaState* pState, int stackIndex)
+{
+    LUA_ASSERT(pState);
+    const int type = lua_type(pState->GetState(), stackIndex);
+    return type == LUA_TNUMBER || type == LUA_TSTRING;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Library functions
+//---------------------------------------------------------------------------------------------------------------------
+// bleach.string_id(name) -> integer id; the name is interned so string_id_name() can find it
+static int StringIdFromName(lua_State* pState)
+{
+    size_t length = 0;
+    const char* name = luaL_checklstring(pState, 1, &length);
+    PushStringId(pState, StringId::Intern(luastl::string_view(name, length)));
+    return 1;
+}
+
+// bleach.string_id_name(id) -> name, or nil if it was never interned
+static int StringIdToName(lua_State* pState)
+{
+    const StringId id(static_cast<StringId::HashType>(luaL_checkinteger(pState, 1)));
+    const char* name = id.GetString();
+    if (!name)
+        return 0;
+
+    lua_pushstring(pState, name);
+    return 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Adds string_id() and string_id_name() to the BleachLua library table.
+//      -pState:    The Lua state.
+//---------------------------------------------------------------------------------------------------------------------
+void OpenStringIdLib(LuaState* pState)
+{
+    LUA_ASSERT(pState);
+    LuaVar lib = pState->GetGlobals().GetOrCreateNewTable(BLEACHLUA_LIB_TABLE_NAME);
+
+    lua_State* pLuaState = pState->GetState();
+    lib.PushValueToStack();                                                 //  [lib]
+    lua_pushcfunction(pLuaState, &StringIdFromName);                        //  [lib, func]
+    lua_setfield(pLuaState, -2, "string_id");                               //  [lib]
+    lua_pushcfunction(pLuaState, &StringIdToName);                          //  [lib, func]
+    lua_setfield(pLuaState, -2, "string_id_name");                          //  [lib]
+    lua_pop(pLuaState, 1);                                                  //  []
+}
+
+}  // end namespace BleachLua
@@ -0,0 +1,295 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaTablePool.h>
+#include <BleachLua/LuaState.h>
+#include <BleachLua/LuaCompat.h>
+
+namespace BleachLua {
+
+//---------------------------------------------------------------------------------------------------------------------
+// Constructor.
+//      -pState:        The state the tables belong to.
+//      -arraySize:     The array size new tables are created with.
+//      -hashSize:      The hash size new tables are created with.
+//      -maxFree:       The most free tables the pool will hold on to.  Tables released beyond that are left for the 
+//                      garbage collector.
+//---------------------------------------------------------------------------------------------------------------------
+LuaTablePool::LuaTablePool(LuaState* pState, int arraySize, int hashSize, int maxFree)
+    : m_pState(pState)
+    , m_numFree(0)
+    , m_maxFree(maxFree)
+    , m_arraySize(arraySize)
+    , m_hashSize(hashSize)
+    , m_numCreated(0)
+{
+    LUA_ASSERT(pState);
+    lua_State* pLuaState = m_pState->GetState();
+    lua_createtable(pLuaState, maxFree, 0);                                 //  [free]
+    m_freeTablesRef = luaL_ref(pLuaState, LUA_REGISTRYINDEX);               //  []
+
+    lua_newtable(pLuaState);                                                //  [owned]
+    lua_createtable(pLuaState, 0, 1);                                       //  [owned, mt]
+    lua_pushliteral(pLuaState, "k");                                        //  [owned, mt, "k"]
+    lua_setfield(pLuaState, -2, "__mode");                                  //  [owned, mt]
+    lua_setmetatable(pLuaState, -2);                                        //  [owned]
+    m_ownedTablesRef = luaL_ref(pLuaState, LUA_REGISTRYINDEX);              //  []
+}
+
+LuaTablePool::~LuaTablePool()
+{
+    lua_State* pLuaState = m_pState->GetState();
+    luaL_unref(pLuaState, LUA_REGISTRYINDEX, m_freeTablesRef);
+    luaL_unref(pLuaState, LUA_REGISTRYINDEX, m_ownedTablesRef);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Returns an empty table, reusing a free one if there is one.
+//---------------------------------------------------------------------------------------------------------------------
+LuaVar LuaTablePool::Acquire()
+{
+    PushAcquired(m_pState->GetState());                                     //  [t]
+    return LuaVar::CreateFromStack(m_pState);                               //  []
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Clears a table and returns it to the pool.  The variable is set to nil.
+//      -table:     The table to release.  It must have come from Acquire() and not have been released since; anything 
+//                  else is an error and is left untouched.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaTablePool::Release(LuaVar& table)
+{
+    lua_State* pLuaState = m_pState->GetState();
+    table.PushValueToStack();                                               //  [t]
+    if (!IsAcquired(pLuaState, -1))
+    {
+        lua_pop(pLuaState, 1);                                              //  []
+        LUA_ERROR("Attempting to release a table that wasn't acquired from this LuaTablePool, or was already released.");
+        return;
+    }
+
+    ReleaseFromStack(pLuaState, -1);
+    lua_pop(pLuaState, 1);                                                  //  []
+    table.SetNil();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Creates tables up front so the first frames don't have to.
+//      -count:     The number of free tables the pool should have, capped at the pool's maximum.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaTablePool::Prewarm(int count)
+{
+    lua_State* pLuaState = m_pState->GetState();
+    while (m_numFree < count && m_numFree < m_maxFree)
+    {
+        lua_createtable(pLuaState, m_arraySize, m_hashSize);                //  [t]
+        ++m_numCreated;
+        AddFreeTable(pLuaState, -1);
+        lua_pop(pLuaState, 1);                                              //  []
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Drops all the free tables so the garbage collector can have them.  Tables that are handed out can still be released.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaTablePool::Clear()
+{
+    lua_State* pLuaState = m_pState->GetState();
+    lua_rawgeti(pLuaState, LUA_REGISTRYINDEX, m_freeTablesRef);             //  [free]
+    lua_rawgeti(pLuaState, LUA_REGISTRYINDEX, m_ownedTablesRef);            //  [free, owned]
+    for (int i = 1; i <= m_numFree; ++i)
+    {
+        lua_rawgeti(pLuaState, -2, i);                                      //  [free, owned, t]
+        lua_pushnil(pLuaState);                                             //  [free, owned, t, nil]
+        lua_rawset(pLuaState, -3);                                          //  [free, owned]
+        lua_pushnil(pLuaState);                                             //  [free, owned, nil]
+        lua_rawseti(pLuaState, -3, i);                                      //  [free, owned]
+    }
+    lua_pop(pLuaState, 2);                                                  //  []
+    m_numFree = 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Pushes a free table, or a new one if the pool is empty, and marks it as handed out.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaTablePool::PushAcquired(lua_State* pState)
+{
+    if (m_numFree == 0)
+    {
+        lua_createtable(pState, m_arraySize, m_hashSize);                   //  [t]
+        ++m_numCreated;
+    }
+    else
+    {
+        lua_rawgeti(pState, LUA_REGISTRYINDEX, m_freeTablesRef);            //  [free]
+        lua_rawgeti(pState, -1, m_numFree);                                 //  [free, t]
+        lua_pushnil(pState);                                                //  [free, t, nil]
+        lua_rawseti(pState, -3, m_numFree);                                 //  [free, t]
+        lua_remove(pState, -2);                                             //  [t]
+        --m_numFree;
+    }
+    SetOwnedState(pState, -1, true);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Returns true if the value at stackIndex is a table this pool handed out that hasn't been released yet.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaTablePool::IsAcquired(lua_State* pState, int stackIndex) const
+{
+    if (lua_type(pState, stackIndex) != LUA_TTABLE)
+        return false;
+
+    if (stackIndex < 0)  // lua_absindex() isn't in 5.1
+        stackIndex = lua_gettop(pState) + stackIndex + 1;
+    lua_rawgeti(pState, LUA_REGISTRYINDEX, m_ownedTablesRef);               //  [owned]
+    lua_pushvalue(pState, stackIndex);                                      //  [owned, t]
+    lua_rawget(pState, -2);                                                 //  [owned, isAcquired]
+    const bool isAcquired = lua_toboolean(pState, -1) != 0;
+    lua_pop(pState, 2);                                                     //  []
+    return isAcquired;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Clears the table at stackIndex and adds it to the free list, or forgets it if the pool is full.  The table stays on 
+// the stack.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaTablePool::ReleaseFromStack(lua_State* pState, int stackIndex)
+{
+    LUA_ASSERT(IsAcquired(pState, stackIndex));
+    if (stackIndex < 0)
+        stackIndex = lua_gettop(pState) + stackIndex + 1;
+
+    ClearTable(pState, stackIndex);
+    lua_pushnil(pState);                                                    //  [nil]
+    lua_setmetatable(pState, stackIndex);                                   //  []
+
+    if (m_numFree < m_maxFree)
+    {
+        AddFreeTable(pState, stackIndex);
+        return;
+    }
+
+    // the pool is full, so this one is left for the garbage collector
+    lua_rawgeti(pState, LUA_REGISTRYINDEX, m_ownedTablesRef);               //  [owned]
+    lua_pushvalue(pState, stackIndex);                                      //  [owned, t]
+    lua_pushnil(pState);                                                    //  [owned, t, nil]
+    lua_rawset(pState, -3);                                                 //  [owned]
+    lua_pop(pState, 1);                                                     //  []
+}
+
+void LuaTablePool::AddFreeTable(lua_State* pState, int stackIndex)
+{
+    if (stackIndex < 0)
+        stackIndex = lua_gettop(pState) + stackIndex + 1;
+
+    ++m_numFree;
+    lua_rawgeti(pState, LUA_REGISTRYINDEX, m_freeTablesRef);                //  [free]
+    lua_pushvalue(pState, stackIndex);                                      //  [free, t]
+    lua_rawseti(pState, -2, m_numFree);                                     //  [free]
+    lua_pop(pState, 1);                                                     //  []
+    SetOwnedState(pState, stackIndex, false);
+}
+
+void LuaTablePool::SetOwnedState(lua_State* pState, int stackIndex, bool isAcquired) const
+{
+    if (stackIndex < 0)
+        stackIndex = lua_gettop(pState) + stackIndex + 1;
+
+    lua_rawgeti(pState, LUA_REGISTRYINDEX, m_ownedTablesRef);               //  [owned]
+    lua_pushvalue(pState, stackIndex);                                      //  [owned, t]
+    lua_pushboolean(pState, isAcquired ? 1 : 0);                            //  [owned, t, isAcquired]
+    lua_rawset(pState, -3);                                                 //  [owned]
+    lua_pop(pState, 1);                                                     //  []
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Sets every field of a table to nil with raw writes, which leaves its array and hash parts allocated.  The array part 
+// is cleared with a plain loop and the rest with lua_next(), which allows existing fields to be cleared as it goes.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaTablePool::ClearTable(lua_State* pState, int stackIndex)
+{
+    const lua_Integer length = static_cast<lua_Integer>(Compat::RawLen(pState, stackIndex));
+    for (lua_Integer i = 1; i <= length; ++i)
+    {
+        lua_pushnil(pState);                                                //  [nil]
+        lua_rawseti(pState, stackIndex, i);                                 //  []
+    }
+
+    lua_pushnil(pState);                                                    //  [nil]
+    while (lua_next(pState, stackIndex))                                    //  [key, value]
+    {
+        lua_pop(pState, 1);                                                 //  [key]
+        lua_pushvalue(pState, -1);                                          //  [key, key]
+        lua_pushnil(pState);                                                //  [key, key, nil]
+        lua_rawset(pState, stackIndex);                                     //  [key]
+    }                                                                       //  []
+}
+
+static LuaTablePool* GetTablePool(lua_State* pState)
+{
+    return static_cast<LuaTablePool*>(lua_touserdata(pState, lua_upvalueindex(1)));
+}
+
+// bleach.pool.acquire() -> table
+static int PoolAcquire(lua_State* pState)
+{
+    GetTablePool(pState)->PushAcquired(pState);
+    return 1;
+}
+
+// bleach.pool.release(t)
+static int PoolRelease(lua_State* pState)
+{
+    luaL_checktype(pState, 1, LUA_TTABLE);
+    LuaTablePool* pPool = GetTablePool(pState);
+    luaL_argcheck(pState, pPool->IsAcquired(pState, 1), 1, "table wasn't acquired from this pool, or was already released");
+    pPool->ReleaseFromStack(pState, 1);
+    return 0;
+}
+
+void OpenTablePoolLib(LuaState* pState, LuaTablePool* pPool)
+{
+    static const luaL_Reg kFunctions[] =
+    {
+        { "acquire", &PoolAcquire },
+        { "release", &PoolRelease },
+        { nullptr, nullptr }
+    };
+
+    LUA_ASSERT(pState);
+    LUA_ASSERT(pPool);
+    LuaVar lib = pState->GetGlobals().GetOrCreateNewTable(BLEACHLUA_LIB_TABLE_NAME);
+    LuaVar poolLib = lib.GetOrCreateNewTable("pool");
+
+    lua_State* pLuaState = pState->GetState();
+    poolLib.PushValueToStack();                                             //  [pool]
+    for (const luaL_Reg* pFunc = kFunctions; pFunc->name; ++pFunc)
+    {
+        lua_pushlightuserdata(pLuaState, pPool);                            //  [pool, tablePool]
+        lua_pushcclosure(pLuaState, pFunc->func, 1);                        //  [pool, func]
+        lua_setfield(pLuaState, -2, pFunc->name);                           //  [pool]
+    }
+    lua_pop(pLuaState, 1);                                                  //  []
+}
+
+}  // end namespace BleachLua
@@ -0,0 +1,520 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaTimerWheel.h>
+#include <BleachLua/LuaState.h>
+#include <algorithm>
+#include <cmath>
+
+namespace BleachLua {
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaTimerWheel
+//---------------------------------------------------------------------------------------------------------------------
+LuaTimerWheel::LuaTimerWheel(LuaState* pState, double tickSeconds)
+    : m_pState(pState)
+    , m_tickSeconds(tickSeconds)
+    , m_accumulatedSeconds(0)
+    , m_currentTick(0)
+    , m_freeHead(kNil)
+    , m_numTimers(0)
+    , m_isDispatching(false)
+{
+    LUA_ASSERT(pState);
+    LUA_ASSERT(tickSeconds > 0);
+    for (uint32_t& head : m_slotHeads)
+        head = kNil;
+}
+
+LuaTimerWheel::~LuaTimerWheel()
+{
+    CancelAll();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Schedules a function to be called once.
+//      -seconds:   How long to wait.  This is rounded up to a whole number of ticks, with a minimum of one.
+//      -function:  The Lua function to call.  It's called with the timer's handle.
+//      -return:    The handle of the timer, or kInvalidTimerHandle if function isn't a function or there are 
+//                  already 2^24 timers.
+//---------------------------------------------------------------------------------------------------------------------
+LuaTimerWheel::TimerHandle LuaTimerWheel::After(double seconds, const LuaVar& function)
+{
+    if (!function.IsFunction())
+    {
+        LUA_ERROR("Attempting to schedule a timer that isn't a function.  Type is " + function.GetTypeNameStr());
+        return kInvalidTimerHandle;
+    }
+
+    lua_State* pState = m_pState->GetState();
+    function.PushValueToStack();                                            //  [func]
+    const TimerHandle handle = ScheduleFromStack(pState, -1, seconds, false);
+    lua_pop(pState, 1);                                                     //  []
+    return handle;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Schedules a function to be called repeatedly until the timer is cancelled.
+//      -seconds:   The interval.  This is rounded up to a whole number of ticks, with a minimum of one.
+//      -function:  The Lua function to call.  It's called with the timer's handle.
+//      -return:    The handle of the timer, or kInvalidTimerHandle if function isn't a function or there are 
+//                  already 2^24 timers.
+//---------------------------------------------------------------------------------------------------------------------
+LuaTimerWheel::TimerHandle LuaTimerWheel::Every(double seconds, const LuaVar& function)
+{
+    if (!function.IsFunction())
+    {
+        LUA_ERROR("Attempting to schedule a timer that isn't a function.  Type is " + function.GetTypeNameStr());
+        return kInvalidTimerHandle;
+    }
+
+    lua_State* pState = m_pState->GetState();
+    function.PushValueToStack();                                            //  [func]
+    const TimerHandle handle = ScheduleFromStack(pState, -1, seconds, true);
+    lua_pop(pState, 1);                                                     //  []
+    return handle;
+}
+
+LuaTimerWheel::TimerHandle LuaTimerWheel::ScheduleFromStack(lua_State* pState, int funcIndex, double seconds, bool repeat)
+{
+    const uint32_t ticks = SecondsToTicks(seconds);
+    const uint32_t index = AllocateNode();
+    if (index == kNil)
+    {
+        LUA_ERROR("Too many timers.  Handles only have room for 2^24 at once.");
+        return kInvalidTimerHandle;
+    }
+
+    TimerNode& node = m_nodes[index];
+    lua_pushvalue(pState, funcIndex);                                       //  [func]
+    node.m_ref = luaL_ref(pState, LUA_REGISTRYINDEX);                       //  []
+    node.m_expireTick = m_currentTick + ticks;
+    node.m_intervalTicks = repeat ? ticks : 0;
+    LinkNode(index);
+
+    ++m_numTimers;
+    return MakeHandle(index, node.m_generation);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Cancels a timer.  This is safe to call from inside a timer callback, including the timer's own.
+//      -handle:    The handle returned when the timer was scheduled.
+//      -return:    true if the timer was cancelled, false if it had already fired, been cancelled, or never existed.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaTimerWheel::Cancel(TimerHandle handle)
+{
+    if (!IsPending(handle))
+        return false;
+
+    const uint32_t index = static_cast<uint32_t>(handle & ((1u << kIndexBits) - 1));
+    if (m_nodes[index].m_slot != kUnlinked)
+        UnlinkNode(index);
+    FreeNode(index);
+    return true;
+}
+
+bool LuaTimerWheel::IsPending(TimerHandle handle) const
+{
+    const uint32_t index = static_cast<uint32_t>(handle & ((1u << kIndexBits) - 1));
+    const uint32_t generation = static_cast<uint32_t>(handle >> kIndexBits);
+    return index < m_nodes.size() && m_nodes[index].m_generation == generation && m_nodes[index].m_ref != LUA_NOREF;
+}
+
+void LuaTimerWheel::CancelAll()
+{
+    for (uint32_t index = 0; index < static_cast<uint32_t>(m_nodes.size()); ++index)
+    {
+        if (m_nodes[index].m_ref == LUA_NOREF)
+            continue;
+        if (m_nodes[index].m_slot != kUnlinked)
+            UnlinkNode(index);
+        FreeNode(index);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Advances time and fires every timer that comes due, in the order they were due.  A repeating timer whose interval 
+// is shorter than deltaSeconds fires once for each interval that passed.  Ticks with nothing to do are skipped, so a 
+// long delta costs about the same as the ticks that actually have timers or cascades in them.
+//      -deltaSeconds:  The time since the last call, usually the frame time.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaTimerWheel::Advance(double deltaSeconds)
+{
+    if (m_isDispatching)
+    {
+        LUA_ERROR("LuaTimerWheel::Advance() can't be called from inside a timer callback.");
+        return;
+    }
+
+    m_accumulatedSeconds += deltaSeconds;
+    if (m_accumulatedSeconds >= m_tickSeconds)
+    {
+        constexpr double kMaxTicks = 9223372036854775808.0;  // 2^63, far more than any game will run
+        const double wholeTicks = std::min(std::floor(m_accumulatedSeconds / m_tickSeconds), kMaxTicks);
+        m_accumulatedSeconds = std::max(m_accumulatedSeconds - wholeTicks * m_tickSeconds, 0.0);
+        AdvanceTicks(static_cast<uint64_t>(wholeTicks));
+    }
+
+    if (!m_dueTimers.empty())
+        FireDueTimers();
+}
+
+void LuaTimerWheel::AdvanceTicks(uint64_t numTicks)
+{
+    while (numTicks > 0)
+    {
+        if (m_numTimers == 0)
+        {
+            m_currentTick += numTicks;
+            return;
+        }
+
+        const uint64_t numEmptyTicks = CountEmptyTicks(numTicks - 1);
+        m_currentTick += numEmptyTicks;
+        numTicks -= numEmptyTicks;
+        Tick();
+        --numTicks;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Counts the ticks after the current one that wouldn't do anything, up to maxTicks.  A tick does something if its 
+// first level slot has timers or it cascades an upper level slot that has timers.  The first level is checked 
+// first, since it usually has the answer; the upper levels are only scanned when nothing in the first level is due 
+// before the next cascade.
+//---------------------------------------------------------------------------------------------------------------------
+uint64_t LuaTimerWheel::CountEmptyTicks(uint64_t maxTicks) const
+{
+    uint64_t nextTick = UINT64_MAX;
+    for (uint64_t delta = 1; delta < kNumSlots; ++delta)
+    {
+        if (m_slotHeads[(m_currentTick + delta) & (kNumSlots - 1)] != kNil)
+        {
+            nextTick = m_currentTick + delta;
+            break;
+        }
+    }
+
+    const uint64_t nextCascadeTick = (m_currentTick | (kNumSlots - 1)) + 1;
+    if (nextTick > nextCascadeTick)
+        nextTick = std::min(nextTick, FindNextCascadeTick());
+    return std::min(nextTick - m_currentTick - 1, maxTicks);
+}
+
+// Finds the first tick after the current one that cascades an upper level slot with timers in it.  Level N's slot S 
+// is cascaded on the ticks that are multiples of 64^N and have S in level N's bits.
+uint64_t LuaTimerWheel::FindNextCascadeTick() const
+{
+    uint64_t result = UINT64_MAX;
+    for (int level = 1; level < kNumLevels; ++level)
+    {
+        const int shift = level * kSlotBits;
+        const uint64_t nextBoundary = (m_currentTick >> shift) + 1;
+        for (int slot = 0; slot < kNumSlots; ++slot)
+        {
+            if (m_slotHeads[level * kNumSlots + slot] == kNil)
+                continue;
+            const uint64_t boundary = nextBoundary + ((static_cast<uint64_t>(slot) - nextBoundary) & (kNumSlots - 1));
+            result = std::min(result, boundary << shift);
+        }
+    }
+    return result;
+}
+
+uint32_t LuaTimerWheel::SecondsToTicks(double seconds) const
+{
+    const double ticks = std::ceil(seconds / m_tickSeconds);
+    if (!(ticks >= 1))  // also catches NaN
+        return 1;
+    return (ticks < 4294967295.0) ? static_cast<uint32_t>(ticks) : 0xffffffff;
+}
+
+uint32_t LuaTimerWheel::AllocateNode()
+{
+    if (m_freeHead != kNil)
+    {
+        const uint32_t index = m_freeHead;
+        m_freeHead = m_nodes[index].m_next;
+        return index;
+    }
+
+    // the index has to fit in the handle
+    if (m_nodes.size() >= (1u << kIndexBits))
+        return kNil;
+
+    TimerNode node = {};
+    node.m_generation = 1;
+    node.m_slot = kUnlinked;
+    node.m_ref = LUA_NOREF;
+    m_nodes.push_back(node);
+    return static_cast<uint32_t>(m_nodes.size() - 1);
+}
+
+void LuaTimerWheel::FreeNode(uint32_t index)
+{
+    TimerNode& node = m_nodes[index];
+    luaL_unref(m_pState->GetState(), LUA_REGISTRYINDEX, node.m_ref);
+    node.m_ref = LUA_NOREF;
+    node.m_generation = (node.m_generation + 1) & ((1u << (53 - kIndexBits)) - 1);
+    if (node.m_generation == 0)  // keeps the handle from ever being 0
+        node.m_generation = 1;
+    node.m_next = m_freeHead;
+    m_freeHead = index;
+    --m_numTimers;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Puts a node into the slot for its expire tick.  The level is picked by how far away that tick is, and anything 
+// past the last level is parked in the last level's furthest slot.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaTimerWheel::LinkNode(uint32_t index)
+{
+    TimerNode& node = m_nodes[index];
+    uint64_t expireTick = node.m_expireTick;
+    const uint64_t delta = expireTick - m_currentTick;
+
+    int level = 0;
+    while (level < kNumLevels - 1 && delta >= (uint64_t(1) << ((level + 1) * kSlotBits)))
+        ++level;
+    if (delta >= (uint64_t(1) << (kNumLevels * kSlotBits)))
+        expireTick = m_currentTick + (uint64_t(1) << (kNumLevels * kSlotBits)) - 1;
+
+    const int slot = static_cast<int>((expireTick >> (level * kSlotBits)) & (kNumSlots - 1));
+    const uint16_t slotIndex = static_cast<uint16_t>(level * kNumSlots + slot);
+
+    node.m_slot = slotIndex;
+    node.m_prev = kNil;
+    node.m_next = m_slotHeads[slotIndex];
+    if (node.m_next != kNil)
+        m_nodes[node.m_next].m_prev = index;
+    m_slotHeads[slotIndex] = index;
+}
+
+void LuaTimerWheel::UnlinkNode(uint32_t index)
+{
+    TimerNode& node = m_nodes[index];
+    if (node.m_prev != kNil)
+        m_nodes[node.m_prev].m_next = node.m_next;
+    else
+        m_slotHeads[node.m_slot] = node.m_next;
+    if (node.m_next != kNil)
+        m_nodes[node.m_next].m_prev = node.m_prev;
+    node.m_slot = kUnlinked;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Advances one tick.  When the first level wraps around, the next slot of the level above is cascaded down before the 
+// current slot is collected, since some of its timers may be due this tick.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaTimerWheel::Tick()
+{
+    ++m_currentTick;
+
+    for (int level = 1; level < kNumLevels; ++level)
+    {
+        if ((m_currentTick & ((uint64_t(1) << (level * kSlotBits)) - 1)) != 0)
+            break;
+        CascadeSlot(level, static_cast<int>((m_currentTick >> (level * kSlotBits)) & (kNumSlots - 1)));
+    }
+
+    const int slotIndex = static_cast<int>(m_currentTick & (kNumSlots - 1));
+    uint32_t index = m_slotHeads[slotIndex];
+    m_slotHeads[slotIndex] = kNil;
+    while (index != kNil)
+    {
+        TimerNode& node = m_nodes[index];
+        const uint32_t next = node.m_next;
+        node.m_slot = kUnlinked;
+        m_dueTimers.push_back(DueTimer{ index, node.m_generation });
+
+        // repeating timers are rescheduled now, so they can be cancelled from their own callback
+        if (node.m_intervalTicks > 0)
+        {
+            node.m_expireTick += node.m_intervalTicks;
+            LinkNode(index);
+        }
+        index = next;
+    }
+}
+
+void LuaTimerWheel::CascadeSlot(int level, int slot)
+{
+    const int slotIndex = level * kNumSlots + slot;
+    uint32_t index = m_slotHeads[slotIndex];
+    m_slotHeads[slotIndex] = kNil;
+    while (index != kNil)
+    {
+        const uint32_t next = m_nodes[index].m_next;
+        LinkNode(index);
+        index = next;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Fires the collected due timers.  One-shot timers are freed as they fire; their function stays on the stack for the 
+// call, so the callback can schedule new timers that reuse the node.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaTimerWheel::FireDueTimers()
+{
+    lua_State* pState = m_pState->GetState();
+    DispatchContext context = { this, 0 };
+
+    m_isDispatching = true;
+    while (context.m_next < m_dueTimers.size())
+    {
+        lua_pushcfunction(pState, &CallDueTimers);                          //  [func]
+        lua_pushlightuserdata(pState, &context);                            //  [func, context]
+        if (Debug::ProtectedCall(pState, 1, 0, 0) != LUA_OK)               //  [] or [error]
+        {
+            LUA_ERROR(luastl::string("Timer callback failed: ") + (lua_tostring(pState, -1) ? lua_tostring(pState, -1) : "(error object is not a string)"));
+            lua_pop(pState, 1);                                             //  []
+        }
+    }
+    m_isDispatching = false;
+    m_dueTimers.clear();
+}
+
+int LuaTimerWheel::CallDueTimers(lua_State* pState)
+{
+    DispatchContext* pContext = static_cast<DispatchContext*>(lua_touserdata(pState, 1));
+    LuaTimerWheel* pWheel = pContext->m_pWheel;
+
+    while (pContext->m_next < pWheel->m_dueTimers.size())
+    {
+        const DueTimer due = pWheel->m_dueTimers[pContext->m_next++];
+        const TimerNode& node = pWheel->m_nodes[due.m_index];
+        if (node.m_generation != due.m_generation || node.m_ref == LUA_NOREF)  // cancelled by an earlier callback
+            continue;
+
+        lua_rawgeti(pState, LUA_REGISTRYINDEX, node.m_ref);                 //  [context, callback]
+        PushTimerHandle(pState, MakeHandle(due.m_index, due.m_generation));  //  [context, callback, handle]
+        if (node.m_intervalTicks == 0)
+            pWheel->FreeNode(due.m_index);
+        lua_call(pState, 1, 0);                                             //  [context]
+    }
+    return 0;
+}
+
+LuaTimerWheel::TimerHandle LuaTimerWheel::MakeHandle(uint32_t index, uint32_t generation)
+{
+    return (static_cast<TimerHandle>(generation) << kIndexBits) | index;
+}
+
+// Handles are below 2^53, so they're exact as either kind of number, but on Lua 5.3+ they're pushed as integers so 
+// scripts see them as integers (math.type(), string.format("%d"), and table keys).
+void LuaTimerWheel::PushTimerHandle(lua_State* pState, TimerHandle handle)
+{
+#if BLEACHLUA_CORE_VERSION >= 53
+    lua_pushinteger(pState, static_cast<lua_Integer>(handle));
+#else
+    lua_pushnumber(pState, static_cast<lua_Number>(handle));
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// bleach.timer
+//---------------------------------------------------------------------------------------------------------------------
+static LuaTimerWheel* GetTimerWheel(lua_State* pState)
+{
+    return static_cast<LuaTimerWheel*>(lua_touserdata(pState, lua_upvalueindex(1)));
+}
+
+// Reads a handle argument.  Handles are integers below 2^53, so anything else (negative, fractional, NaN, or huge) 
+// can't name a timer and reads as kInvalidTimerHandle instead of being converted.
+static LuaTimerWheel::TimerHandle CheckTimerHandle(lua_State* pState, int index)
+{
+    constexpr lua_Number kHandleLimit = 9007199254740992.0;  // 2^53
+    const lua_Number value = luaL_checknumber(pState, index);
+    if (!(value >= 0 && value < kHandleLimit) || value != std::floor(value))
+        return LuaTimerWheel::kInvalidTimerHandle;
+    return static_cast<LuaTimerWheel::TimerHandle>(value);
+}
+
+// bleach.timer.after(seconds, func) -> handle
+static int TimerAfter(lua_State* pState)
+{
+    const double seconds = luaL_checknumber(pState, 1);
+    luaL_checktype(pState, 2, LUA_TFUNCTION);
+    const LuaTimerWheel::TimerHandle handle = GetTimerWheel(pState)->ScheduleFromStack(pState, 2, seconds, false);
+    if (handle == LuaTimerWheel::kInvalidTimerHandle)
+        return luaL_error(pState, "too many timers");
+    LuaTimerWheel::PushTimerHandle(pState, handle);
+    return 1;
+}
+
+// bleach.timer.every(seconds, func) -> handle
+static int TimerEvery(lua_State* pState)
+{
+    const double seconds = luaL_checknumber(pState, 1);
+    luaL_checktype(pState, 2, LUA_TFUNCTION);
+    const LuaTimerWheel::TimerHandle handle = GetTimerWheel(pState)->ScheduleFromStack(pState, 2, seconds, true);
+    if (handle == LuaTimerWheel::kInvalidTimerHandle)
+        return luaL_error(pState, "too many timers");
+    LuaTimerWheel::PushTimerHandle(pState, handle);
+    return 1;
+}
+
+// bleach.timer.cancel(handle) -> bool
+static int TimerCancel(lua_State* pState)
+{
+    const bool cancelled = GetTimerWheel(pState)->Cancel(CheckTimerHandle(pState, 1));
+    lua_pushboolean(pState, cancelled ? 1 : 0);
+    return 1;
+}
+
+// bleach.timer.pending(handle) -> bool
+static int TimerPending(lua_State* pState)
+{
+    const bool pending = GetTimerWheel(pState)->IsPending(CheckTimerHandle(pState, 1));
+    lua_pushboolean(pState, pending ? 1 : 0);
+    return 1;
+}
+
+void OpenTimerLib(LuaState* pState, LuaTimerWheel* pTimers)
+{
+    static const luaL_Reg kFunctions[] =
+    {
+        { "after", &TimerAfter },
+        { "every", &TimerEvery },
+        { "cancel", &TimerCancel },
+        { "pending", &TimerPending },
+        { nullptr, nullptr }
+    };
+
+    LUA_ASSERT(pState);
+    LUA_ASSERT(pTimers);
+    LuaVar lib = pState->GetGlobals().GetOrCreateNewTable(BLEACHLUA_LIB_TABLE_NAME);
+    LuaVar timerLib = lib.GetOrCreateNewTable("timer");
+
+    lua_State* pLuaState = pState->GetState();
+    timerLib.PushValueToStack();                                            //  [timer]
+    for (const luaL_Reg* pFunc = kFunctions; pFunc->name; ++pFunc)
+    {
+        lua_pushlightuserdata(pLuaState, pTimers);                          //  [timer, wheel]
+        lua_pushcclosure(pLuaState, pFunc->func, 1);                        //  [timer, func]
+        lua_setfield(pLuaState, -2, pFunc->name);                           //  [timer]
+    }
+    lua_pop(pLuaState, 1);                                                  //  []
+}
+
+}  // end namespace BleachLua
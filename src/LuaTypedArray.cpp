@@ -0,0 +1,679 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaTypedArray.h>
+#include <BleachLua/LuaState.h>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <new>
+
+#if BLEACHLUA_USE_SSE
+    #include <emmintrin.h>
+#endif
+
+namespace BleachLua {
+
+// The most elements a script can ask for.  Element indices have to fit in an int for lua_rawgeti() and friends.
+static constexpr lua_Integer kMaxTypedArraySize = 0x7fffffff;
+
+//---------------------------------------------------------------------------------------------------------------------
+// Per-type names.  The metatable name is the registry key for the metatable and doubles as the type tag we check 
+// against; the lib name is the constructor's name in the BleachLua library table.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type> struct TypedArrayNames;
+template <> struct TypedArrayNames<float>   { static constexpr const char* kMetatable = "BleachLua.Float32Array"; static constexpr const char* kLibName = "Float32Array"; };
+template <> struct TypedArrayNames<double>  { static constexpr const char* kMetatable = "BleachLua.Float64Array"; static constexpr const char* kLibName = "Float64Array"; };
+template <> struct TypedArrayNames<int32_t> { static constexpr const char* kMetatable = "BleachLua.Int32Array"; static constexpr const char* kLibName = "Int32Array"; };
+template <> struct TypedArrayNames<uint8_t> { static constexpr const char* kMetatable = "BleachLua.Uint8Array"; static constexpr const char* kLibName = "Uint8Array"; };
+
+// Sums and dot products of integer arrays are accumulated as Lua integers so they don't overflow the element type.
+template <class Type>
+using AccumType = luastl::conditional_t<luastl::is_floating_point<Type>::value, Type, lua_Integer>;
+
+//---------------------------------------------------------------------------------------------------------------------
+// Kernels.  The templates are the generic versions, written as simple loops so the compiler can vectorize them.  The 
+// float and double overloads use SSE2 directly when it's available since compilers won't reorder floating-point 
+// reductions on their own.  Unaligned loads are used throughout since Lua only guarantees 8-byte alignment for 
+// userdata.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+static AccumType<Type> SumKernel(const Type* pData, size_t count)
+{
+    AccumType<Type> result = 0;
+    for (size_t i = 0; i < count; ++i)
+        result += pData[i];
+    return result;
+}
+
+// Integer dot products wrap around on overflow, like Lua's own integer arithmetic.  The accumulator is unsigned so the 
+// wrap is well defined; each product fits since the elements are at most 32 bits.
+template <class Type>
+static AccumType<Type> DotKernel(const Type* pLeft, const Type* pRight, size_t count)
+{
+    if constexpr (luastl::is_floating_point<Type>::value)
+    {
+        Type result = 0;
+        for (size_t i = 0; i < count; ++i)
+            result += pLeft[i] * pRight[i];
+        return result;
+    }
+    else
+    {
+        using UnsignedAccum = typename luastl::make_unsigned<lua_Integer>::type;
+        static_assert(sizeof(Type) <= 4, "Products of the elements have to fit in a lua_Integer.");
+        UnsignedAccum result = 0;
+        for (size_t i = 0; i < count; ++i)
+            result += static_cast<UnsignedAccum>(static_cast<lua_Integer>(pLeft[i]) * pRight[i]);
+        return static_cast<lua_Integer>(result);
+    }
+}
+
+// Integer arrays saturate like scale() does: each sum is done in 64 bits and clamped to the type's range.  The right 
+// side can be any addend CheckAddend() returns.
+template <class Type>
+static Type SaturatingAdd(Type left, AccumType<Type> right)
+{
+    if constexpr (luastl::is_floating_point<Type>::value)
+    {
+        return left + right;
+    }
+    else
+    {
+        static_assert(sizeof(Type) <= 4, "Sums of the elements have to fit in a lua_Integer.");
+        constexpr lua_Integer kLowest = static_cast<lua_Integer>(std::numeric_limits<Type>::lowest());
+        constexpr lua_Integer kHighest = static_cast<lua_Integer>(std::numeric_limits<Type>::max());
+        const lua_Integer result = static_cast<lua_Integer>(left) + right;
+        return static_cast<Type>(std::min(std::max(result, kLowest), kHighest));
+    }
+}
+
+template <class Type>
+static void AddArrayKernel(Type* pDest, const Type* pSource, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        pDest[i] = SaturatingAdd<Type>(pDest[i], pSource[i]);
+}
+
+template <class Type>
+static void AddScalarKernel(Type* pDest, AccumType<Type> value, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        pDest[i] = SaturatingAdd<Type>(pDest[i], value);
+}
+
+// Integer arrays saturate: results are clamped to the type's range and NaN becomes 0, since converting an out-of-range 
+// double to an integer is undefined.
+template <class Type>
+static void ScaleKernel(Type* pDest, lua_Number scale, size_t count)
+{
+    if constexpr (luastl::is_floating_point<Type>::value)
+    {
+        for (size_t i = 0; i < count; ++i)
+            pDest[i] = static_cast<Type>(pDest[i] * scale);
+    }
+    else
+    {
+        constexpr lua_Number kLowest = static_cast<lua_Number>(std::numeric_limits<Type>::lowest());
+        constexpr lua_Number kHighest = static_cast<lua_Number>(std::numeric_limits<Type>::max());
+        for (size_t i = 0; i < count; ++i)
+        {
+            const lua_Number result = pDest[i] * scale;
+            pDest[i] = (result == result) ? static_cast<Type>(std::min(std::max(result, kLowest), kHighest)) : 0;
+        }
+    }
+}
+
+template <class Type>
+static void MinMaxKernel(const Type* pData, size_t count, Type& outMin, Type& outMax)
+{
+    LUA_ASSERT(count > 0);
+    Type minVal = pData[0];
+    Type maxVal = pData[0];
+    for (size_t i = 1; i < count; ++i)
+    {
+        minVal = (pData[i] < minVal) ? pData[i] : minVal;
+        maxVal = (pData[i] > maxVal) ? pData[i] : maxVal;
+    }
+    outMin = minVal;
+    outMax = maxVal;
+}
+
+#if BLEACHLUA_USE_SSE
+
+static float HorizontalSum(__m128 value)
+{
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, value);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+static double HorizontalSum(__m128d value)
+{
+    alignas(16) double lanes[2];
+    _mm_store_pd(lanes, value);
+    return lanes[0] + lanes[1];
+}
+
+static float SumKernel(const float* pData, size_t count)
+{
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_loadu_ps(pData + i));
+        acc1 = _mm_add_ps(acc1, _mm_loadu_ps(pData + i + 4));
+    }
+    float result = HorizontalSum(_mm_add_ps(acc0, acc1));
+    for (; i < count; ++i)
+        result += pData[i];
+    return result;
+}
+
+static double SumKernel(const double* pData, size_t count)
+{
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        acc0 = _mm_add_pd(acc0, _mm_loadu_pd(pData + i));
+        acc1 = _mm_add_pd(acc1, _mm_loadu_pd(pData + i + 2));
+    }
+    double result = HorizontalSum(_mm_add_pd(acc0, acc1));
+    for (; i < count; ++i)
+        result += pData[i];
+    return result;
+}
+
+static float DotKernel(const float* pLeft, const float* pRight, size_t count)
+{
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(pLeft + i), _mm_loadu_ps(pRight + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(pLeft + i + 4), _mm_loadu_ps(pRight + i + 4)));
+    }
+    float result = HorizontalSum(_mm_add_ps(acc0, acc1));
+    for (; i < count; ++i)
+        result += pLeft[i] * pRight[i];
+    return result;
+}
+
+static double DotKernel(const double* pLeft, const double* pRight, size_t count)
+{
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(pLeft + i), _mm_loadu_pd(pRight + i)));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(pLeft + i + 2), _mm_loadu_pd(pRight + i + 2)));
+    }
+    double result = HorizontalSum(_mm_add_pd(acc0, acc1));
+    for (; i < count; ++i)
+        result += pLeft[i] * pRight[i];
+    return result;
+}
+
+static void MinMaxKernel(const float* pData, size_t count, float& outMin, float& outMax)
+{
+    LUA_ASSERT(count > 0);
+    size_t i = 0;
+    float minVal = pData[0];
+    float maxVal = pData[0];
+    if (count >= 4)
+    {
+        __m128 minVec = _mm_loadu_ps(pData);
+        __m128 maxVec = minVec;
+        for (i = 4; i + 4 <= count; i += 4)
+        {
+            const __m128 values = _mm_loadu_ps(pData + i);
+            minVec = _mm_min_ps(minVec, values);
+            maxVec = _mm_max_ps(maxVec, values);
+        }
+
+        alignas(16) float minLanes[4];
+        alignas(16) float maxLanes[4];
+        _mm_store_ps(minLanes, minVec);
+        _mm_store_ps(maxLanes, maxVec);
+        minVal = std::min(std::min(minLanes[0], minLanes[1]), std::min(minLanes[2], minLanes[3]));
+        maxVal = std::max(std::max(maxLanes[0], maxLanes[1]), std::max(maxLanes[2], maxLanes[3]));
+    }
+    for (; i < count; ++i)
+    {
+        minVal = (pData[i] < minVal) ? pData[i] : minVal;
+        maxVal = (pData[i] > maxVal) ? pData[i] : maxVal;
+    }
+    outMin = minVal;
+    outMax = maxVal;
+}
+
+static void ScaleKernel(float* pDest, lua_Number scale, size_t count)
+{
+    const __m128 scaleVec = _mm_set1_ps(static_cast<float>(scale));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(pDest + i, _mm_mul_ps(_mm_loadu_ps(pDest + i), scaleVec));
+    for (; i < count; ++i)
+        pDest[i] *= static_cast<float>(scale);
+}
+
+static void AddArrayKernel(float* pDest, const float* pSource, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(pDest + i, _mm_add_ps(_mm_loadu_ps(pDest + i), _mm_loadu_ps(pSource + i)));
+    for (; i < count; ++i)
+        pDest[i] += pSource[i];
+}
+
+#endif  // BLEACHLUA_USE_SSE
+
+//---------------------------------------------------------------------------------------------------------------------
+// Element conversion helpers.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+static void PushElement(lua_State* pState, Type value)
+{
+    if constexpr (luastl::is_floating_point<Type>::value)
+        lua_pushnumber(pState, static_cast<lua_Number>(value));
+    else
+        lua_pushinteger(pState, static_cast<lua_Integer>(value));
+}
+
+template <class Type>
+static Type CheckElement(lua_State* pState, int stackIndex)
+{
+    if constexpr (luastl::is_floating_point<Type>::value)
+        return static_cast<Type>(luaL_checknumber(pState, stackIndex));
+    else
+    {
+        const lua_Integer value = luaL_checkinteger(pState, stackIndex);
+        luaL_argcheck(pState, value >= static_cast<lua_Integer>(std::numeric_limits<Type>::lowest()) && 
+            value <= static_cast<lua_Integer>(std::numeric_limits<Type>::max()), stackIndex, "value out of range");
+        return static_cast<Type>(value);
+    }
+}
+
+// Gets a number to add to every element.  Integer addends can be negative or bigger than the type, so they're clamped 
+// to a range where the sum still saturates the same way and can't overflow.
+template <class Type>
+static AccumType<Type> CheckAddend(lua_State* pState, int stackIndex)
+{
+    if constexpr (luastl::is_floating_point<Type>::value)
+    {
+        return CheckElement<Type>(pState, stackIndex);
+    }
+    else
+    {
+        constexpr lua_Integer kSpan = static_cast<lua_Integer>(std::numeric_limits<Type>::max()) - 
+            static_cast<lua_Integer>(std::numeric_limits<Type>::lowest());
+        return std::min(std::max(luaL_checkinteger(pState, stackIndex), -kSpan), kSpan);
+    }
+}
+
+template <class Type>
+static LuaTypedArray<Type>* CheckArray(lua_State* pState, int stackIndex)
+{
+    return static_cast<LuaTypedArray<Type>*>(luaL_checkudata(pState, stackIndex, TypedArrayNames<Type>::kMetatable));
+}
+
+// Converts an optional 1-based index argument into a 0-based index, raising a Lua error if it's out of range.
+static size_t CheckOptionalIndex(lua_State* pState, int stackIndex, size_t defaultIndex, size_t maxIndex)
+{
+    const lua_Integer index = luaL_optinteger(pState, stackIndex, static_cast<lua_Integer>(defaultIndex) + 1);
+    luaL_argcheck(pState, index >= 1 && static_cast<size_t>(index) <= maxIndex + 1, stackIndex, "index out of range");
+    return static_cast<size_t>(index - 1);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Metamethods
+//---------------------------------------------------------------------------------------------------------------------
+// __index(array, key); upvalue 1 is the methods table
+template <class Type>
+static int TypedArrayIndex(lua_State* pState)
+{
+    LuaTypedArray<Type>* pArray = CheckArray<Type>(pState, 1);
+    if (lua_type(pState, 2) == LUA_TNUMBER)
+    {
+        const lua_Integer index = lua_tointeger(pState, 2);
+        if (index >= 1 && static_cast<size_t>(index) <= pArray->GetSize())
+            PushElement(pState, pArray->GetData()[index - 1]);
+        else
+            lua_pushnil(pState);
+        return 1;
+    }
+
+    lua_pushvalue(pState, 2);
+    lua_rawget(pState, lua_upvalueindex(1));
+    return 1;
+}
+
+// __newindex(array, index, value)
+template <class Type>
+static int TypedArrayNewIndex(lua_State* pState)
+{
+    LuaTypedArray<Type>* pArray = CheckArray<Type>(pState, 1);
+    const lua_Integer index = luaL_checkinteger(pState, 2);
+    luaL_argcheck(pState, index >= 1 && static_cast<size_t>(index) <= pArray->GetSize(), 2, "index out of range");
+    pArray->GetData()[index - 1] = CheckElement<Type>(pState, 3);
+    return 0;
+}
+
+// __len(array)
+template <class Type>
+static int TypedArrayLen(lua_State* pState)
+{
+    lua_pushinteger(pState, static_cast<lua_Integer>(CheckArray<Type>(pState, 1)->GetSize()));
+    return 1;
+}
+
+// __tostring(array)
+template <class Type>
+static int TypedArrayToString(lua_State* pState)
+{
+    lua_pushfstring(pState, "%s(%d)", TypedArrayNames<Type>::kLibName, static_cast<int>(CheckArray<Type>(pState, 1)->GetSize()));
+    return 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Methods
+//---------------------------------------------------------------------------------------------------------------------
+// array:fill(value [, first [, last]])
+template <class Type>
+static int TypedArrayFill(lua_State* pState)
+{
+    LuaTypedArray<Type>* pArray = CheckArray<Type>(pState, 1);
+    const Type value = CheckElement<Type>(pState, 2);
+    const lua_Integer first = luaL_optinteger(pState, 3, 1);
+    const lua_Integer last = luaL_optinteger(pState, 4, static_cast<lua_Integer>(pArray->GetSize()));
+    luaL_argcheck(pState, first >= 1, 3, "index out of range");
+    luaL_argcheck(pState, last <= static_cast<lua_Integer>(pArray->GetSize()), 4, "index out of range");
+    if (first <= last)
+        std::fill(pArray->GetData() + (first - 1), pArray->GetData() + last, value);
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// array:add(otherArray|number); other arrays must be the same type and size, and integer arrays saturate
+template <class Type>
+static int TypedArrayAdd(lua_State* pState)
+{
+    LuaTypedArray<Type>* pArray = CheckArray<Type>(pState, 1);
+    if (lua_type(pState, 2) == LUA_TNUMBER)
+    {
+        AddScalarKernel(pArray->GetData(), CheckAddend<Type>(pState, 2), pArray->GetSize());
+    }
+    else
+    {
+        const LuaTypedArray<Type>* pOther = CheckArray<Type>(pState, 2);
+        luaL_argcheck(pState, pOther->GetSize() == pArray->GetSize(), 2, "array sizes don't match");
+        AddArrayKernel(pArray->GetData(), pOther->GetData(), pArray->GetSize());
+    }
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// array:scale(number)  -- integer arrays saturate rather than wrap
+template <class Type>
+static int TypedArrayScale(lua_State* pState)
+{
+    LuaTypedArray<Type>* pArray = CheckArray<Type>(pState, 1);
+    ScaleKernel(pArray->GetData(), luaL_checknumber(pState, 2), pArray->GetSize());
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// array:dot(otherArray) -> number
+template <class Type>
+static int TypedArrayDot(lua_State* pState)
+{
+    const LuaTypedArray<Type>* pArray = CheckArray<Type>(pState, 1);
+    const LuaTypedArray<Type>* pOther = CheckArray<Type>(pState, 2);
+    luaL_argcheck(pState, pOther->GetSize() == pArray->GetSize(), 2, "array sizes don't match");
+    PushElement(pState, DotKernel(pArray->GetData(), pOther->GetData(), pArray->GetSize()));
+    return 1;
+}
+
+// array:sum() -> number
+template <class Type>
+static int TypedArraySum(lua_State* pState)
+{
+    const LuaTypedArray<Type>* pArray = CheckArray<Type>(pState, 1);
+    PushElement(pState, SumKernel(pArray->GetData(), pArray->GetSize()));
+    return 1;
+}
+
+// array:minmax() -> min, max (or nil if the array is empty)
+template <class Type>
+static int TypedArrayMinMax(lua_State* pState)
+{
+    const LuaTypedArray<Type>* pArray = CheckArray<Type>(pState, 1);
+    if (pArray->GetSize() == 0)
+    {
+        lua_pushnil(pState);
+        return 1;
+    }
+
+    Type minVal, maxVal;
+    MinMaxKernel(pArray->GetData(), pArray->GetSize(), minVal, maxVal);
+    PushElement(pState, minVal);
+    PushElement(pState, maxVal);
+    return 2;
+}
+
+// array:min() -> number (or nil if the array is empty)
+template <class Type>
+static int TypedArrayMin(lua_State* pState)
+{
+    lua_settop(pState, 1);             //  [array]
+    TypedArrayMinMax<Type>(pState);    //  [array, min, max?]
+    lua_settop(pState, 2);             //  [array, min]
+    return 1;
+}
+
+// array:max() -> number (or nil if the array is empty)
+template <class Type>
+static int TypedArrayMax(lua_State* pState)
+{
+    lua_settop(pState, 1);             //  [array]
+    TypedArrayMinMax<Type>(pState);    //  [array, min, max] or [array, nil]
+    return 1;
+}
+
+// array:copy(source [, sourceFirst [, destFirst [, count]]]); source must be the same type, but may be this array
+template <class Type>
+static int TypedArrayCopy(lua_State* pState)
+{
+    LuaTypedArray<Type>* pDest = CheckArray<Type>(pState, 1);
+    const LuaTypedArray<Type>* pSource = CheckArray<Type>(pState, 2);
+    const size_t sourceFirst = CheckOptionalIndex(pState, 3, 0, pSource->GetSize());
+    const size_t destFirst = CheckOptionalIndex(pState, 4, 0, pDest->GetSize());
+    const size_t maxCount = std::min(pSource->GetSize() - sourceFirst, pDest->GetSize() - destFirst);
+    const lua_Integer count = luaL_optinteger(pState, 5, static_cast<lua_Integer>(maxCount));
+    luaL_argcheck(pState, count >= 0 && static_cast<size_t>(count) <= maxCount, 5, "count out of range");
+
+    memmove(pDest->GetData() + destFirst, pSource->GetData() + sourceFirst, static_cast<size_t>(count) * sizeof(Type));
+    lua_settop(pState, 1);
+    return 1;
+}
+
+// array:totable() -> table
+template <class Type>
+static int TypedArrayToTable(lua_State* pState)
+{
+    const LuaTypedArray<Type>* pArray = CheckArray<Type>(pState, 1);
+    const int size = static_cast<int>(pArray->GetSize());
+    lua_createtable(pState, size, 0);
+    for (int i = 0; i < size; ++i)
+    {
+        PushElement(pState, pArray->GetData()[i]);
+        lua_rawseti(pState, -2, i + 1);
+    }
+    return 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Constructor: bleach.Float32Array(size | table)
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+static int TypedArrayNew(lua_State* pState)
+{
+    if (lua_istable(pState, 1))
+    {
+        const size_t size = Compat::RawLen(pState, 1);
+        LuaTypedArray<Type>* pArray = LuaTypedArray<Type>::PushNew(pState, size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            lua_rawgeti(pState, 1, static_cast<int>(i + 1));
+            pArray->GetData()[i] = CheckElement<Type>(pState, -1);
+            lua_pop(pState, 1);
+        }
+        return 1;
+    }
+
+    const lua_Integer size = luaL_checkinteger(pState, 1);
+    luaL_argcheck(pState, size >= 0, 1, "size must not be negative");
+    luaL_argcheck(pState, size <= kMaxTypedArraySize, 1, "size is too large");
+    LuaTypedArray<Type>::PushNew(pState, static_cast<size_t>(size));
+    return 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Registers the metatable for one array type and adds its constructor to the library table at the top of the stack.
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+static void RegisterTypedArray(lua_State* pState)
+{
+    static const luaL_Reg kMethods[] =
+    {
+        { "fill", &TypedArrayFill<Type> },
+        { "add", &TypedArrayAdd<Type> },
+        { "scale", &TypedArrayScale<Type> },
+        { "dot", &TypedArrayDot<Type> },
+        { "sum", &TypedArraySum<Type> },
+        { "min", &TypedArrayMin<Type> },
+        { "max", &TypedArrayMax<Type> },
+        { "minmax", &TypedArrayMinMax<Type> },
+        { "copy", &TypedArrayCopy<Type> },
+        { "totable", &TypedArrayToTable<Type> },
+        { nullptr, nullptr }
+    };
+                                                                            //  [lib]
+    luaL_newmetatable(pState, TypedArrayNames<Type>::kMetatable);           //  [lib, mt]
+
+    constexpr int kNumMethods = static_cast<int>(sizeof(kMethods) / sizeof(kMethods[0])) - 1;
+    lua_createtable(pState, 0, kNumMethods);                                //  [lib, mt, methods]
+    for (const luaL_Reg* pMethod = kMethods; pMethod->name; ++pMethod)
+    {
+        lua_pushcfunction(pState, pMethod->func);                           //  [lib, mt, methods, func]
+        lua_setfield(pState, -2, pMethod->name);                            //  [lib, mt, methods]
+    }
+    lua_pushcclosure(pState, &TypedArrayIndex<Type>, 1);                    //  [lib, mt, __index]
+    lua_setfield(pState, -2, "__index");                                    //  [lib, mt]
+
+    lua_pushcfunction(pState, &TypedArrayNewIndex<Type>);                   //  [lib, mt, __newindex]
+    lua_setfield(pState, -2, "__newindex");                                 //  [lib, mt]
+    lua_pushcfunction(pState, &TypedArrayLen<Type>);                       //  [lib, mt, __len]
+    lua_setfield(pState, -2, "__len");                                      //  [lib, mt]
+    lua_pushcfunction(pState, &TypedArrayToString<Type>);                  //  [lib, mt, __tostring]
+    lua_setfield(pState, -2, "__tostring");                                 //  [lib, mt]
+    lua_pop(pState, 1);                                                     //  [lib]
+
+    lua_pushcfunction(pState, &TypedArrayNew<Type>);                        //  [lib, ctor]
+    lua_setfield(pState, -2, TypedArrayNames<Type>::kLibName);              //  [lib]
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// LuaTypedArray
+//---------------------------------------------------------------------------------------------------------------------
+template <class Type>
+LuaTypedArray<Type>* LuaTypedArray<Type>::PushNew(lua_State* pState, size_t size)
+{
+    if (size > (SIZE_MAX - kHeaderSize) / sizeof(Type))
+        luaL_error(pState, "typed array of %f elements is too large", static_cast<double>(size));
+
+    void* pBlock = Compat::NewUserData(pState, kHeaderSize + (size * sizeof(Type)));   //  [array]
+    LuaTypedArray* pArray = new (pBlock) LuaTypedArray(size);
+    memset(pArray->GetData(), 0, size * sizeof(Type));
+
+    luaL_getmetatable(pState, TypedArrayNames<Type>::kMetatable);                      //  [array, mt?]
+    LUA_ASSERT_MSG(lua_istable(pState, -1), "OpenTypedArrayLib() must be called before creating typed arrays.");
+    lua_setmetatable(pState, -2);                                                       //  [array]
+    return pArray;
+}
+
+template <class Type>
+LuaVar LuaTypedArray<Type>::Create(LuaState* pState, size_t size)
+{
+    LUA_ASSERT(pState);
+    PushNew(pState->GetState(), size);
+    return LuaVar::CreateFromStack(pState);
+}
+
+template <class Type>
+LuaTypedArray<Type>* LuaTypedArray<Type>::FromStack(lua_State* pState, int stackIndex)
+{
+    return static_cast<LuaTypedArray*>(luaL_testudata(pState, stackIndex, TypedArrayNames<Type>::kMetatable));
+}
+
+template <class Type>
+LuaTypedArray<Type>* LuaTypedArray<Type>::FromVar(const LuaVar& var)
+{
+    if (!var.PushValueToStack(false))                                       //  [var]
+        return nullptr;
+
+    lua_State* pState = var.GetLuaState()->GetState();
+    LuaTypedArray* pArray = FromStack(pState, -1);
+    lua_pop(pState, 1);                                                     //  []
+    return pArray;  // the memory is owned by the userdata, which var keeps alive
+}
+
+template class LuaTypedArray<float>;
+template class LuaTypedArray<double>;
+template class LuaTypedArray<int32_t>;
+template class LuaTypedArray<uint8_t>;
+
+//---------------------------------------------------------------------------------------------------------------------
+// Registers the typed array metatables and adds their constructors to the BleachLua library table.
+//      -pState:    The Lua state.
+//---------------------------------------------------------------------------------------------------------------------
+void OpenTypedArrayLib(LuaState* pState)
+{
+    LUA_ASSERT(pState);
+    LuaVar lib = pState->GetGlobals().GetOrCreateNewTable(BLEACHLUA_LIB_TABLE_NAME);
+
+    lua_State* pLuaState = pState->GetState();
+    lib.PushValueToStack();                                                 //  [lib]
+    RegisterTypedArray<float>(pLuaState);
+    RegisterTypedArray<double>(pLuaState);
+    RegisterTypedArray<int32_t>(pLuaState);
+    RegisterTypedArray<uint8_t>(pLuaState);
+    lua_pop(pLuaState, 1);                                                  //  []
+}
+
+}  // end namespace BleachLua
@@ -26,23 +26,194 @@
 #include <BleachLua/LuaVar.h>
 #include <BleachLua/LuaState.h>
 #include <BleachLua/TableIterator.h>
-
-#if BLEACHLUA_USE_MEMORY_POOLS
-#include <BleachUtils/Memory/MemoryPool.h>
-#endif
+#include <BleachLua/LuaArrayLib.h>
 
 namespace BleachLua {
 
-namespace _Internal {
+LuaState* LuaVar::s_pDefaultLuaState = nullptr;
 
-#if BLEACHLUA_USE_MEMORY_POOLS
-    BLEACH_MEMORYPOOL_DEFINITION(RefCount)
-    BLEACH_MEMORYPOOL_AUTOINIT(RefCount, 1024 * 8)
-#endif
+static_assert(sizeof(LuaVar) <= 2 * sizeof(void*), "LuaVar should only hold a state pointer and a registry ref.");
+//---------------------------------------------------------------------------------------------------------------------
+// Frozen tables.  A frozen table is an empty table standing in for the table that holds the data.  Each view has its 
+// own metatable with the data in slot 1 and the data (or, for deep freezes, the child index) as __index, so reads 
+// are plain table lookups that the VM does without calling into C.  __newindex is the only C function on the read or 
+// write path, and it raises an error.  The child index maps each key that held a nested table at Freeze() time to 
+// that table's frozen view, and falls back to the data through its own __index, so every view in a deep freeze is 
+// built up front, cycles share views, and the data itself is never touched.
+// 
+// The guard function doubles as the marker: a value is frozen if its metatable's __newindex is FrozenNewIndex(), 
+// which scripts can't forge.  The metatable is hidden with __metatable.  __len and __pairs forward to the data, 
+// except on Lua 5.1 and LuaJIT, which ignore both on tables.
+//---------------------------------------------------------------------------------------------------------------------
+static int FrozenNewIndex(lua_State* pState)
+{
+    return luaL_error(pState, "attempt to modify a frozen table");
+}
 
-}  // end namespace _Internal
+static bool IsFrozenTable(lua_State* pState, int index)
+{
+    if (!lua_istable(pState, index) || !lua_getmetatable(pState, index))    //  [mt?]
+        return false;
+    lua_pushstring(pState, "__newindex");                                   //  [mt, "__newindex"]
+    lua_rawget(pState, -2);                                                 //  [mt, __newindex]
+    const bool frozen = (lua_tocfunction(pState, -1) == &FrozenNewIndex);
+    lua_pop(pState, 2);                                                     //  []
+    return frozen;
+}
 
-LuaState* LuaVar::s_pDefaultLuaState = nullptr;
+static void PushFrozenSource(lua_State* pState, int proxyIndex)
+{
+    lua_getmetatable(pState, proxyIndex);                                   //  [mt]
+    lua_rawgeti(pState, -1, 1);                                             //  [mt, source]
+    lua_remove(pState, -2);                                                 //  [source]
+}
+
+// __len(proxy) -> the raw length of the data
+static int FrozenLen(lua_State* pState)
+{
+    PushFrozenSource(pState, 1);                                            //  [proxy, source]
+    lua_pushinteger(pState, static_cast<lua_Integer>(Compat::RawLen(pState, -1)));
+    return 1;
+}
+
+// the iterator returned by __pairs, with the data as upvalue 1 and the view's __index as upvalue 2
+static int FrozenNext(lua_State* pState)
+{
+    lua_settop(pState, 2);                                                  //  [proxy, key]
+    if (!lua_next(pState, lua_upvalueindex(1)))                             //  [proxy, key, value] or [proxy]
+    {
+        lua_pushnil(pState);                                                //  [proxy, nil]
+        return 1;
+    }
+    if (lua_istable(pState, -1))
+    {
+        // nested tables come back as their views if the freeze is deep
+        lua_pushvalue(pState, -2);                                          //  [proxy, key, value, key]
+        lua_rawget(pState, lua_upvalueindex(2));                            //  [proxy, key, value, view|value|nil]
+        if (lua_isnil(pState, -1))
+            lua_pop(pState, 1);                                             //  [proxy, key, value]
+        else
+            lua_replace(pState, -2);                                        //  [proxy, key, view|value]
+    }
+    return 2;
+}
+
+// __pairs(proxy) -> next, proxy, nil
+static int FrozenPairs(lua_State* pState)
+{
+    lua_getmetatable(pState, 1);                                            //  [proxy, mt]
+    lua_rawgeti(pState, -1, 1);                                             //  [proxy, mt, source]
+    lua_getfield(pState, -2, "__index");                                    //  [proxy, mt, source, index]
+    lua_pushcclosure(pState, &FrozenNext, 2);                               //  [proxy, mt, next]
+    lua_pushvalue(pState, 1);                                               //  [proxy, mt, next, proxy]
+    lua_pushnil(pState);                                                    //  [proxy, mt, next, proxy, nil]
+    return 3;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Pushes a new frozen view of a table.  For a deep freeze, __index is an empty child index that falls back to the 
+// data, and the caller fills it in.
+//      -pState:        The Lua state.
+//      -tableIndex:    The absolute index of the table.
+//      -deep:          true to give the view a child index.
+//---------------------------------------------------------------------------------------------------------------------
+static void PushFrozenProxy(lua_State* pState, int tableIndex, bool deep)
+{
+    lua_checkstack(pState, 4);
+    lua_newtable(pState);                                                   //  [proxy]
+    lua_createtable(pState, 1, 5);                                          //  [proxy, mt]
+    lua_pushvalue(pState, tableIndex);                                      //  [proxy, mt, t]
+    lua_rawseti(pState, -2, 1);                                             //  [proxy, mt]
+    if (deep)
+    {
+        lua_newtable(pState);                                               //  [proxy, mt, children]
+        lua_createtable(pState, 0, 1);                                      //  [proxy, mt, children, childrenMt]
+        lua_pushvalue(pState, tableIndex);                                  //  [proxy, mt, children, childrenMt, t]
+        lua_setfield(pState, -2, "__index");                                //  [proxy, mt, children, childrenMt]
+        lua_setmetatable(pState, -2);                                       //  [proxy, mt, children]
+    }
+    else
+    {
+        lua_pushvalue(pState, tableIndex);                                  //  [proxy, mt, t]
+    }
+    lua_setfield(pState, -2, "__index");                                    //  [proxy, mt]
+    lua_pushcfunction(pState, &FrozenNewIndex);                             //  [proxy, mt, FrozenNewIndex]
+    lua_setfield(pState, -2, "__newindex");                                 //  [proxy, mt]
+    lua_pushcfunction(pState, &FrozenLen);                                  //  [proxy, mt, FrozenLen]
+    lua_setfield(pState, -2, "__len");                                      //  [proxy, mt]
+    lua_pushcfunction(pState, &FrozenPairs);                                //  [proxy, mt, FrozenPairs]
+    lua_setfield(pState, -2, "__pairs");                                    //  [proxy, mt]
+    lua_pushboolean(pState, 0);                                             //  [proxy, mt, false]
+    lua_setfield(pState, -2, "__metatable");                                //  [proxy, mt]
+    lua_setmetatable(pState, -2);                                           //  [proxy]
+}
+
+// Pushes the cached view of the table at the top of the stack, creating it and queueing the table if it's new.
+static void PushCachedFrozenProxy(lua_State* pState, int cacheIndex, int pendingIndex)
+{
+    const int tableIndex = lua_gettop(pState);
+    lua_pushvalue(pState, tableIndex);                                      //  [t, t]
+    lua_rawget(pState, cacheIndex);                                         //  [t, proxy|nil]
+    if (!lua_isnil(pState, -1))
+        return;
+    lua_pop(pState, 1);                                                     //  [t]
+
+    PushFrozenProxy(pState, tableIndex, true);                              //  [t, proxy]
+    lua_pushvalue(pState, tableIndex);                                      //  [t, proxy, t]
+    lua_pushvalue(pState, -2);                                              //  [t, proxy, t, proxy]
+    lua_rawset(pState, cacheIndex);                                         //  [t, proxy]
+    lua_pushvalue(pState, tableIndex);                                      //  [t, proxy, t]
+    lua_rawseti(pState, pendingIndex, static_cast<int>(Compat::RawLen(pState, pendingIndex)) + 1);  //  [t, proxy]
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Pushes the deep frozen view of a table, building the views of every nested table it reaches.  This works through a 
+// queue rather than recursing so deeply nested data can't overflow the C stack.
+//      -pState:        The Lua state.
+//      -tableIndex:    The absolute index of the table.
+//---------------------------------------------------------------------------------------------------------------------
+static void PushDeepFrozenProxy(lua_State* pState, int tableIndex)
+{
+    lua_checkstack(pState, 10);
+    lua_newtable(pState);                                                   //  [cache]
+    const int cacheIndex = lua_gettop(pState);
+    lua_newtable(pState);                                                   //  [cache, pending]
+    const int pendingIndex = cacheIndex + 1;
+    lua_pushvalue(pState, tableIndex);                                      //  [cache, pending, t]
+    PushCachedFrozenProxy(pState, cacheIndex, pendingIndex);                //  [cache, pending, t, proxy]
+
+    for (size_t count = Compat::RawLen(pState, pendingIndex); count > 0; count = Compat::RawLen(pState, pendingIndex))
+    {
+        lua_rawgeti(pState, pendingIndex, static_cast<int>(count));         //  [..., parent]
+        lua_pushnil(pState);                                                //  [..., parent, nil]
+        lua_rawseti(pState, pendingIndex, static_cast<int>(count));         //  [..., parent]
+        const int parentIndex = lua_gettop(pState);
+
+        lua_pushvalue(pState, parentIndex);                                 //  [..., parent, parent]
+        lua_rawget(pState, cacheIndex);                                     //  [..., parent, parentProxy]
+        lua_getmetatable(pState, -1);                                       //  [..., parent, parentProxy, mt]
+        lua_pushstring(pState, "__index");                                  //  [..., parent, parentProxy, mt, "__index"]
+        lua_rawget(pState, -2);                                             //  [..., parent, parentProxy, mt, children]
+        const int childrenIndex = lua_gettop(pState);
+
+        lua_pushnil(pState);                                                //  [..., children, nil]
+        while (lua_next(pState, parentIndex))                               //  [..., children, key, value]
+        {
+            if (lua_istable(pState, -1) && !IsFrozenTable(pState, -1))
+            {
+                PushCachedFrozenProxy(pState, cacheIndex, pendingIndex);    //  [..., children, key, value, childProxy]
+                lua_pushvalue(pState, -3);                                  //  [..., children, key, value, childProxy, key]
+                lua_insert(pState, -2);                                     //  [..., children, key, value, key, childProxy]
+                lua_rawset(pState, childrenIndex);                          //  [..., children, key, value]
+            }
+            lua_pop(pState, 1);                                             //  [..., children, key]
+        }
+        lua_settop(pState, parentIndex - 1);                                //  [cache, pending, t, proxy]
+    }
+
+    lua_replace(pState, cacheIndex);                                        //  [proxy, pending, t]
+    lua_settop(pState, cacheIndex);                                         //  [proxy]
+}
 
 //---------------------------------------------------------------------------------------------------------------------
 // Constructor / Destructor
@@ -50,7 +221,6 @@ LuaState* LuaVar::s_pDefaultLuaState = nullptr;
 LuaVar::LuaVar(LuaState* pState) noexcept
     : m_pState(pState)
     , m_reference(LUA_REFNIL)
-    , m_pRefCount(nullptr)
 {
     //
 }
@@ -74,22 +244,23 @@ LuaVar LuaVar::CreateFromStack(LuaState* pState)
 
 //---------------------------------------------------------------------------------------------------------------------
 // Clears the Lua reference.  This effectively resets this variable, though the Lua state isn't cleared.  This will 
-// cause the value to be garbage collected if there are no more references to it.
+// cause the value to be garbage collected if there are no more references to it.  If the state is deferring unrefs, 
+// the last reference is queued and released by LuaState::FlushDeferredUnrefs() instead.
 //---------------------------------------------------------------------------------------------------------------------
 void LuaVar::ClearRef()
 {
     if (m_reference != LUA_REFNIL)
     {
         // clean up the refcount
-        LUA_ASSERT(m_pRefCount);  // this definitely shouldn't be null if we have a valid reference
-        if (m_pRefCount->Decrement())
+        if (m_pState->ReleaseRefCount(m_reference))
         {
-            luaL_unref(m_pState->GetState(), LUA_REGISTRYINDEX, m_reference);
-            BLEACHLUA_DELETE(m_pRefCount);
+            if (m_pState->IsDeferringUnrefs())
+                m_pState->DeferUnref(m_reference);
+            else
+                luaL_unref(m_pState->GetState(), LUA_REGISTRYINDEX, m_reference);
         }
 
         m_reference = LUA_REFNIL;
-        m_pRefCount = nullptr;
     }
 }
 
@@ -354,7 +525,105 @@ LuaVar LuaVar::Lookup(const luastl::string& path) const
 //---------------------------------------------------------------------------------------------------------------------
 size_t LuaVar::GetLength() const
 {
-    return DoLuaAction([this]() -> size_t { return lua_rawlen(m_pState->GetState(), -1); });
+    return DoLuaAction([this]() -> size_t
+    {
+        lua_State* pState = m_pState->GetState();
+        if (IsFrozenTable(pState, lua_gettop(pState)))
+        {
+            PushFrozenSource(pState, -1);                                   //  [proxy, source]
+            const size_t length = Compat::RawLen(pState, -1);
+            lua_pop(pState, 1);                                             //  [proxy]
+            return length;
+        }
+        return Compat::RawLen(pState, -1);
+    });
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Points this variable to a read-only view of its table.  Writes through the view raise a Lua error, so the result can 
+// be handed to untrusted scripts, or shared between environments, without a defensive copy.  Reads are ordinary table 
+// lookups through __index, with no C calls.  The data isn't copied or modified, so other references to the original 
+// table (in C++ or Lua) can still change it, and those changes show through the view.
+// 
+// The view is an empty table, so IsTable() and type() still report a table.  Indexing works as it does on the data, 
+// and so do # and pairs(), except on Lua 5.1 and LuaJIT, which ignore __len and __pairs on tables.  next() sees the 
+// empty view.  rawset() can't be guarded on a table: it only ever writes to the view and never reaches the data, but 
+// environments that share views with untrusted scripts should give them a rawset() that refuses frozen tables, like 
+// the shared environment base does.  C++ iteration and GetLength() see the data directly.  Freezing a variable that's already frozen does nothing.
+//      -deep:      If true, nested tables read through the view come back as frozen views too.  Every view is built 
+//                  here, so a nested table that's added or replaced in the data afterwards isn't wrapped, and the 
+//                  same nested table always gives the same view.
+//      -return:    true if the table is frozen, false if this isn't a table.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaVar::Freeze(bool deep /*= false*/)
+{
+    if (IsFrozen())
+        return true;
+    if (!IsTable())
+    {
+        LUA_ERROR("Attempting to freeze a var that isn't a table.  Type is " + GetTypeNameStr());
+        return false;
+    }
+
+    lua_State* pState = m_pState->GetState();
+    PushValueToStack();                                                     //  [t]
+    const int tableIndex = lua_gettop(pState);
+    if (deep)
+        PushDeepFrozenProxy(pState, tableIndex);                            //  [t, proxy]
+    else
+        PushFrozenProxy(pState, tableIndex, false);                         //  [t, proxy]
+    lua_remove(pState, -2);                                                 //  [proxy]
+
+    ClearRef();
+    CreateRegisteryEntryFromStack();                                        //  []
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Returns true if this variable is a frozen table.  A frozen table can be shared with scripts as-is.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaVar::IsFrozen() const
+{
+    return DoLuaAction([this]() -> bool
+    {
+        lua_State* pState = m_pState->GetState();
+        return IsFrozenTable(pState, lua_gettop(pState));
+    });
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Sorts this array of tables by the value of one field in each element.  This is much faster than table.sort() with 
+// a Lua comparator since the keys are only looked up once and the comparisons happen in C++.  See SortArrayBy() in 
+// LuaArrayLib.h for the rules.
+//      -key:       The field to sort by.
+//      -order:     Ascending or descending.
+//      -return:    true if the array was sorted, false if not.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaVar::SortBy(const char* key, LuaSortOrder order) const
+{
+    if (IsFrozen())
+    {
+        LUA_ERROR("Attempting to call SortBy() on a frozen table.");
+        return false;
+    }
+    if (!IsTable())
+    {
+        LUA_ERROR("Attempting to call SortBy() on var that isn't a table.  Type is " + GetTypeNameStr());
+        return false;
+    }
+
+    lua_State* pState = m_pState->GetState();
+    PushValueToStack();                                                     //  [t]
+    lua_pushstring(pState, key);                                            //  [t, key]
+    const int top = lua_gettop(pState);
+
+    const char* pError = nullptr;
+    const bool sorted = SortArrayBy(pState, top - 1, top, order, &pError);
+    lua_pop(pState, 2);                                                     //  []
+
+    if (!sorted)
+        LUA_ERROR("SortBy() failed: " + luastl::string(pError));
+    return sorted;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -429,7 +698,7 @@ void LuaVar::WrapObjectPtr(void* pPtr)
     ClearRef();
 
     // allocate a new userdatum and copy over the pointer
-    void* pUserData = lua_newuserdata(m_pState->GetState(), sizeof(void*));     //  [userdata]
+    void* pUserData = Compat::NewUserData(m_pState->GetState(), sizeof(void*)); //  [userdata]
     memcpy(pUserData, &pPtr, sizeof(void*));
 
     // create the Lua object
@@ -458,11 +727,10 @@ bool LuaVar::PushValueToStack(bool allowNil /*= true*/) const
 //---------------------------------------------------------------------------------------------------------------------
 void LuaVar::CreateRegisteryEntryFromStack()
 {
-    LUA_ASSERT(!m_pRefCount);
     LUA_ASSERT(m_reference == LUA_REFNIL);
     m_reference = luaL_ref(m_pState->GetState(), LUA_REGISTRYINDEX);  // adds the top of the stack as a new value in the registry, returning the reference to it
     if (m_reference != LUA_REFNIL)
-        m_pRefCount = BLEACHLUA_NEW(_Internal::RefCount);
+        m_pState->InitRefCount(m_reference);
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -481,7 +749,7 @@ bool LuaVar::CompareHelper(const LuaVar& right, int op) const
     right.PushValueToStack();                                       //  [left, right]
 
     // compare the values and clean up the stack
-    int result = lua_compare(m_pState->GetState(), -1, -2, op);     //  [left, right]
+    int result = Compat::Compare(m_pState->GetState(), -1, -2, op); //  [left, right]
     lua_pop(m_pState->GetState(), 2);                               //  []
 
     return result == 1;
@@ -496,9 +764,8 @@ void LuaVar::Copy(const LuaVar& right)
 
     m_pState = right.m_pState;
     m_reference = right.m_reference;
-    m_pRefCount = right.m_pRefCount;
-    if (m_pRefCount)
-        m_pRefCount->Increment();
+    if (m_reference != LUA_REFNIL)
+        m_pState->AddRefCount(m_reference);
 }
 
 void LuaVar::Move(LuaVar&& right) noexcept
@@ -507,11 +774,9 @@ void LuaVar::Move(LuaVar&& right) noexcept
 
     m_pState = right.m_pState;
     m_reference = right.m_reference;
-    m_pRefCount = right.m_pRefCount;
 
     right.m_pState = nullptr;
     right.m_reference = LUA_REFNIL;
-    right.m_pRefCount = nullptr;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -530,6 +795,14 @@ TableIterator LuaVar::InternalBegin() const
 
     // push the table onto the stack
     PushValueToStack();                                                                             //  [t]
+
+    // iterate over the data of a frozen table, not the empty proxy
+    if (IsFrozenTable(m_pState->GetState(), lua_gettop(m_pState->GetState())))
+    {
+        PushFrozenSource(m_pState->GetState(), -1);                                                 //  [proxy, source]
+        lua_remove(m_pState->GetState(), -2);                                                       //  [source]
+    }
+
     if (!lua_istable(m_pState->GetState(), -1))
     {
         LUA_ERROR("Trying to get an iterator for a variable that isn't a table.");
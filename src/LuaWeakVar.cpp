@@ -0,0 +1,217 @@
+//---------------------------------------------------------------------------------------------------------------------
+// MIT License
+// 
+// Copyright(c) 2021 David "Rez" Graham
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// 
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <BleachLua/LuaWeakVar.h>
+#include <BleachLua/LuaState.h>
+
+namespace BleachLua {
+
+//---------------------------------------------------------------------------------------------------------------------
+// The weak table lives in the registry under the address of s_weakTableKey.  Index 0 holds the head of the free slot 
+// list and index -1 holds the highest slot ever handed out.  Free slots hold the next free slot.  These are all 
+// numbers, which the collector never removes.
+//---------------------------------------------------------------------------------------------------------------------
+static char s_weakTableKey;  // the address is the registry key
+static constexpr int kFreeListIndex = 0;
+static constexpr int kHighestSlotIndex = -1;
+
+static void PushWeakTable(lua_State* pState)
+{
+    lua_pushlightuserdata(pState, &s_weakTableKey);                         //  [key]
+    lua_rawget(pState, LUA_REGISTRYINDEX);                                  //  [weak|nil]
+    if (!lua_isnil(pState, -1))
+        return;
+    lua_pop(pState, 1);                                                     //  []
+
+    lua_newtable(pState);                                                   //  [weak]
+    lua_createtable(pState, 0, 1);                                          //  [weak, metatable]
+    lua_pushliteral(pState, "v");                                           //  [weak, metatable, "v"]
+    lua_setfield(pState, -2, "__mode");                                     //  [weak, metatable]
+    lua_setmetatable(pState, -2);                                           //  [weak]
+
+    lua_pushlightuserdata(pState, &s_weakTableKey);                         //  [weak, key]
+    lua_pushvalue(pState, -2);                                              //  [weak, key, weak]
+    lua_rawset(pState, LUA_REGISTRYINDEX);                                  //  [weak]
+}
+
+static int GetIntegerField(lua_State* pState, int tableIndex, int index)
+{
+    lua_rawgeti(pState, tableIndex, index);                                 //  [value]
+    const int value = static_cast<int>(lua_tointeger(pState, -1));  // nil converts to 0
+    lua_pop(pState, 1);                                                     //  []
+    return value;
+}
+
+static void SetIntegerField(lua_State* pState, int tableIndex, int index, int value)
+{
+    lua_pushinteger(pState, value);                                         //  [value]
+    lua_rawseti(pState, tableIndex, index);                                 //  []
+}
+
+LuaWeakVar::LuaWeakVar(const LuaVar& var)
+    : LuaWeakVar()
+{
+    (*this) = var;
+}
+
+LuaWeakVar::LuaWeakVar(const LuaWeakVar& right)
+    : LuaWeakVar()
+{
+    (*this) = right;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Points this at a value.  Nil leaves this empty.
+//      -var:   The value to reference weakly.
+//---------------------------------------------------------------------------------------------------------------------
+LuaWeakVar& LuaWeakVar::operator=(const LuaVar& var)
+{
+    Reset();
+    if (!var.GetLuaState() || !var.IsValid())
+        return (*this);
+
+    var.PushValueToStack();                                                 //  [value]
+    SetFromStack(var.GetLuaState());                                        //  []
+    return (*this);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Copies another weak reference.  Each LuaWeakVar owns its own slot, so this takes a new one.  If the right side is 
+// dead, this ends up empty.
+//---------------------------------------------------------------------------------------------------------------------
+LuaWeakVar& LuaWeakVar::operator=(const LuaWeakVar& right)
+{
+    if (&right == this)
+        return (*this);
+
+    Reset();
+    if (right.PushValue())                                                  //  [value]
+        SetFromStack(right.m_pState);                                       //  []
+    return (*this);
+}
+
+LuaWeakVar& LuaWeakVar::operator=(LuaWeakVar&& right) noexcept
+{
+    if (&right == this)
+        return (*this);
+
+    Reset();
+    m_pState = right.m_pState;
+    m_slot = right.m_slot;
+    right.m_slot = LUA_REFNIL;
+    return (*this);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Returns a strong reference to the value, or nil if it has been collected.  Keep the result only as long as you need 
+// the value alive.
+//---------------------------------------------------------------------------------------------------------------------
+LuaVar LuaWeakVar::Lock() const
+{
+    if (!PushValue())                                                       //  [value]
+        return m_pState ? LuaVar(m_pState) : LuaVar();
+    return LuaVar::CreateFromStack(m_pState);                               //  []
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Returns true if the value is still around.  A value that's only weakly referenced may still be alive until the next 
+// collection gets to it.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaWeakVar::IsAlive() const
+{
+    if (!PushValue())                                                       //  [value]
+        return false;
+    lua_pop(m_pState->GetState(), 1);                                       //  []
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Gives this variable's slot back to the free list, leaving it empty.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaWeakVar::Reset()
+{
+    if (m_slot == LUA_REFNIL)
+        return;
+
+    lua_State* pState = m_pState->GetState();
+    PushWeakTable(pState);                                                  //  [weak]
+    SetIntegerField(pState, -1, m_slot, GetIntegerField(pState, -1, kFreeListIndex));
+    SetIntegerField(pState, -1, kFreeListIndex, m_slot);
+    lua_pop(pState, 1);                                                     //  []
+    m_slot = LUA_REFNIL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Takes a slot for the value at the top of the stack and pops it.  This must be empty when it's called.
+//---------------------------------------------------------------------------------------------------------------------
+void LuaWeakVar::SetFromStack(LuaState* pState)
+{
+    LUA_ASSERT(m_slot == LUA_REFNIL);
+    m_pState = pState;
+
+    lua_State* pLuaState = pState->GetState();
+    if (lua_isnil(pLuaState, -1))
+    {
+        lua_pop(pLuaState, 1);                                              //  []
+        return;
+    }
+
+    PushWeakTable(pLuaState);                                               //  [value, weak]
+    m_slot = GetIntegerField(pLuaState, -1, kFreeListIndex);
+    if (m_slot != 0)
+    {
+        SetIntegerField(pLuaState, -1, kFreeListIndex, GetIntegerField(pLuaState, -1, m_slot));
+    }
+    else
+    {
+        m_slot = GetIntegerField(pLuaState, -1, kHighestSlotIndex) + 1;
+        SetIntegerField(pLuaState, -1, kHighestSlotIndex, m_slot);
+    }
+
+    lua_insert(pLuaState, -2);                                              //  [weak, value]
+    lua_rawseti(pLuaState, -2, m_slot);                                     //  [weak]
+    lua_pop(pLuaState, 1);                                                  //  []
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Pushes the value if it's still alive.
+//      -return:    true if a value was pushed, false if nothing was.
+//---------------------------------------------------------------------------------------------------------------------
+bool LuaWeakVar::PushValue() const
+{
+    if (m_slot == LUA_REFNIL)
+        return false;
+
+    lua_State* pState = m_pState->GetState();
+    PushWeakTable(pState);                                                  //  [weak]
+    lua_rawgeti(pState, -1, m_slot);                                        //  [weak, value]
+    lua_remove(pState, -2);                                                 //  [value]
+    if (lua_isnil(pState, -1))
+    {
+        lua_pop(pState, 1);                                                 //  []
+        return false;
+    }
+    return true;
+}
+
+}  // end namespace BleachLua
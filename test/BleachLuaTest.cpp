@@ -41,5 +41,10 @@ int main()
     testApp.CallCppFunctionsFromLua();
     testApp.FunWithTables();
 
-    return 0;
+    testApp.TestTimerWheel();
+    testApp.TestMemoizedFunction();
+    testApp.TestDeferredUnrefs();
+    testApp.TestLuaVarRefCounts();
+
+    return (testApp.GetNumFailedChecks() == 0) ? 0 : 1;
 }
@@ -25,7 +25,12 @@
 #include "TestApp.h"
 #include <assert.h>
 #include <BleachLua/LuaFunction.h>
+#include <BleachLua/LuaMemoize.h>
+#include <BleachLua/LuaTimerWheel.h>
 #include <BleachLua/TableIterator.h>
+#include <iostream>
+#include <list>
+#include <algorithm>
 
 using namespace BleachLua;
 
@@ -167,6 +172,245 @@ void TestApp::FunWithTables()
     printTable(animals);
 }
 
+// Like assert(), but it's checked in every build configuration, and a failure is reported and counted rather than 
+// fatal, so main() can return an error once everything has run.
+#define TEST_CHECK(_expr) Check((_expr), #_expr, __FILE__, __LINE__)
+
+bool TestApp::Check(bool passed, const char* expression, const char* file, int line)
+{
+    if (!passed)
+    {
+        std::cout << file << "(" << line << "): check failed: " << expression << "\n";
+        ++m_numFailedChecks;
+    }
+    return passed;
+}
+
+void TestApp::ReportResults(const char* name, int numFailedChecksBefore) const
+{
+    if (m_numFailedChecks == numFailedChecksBefore)
+        std::cout << name << " tests passed\n";
+    else
+        std::cout << name << " tests FAILED (" << (m_numFailedChecks - numFailedChecksBefore) << " checks)\n";
+}
+
+void TestApp::TestTimerWheel()
+{
+    std::cout << "\n===== Timer Wheel =====\n";
+    const int numFailedChecks = m_numFailedChecks;
+
+    // one tick per second keeps the math exact
+    LuaTimerWheel timers(&m_luaState, 1.0);
+    OpenTimerLib(&m_luaState, &timers);
+
+    m_luaState.DoString("timersFired = 0 function OnTimerFired() timersFired = timersFired + 1 end");
+    LuaVar onTimerFired = m_luaState.GetGlobal<LuaVar>("OnTimerFired");
+
+    // Start off of a level boundary so the cascades don't line up with the delays.
+    timers.Advance(37);
+
+    // Delays on each side of every level boundary, plus a few past the last level, which get parked and 
+    // rescheduled as time catches up.  They're all pending at once, so cascades carry several timers.
+    const uint32_t kDelays[] = { 1, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 262145, (1u << 24) - 1, 1u << 24, 
+        (1u << 24) + 1, (1u << 24) + 5000, 3u * (1u << 24) + 7 };
+    constexpr size_t kNumDelays = sizeof(kDelays) / sizeof(kDelays[0]);
+    LuaTimerWheel::TimerHandle handles[kNumDelays];
+    for (size_t i = 0; i < kNumDelays; ++i)
+        handles[i] = timers.After(kDelays[i], onTimerFired);
+
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < kNumDelays; ++i)
+    {
+        // nothing fires until the tick it's due, and then exactly that timer fires
+        timers.Advance(static_cast<double>(kDelays[i] - 1 - elapsed));
+        TEST_CHECK(m_luaState.GetGlobal<int>("timersFired") == static_cast<int>(i));
+        TEST_CHECK(timers.IsPending(handles[i]));
+
+        timers.Advance(1);
+        TEST_CHECK(m_luaState.GetGlobal<int>("timersFired") == static_cast<int>(i + 1));
+        TEST_CHECK(!timers.IsPending(handles[i]));
+        elapsed = kDelays[i];
+    }
+    TEST_CHECK(timers.GetNumTimers() == 0);
+
+    // A repeating timer can cancel itself, and a timer can cancel another one that's due on the same tick (so only 
+    // one of the pair runs, whichever goes first).  A one-shot timer is already gone by the time its callback runs.
+    m_luaState.DoString(R"(
+        repeatCount = 0
+        bleach.timer.every(1, function(handle)
+            repeatCount = repeatCount + 1
+            if repeatCount == 3 then
+                bleach.timer.cancel(handle)
+            end
+        end)
+
+        sameTickFired = 0
+        local first, second
+        first = bleach.timer.after(5, function() sameTickFired = sameTickFired + 1 bleach.timer.cancel(second) end)
+        second = bleach.timer.after(5, function() sameTickFired = sameTickFired + 1 bleach.timer.cancel(first) end)
+
+        bleach.timer.after(2, function(handle) cancelOwnOneShot = bleach.timer.cancel(handle) end)
+
+        -- handles are integers wherever Lua has them
+        handleIsInteger = (math.type == nil) or (math.type(bleach.timer.after(1, function() end)) == "integer")
+    )");
+    timers.Advance(10);
+    TEST_CHECK(m_luaState.GetGlobal<int>("repeatCount") == 3);
+    TEST_CHECK(m_luaState.GetGlobal<int>("sameTickFired") == 1);
+    TEST_CHECK(!m_luaState.GetGlobal<bool>("cancelOwnOneShot"));
+    TEST_CHECK(m_luaState.GetGlobal<bool>("handleIsInteger"));
+    TEST_CHECK(timers.GetNumTimers() == 0);
+
+    // garbage handles don't name a timer
+    m_luaState.DoString("badHandles = bleach.timer.cancel(1e300) or bleach.timer.cancel(-1) or bleach.timer.pending(0/0)");
+    TEST_CHECK(!m_luaState.GetGlobal<bool>("badHandles"));
+
+    // the wheel is about to go away
+    m_luaState.DoString("bleach.timer = nil");
+    ReportResults("Timer wheel", numFailedChecks);
+}
+
+void TestApp::TestMemoizedFunction()
+{
+    std::cout << "\n===== Memoized Function =====\n";
+    const int numFailedChecks = m_numFailedChecks;
+
+    m_luaState.DoString("memoCalls = 0 function MemoSquare(x) memoCalls = memoCalls + 1 return x * x end");
+    LuaMemoizedFunction<int> square = LuaFunction<int>(m_luaState.GetGlobal<LuaVar>("MemoSquare")).Memoize(4);
+
+    // Four entries share eight slots, so probes collide and every eviction shifts entries back.  A plain list is the 
+    // reference LRU; the cache has to agree with it on every hit and miss.
+    constexpr size_t kCapacity = 4;
+    std::list<int> reference;
+    size_t expectedHits = 0;
+    uint32_t random = 12345;
+    for (int i = 0; i < 5000; ++i)
+    {
+        random = random * 1664525u + 1013904223u;
+        const int key = static_cast<int>((random >> 16) % 11);
+
+        const auto found = std::find(reference.begin(), reference.end(), key);
+        if (found != reference.end())
+        {
+            ++expectedHits;
+            reference.erase(found);
+        }
+        else if (reference.size() == kCapacity)
+        {
+            reference.pop_back();
+        }
+        reference.push_front(key);
+
+        const int result = square(key);
+        TEST_CHECK(result == key * key);
+        TEST_CHECK(square.GetNumHits() == expectedHits);
+    }
+    TEST_CHECK(square.GetSize() == kCapacity);
+    TEST_CHECK(m_luaState.GetGlobal<size_t>("memoCalls") == square.GetNumMisses());
+
+    // string literals and pointers make the same key
+    m_luaState.DoString("function MemoLength(s) return #s end");
+    LuaMemoizedFunction<int> length = LuaFunction<int>(m_luaState.GetGlobal<LuaVar>("MemoLength")).Memoize(4);
+    const char* pHello = "hello";
+    TEST_CHECK(length("hello") == 5);
+    TEST_CHECK(length(pHello) == 5);
+    TEST_CHECK(length.GetNumHits() == 1);
+    TEST_CHECK(length.GetNumMisses() == 1);
+
+    ReportResults("Memoized function", numFailedChecks);
+}
+
+// A weak table sees whether anything else still holds the watched value.  This uses lua_gc() directly, since 
+// CollectGarbage() flushes deferred unrefs first.
+void TestApp::WatchValue(const LuaVar& value)
+{
+    m_luaState.DoString("refWatch = refWatch or setmetatable({}, { __mode = 'v' })");
+    m_luaState.SetGlobal("refWatchNew", value);
+    m_luaState.DoString("refWatch[1] = refWatchNew refWatchNew = nil");
+}
+
+bool TestApp::IsWatchedValueAlive()
+{
+    lua_gc(m_luaState.GetState(), LUA_GCCOLLECT, 0);
+    m_luaState.DoString("refWatchAlive = (refWatch[1] ~= nil)");
+    return m_luaState.GetGlobal<bool>("refWatchAlive");
+}
+
+void TestApp::TestDeferredUnrefs()
+{
+    std::cout << "\n===== Deferred Unrefs =====\n";
+    const int numFailedChecks = m_numFailedChecks;
+
+    // with deferring on, the last release keeps the value alive until the flush
+    m_luaState.SetDeferUnrefs(true);
+    {
+        LuaVar deferred;
+        deferred.CreateNewTable();
+        WatchValue(deferred);
+        LuaVar copy = deferred;
+        deferred = LuaVar();
+        TEST_CHECK(m_luaState.GetNumDeferredUnrefs() == 0);
+    }
+    TEST_CHECK(m_luaState.GetNumDeferredUnrefs() == 1);
+    TEST_CHECK(IsWatchedValueAlive());
+    TEST_CHECK(m_luaState.FlushDeferredUnrefs() == 1);
+    TEST_CHECK(!IsWatchedValueAlive());
+    m_luaState.SetDeferUnrefs(false);
+
+    m_luaState.DoString("refWatch = nil");
+    ReportResults("Deferred unref", numFailedChecks);
+}
+
+void TestApp::TestLuaVarRefCounts()
+{
+    std::cout << "\n===== LuaVar Ref Counts =====\n";
+    const int numFailedChecks = m_numFailedChecks;
+
+    // copies and moves share one ref; the table lives until the last of them lets go
+    {
+        LuaVar original;
+        original.CreateNewTable();
+        WatchValue(original);
+
+        LuaVar copy = original;
+        LuaVar moved = std::move(copy);
+        TEST_CHECK(copy.IsNil());
+        original = LuaVar();
+        TEST_CHECK(IsWatchedValueAlive());
+
+        LuaVar assigned;
+        assigned = moved;
+        const LuaVar& alias = assigned;
+        assigned = alias;  // self-assignment mustn't drop the count
+        moved = LuaVar();
+        TEST_CHECK(IsWatchedValueAlive());
+
+        assigned = LuaVar();
+        TEST_CHECK(!IsWatchedValueAlive());
+    }
+
+    // refs freed by a deferred flush get reused, and their counts have to start over at one
+    m_luaState.SetDeferUnrefs(true);
+    {
+        LuaVar released;
+        released.CreateNewTable();
+    }
+    m_luaState.FlushDeferredUnrefs();
+    m_luaState.SetDeferUnrefs(false);
+    {
+        LuaVar reused;
+        reused.CreateNewTable();
+        WatchValue(reused);
+        LuaVar copy = reused;
+        reused = LuaVar();
+        TEST_CHECK(IsWatchedValueAlive());
+    }
+    TEST_CHECK(!IsWatchedValueAlive());
+
+    m_luaState.DoString("refWatch = nil");
+    ReportResults("LuaVar ref count", numFailedChecks);
+}
+
 int TestApp::FastSquare(int val)
 {
     return val * val;
@@ -29,6 +29,7 @@
 class TestApp
 {
     BleachLua::LuaState m_luaState;
+    int m_numFailedChecks = 0;
 
 public:
     ~TestApp();
@@ -39,7 +40,19 @@ public:
     void CallCppFunctionsFromLua();
     void FunWithTables();
 
+    // regression tests; failed checks are reported in every build configuration
+    void TestTimerWheel();
+    void TestMemoizedFunction();
+    void TestDeferredUnrefs();
+    void TestLuaVarRefCounts();
+    int GetNumFailedChecks() const { return m_numFailedChecks; }
+
 private:
+    bool Check(bool passed, const char* expression, const char* file, int line);  // use TEST_CHECK()
+    void ReportResults(const char* name, int numFailedChecksBefore) const;
+    void WatchValue(const BleachLua::LuaVar& value);
+    bool IsWatchedValueAlive();
+
     // called from Lua as part of the call-into-C++ example
     static int FastSquare(int val);
     void PrintString(const char* str) const;  // const and non-const member functions are both allowed